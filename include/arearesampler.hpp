@@ -0,0 +1,61 @@
+#ifndef AREARESAMPLER_HPP
+#define AREARESAMPLER_HPP
+
+
+// C++ headers
+#include <cstdint>
+#include <vector>
+
+
+namespace BMP
+{
+
+
+    // streaming area (box) filter for reducing an image
+    // source rows are pushed one at a time in memory order, and each
+    // destination row is returned as soon as every source row covering it
+    // has been pushed, so only one source row is needed at a time
+    // the destination must not be larger than the source in either direction
+    class AreaResampler
+    {
+
+        uint64_t m_src_width;
+        uint64_t m_src_height;
+        uint64_t m_dst_width;
+        uint64_t m_dst_height;
+        uint64_t m_channels;
+
+        // taps of destination pixel x are m_tap_begin[x] to m_tap_begin[x + 1]
+        std::vector<uint64_t> m_tap_begin;
+        std::vector<uint64_t> m_tap_source;
+        std::vector<uint32_t> m_tap_weight;
+
+        // horizontally filtered source row, and weighted sum of such rows
+        std::vector<uint32_t> m_row;
+        std::vector<uint64_t> m_accumulator;
+        std::vector<uint8_t> m_output;
+
+        uint64_t m_src_row;
+        uint64_t m_dst_row;
+
+        void finish_row();
+
+    public:
+
+        // channels is the number of bytes per pixel
+        AreaResampler(const uint64_t src_width, const uint64_t src_height, const uint64_t dst_width, const uint64_t dst_height, const uint64_t channels);
+
+        // add the next source row (src_width * channels bytes)
+        // returns the completed destination row (dst_width * channels bytes,
+        // valid until the next call) or nullptr if no row was completed
+        const uint8_t* PushRow(const uint8_t* const row);
+
+        // index of the next destination row to be completed
+        uint64_t DstRow() const;
+
+    };
+
+
+}
+
+#endif // AREARESAMPLER_HPP
@@ -0,0 +1,139 @@
+#ifndef BASICBITMAP_HPP
+#define BASICBITMAP_HPP
+
+
+// C++ headers
+#include <cstdint>
+#include <type_traits>
+
+
+namespace BMP
+{
+
+
+    ////////////////////////////////////////////////////////////////////////////
+    // pixel formats
+    ////////////////////////////////////////////////////////////////////////////
+
+    // size and channel layout of a pixel as compile time constants
+    // channel positions are indices into the channels of one pixel, -1 if
+    // the format has no such channel
+
+    struct Gray8
+    {
+        typedef uint8_t channel_type;
+        static const uint16_t bit_count{8};
+        static const int channels{1};
+        static const int b{0};
+        static const int g{0};
+        static const int r{0};
+        static const int a{-1};
+    };
+
+    struct Gray16
+    {
+        typedef uint16_t channel_type;
+        static const uint16_t bit_count{16};
+        static const int channels{1};
+        static const int b{0};
+        static const int g{0};
+        static const int r{0};
+        static const int a{-1};
+    };
+
+    struct Bgr24
+    {
+        typedef uint8_t channel_type;
+        static const uint16_t bit_count{24};
+        static const int channels{3};
+        static const int b{0};
+        static const int g{1};
+        static const int r{2};
+        static const int a{-1};
+    };
+
+    struct Bgra32
+    {
+        typedef uint8_t channel_type;
+        static const uint16_t bit_count{32};
+        static const int channels{4};
+        static const int b{0};
+        static const int g{1};
+        static const int r{2};
+        static const int a{3};
+    };
+
+
+    ////////////////////////////////////////////////////////////////////////////
+    // typed view
+    ////////////////////////////////////////////////////////////////////////////
+
+    // rows of pixels of format F, the view does not own the memory
+    // row_bytes is the distance between rows including padding, rows are in
+    // memory order (bottom up for bitmaps)
+    // BYTE_TYPE is const uint8_t for a read only view
+    // the pixel size is a constant, so loops over a view can be unrolled and
+    // vectorized by the compiler for each format
+    template<typename F, typename BYTE_TYPE = uint8_t>
+    class BasicBitmap
+    {
+
+    public:
+
+        typedef F format_type;
+        typedef typename std::conditional<std::is_const<BYTE_TYPE>::value,
+            const typename F::channel_type, typename F::channel_type>::type channel_type;
+
+        static const int channels{F::channels};
+        static const uint64_t bytes_per_pixel{sizeof(typename F::channel_type) * F::channels};
+
+    private:
+
+        BYTE_TYPE* m_data;
+        uint64_t m_width;
+        uint64_t m_height;
+        uint64_t m_row_bytes;
+
+    public:
+
+        BasicBitmap(BYTE_TYPE* const data, const uint64_t width, const uint64_t height, const uint64_t row_bytes)
+            : m_data{data}
+            , m_width{width}
+            , m_height{height}
+            , m_row_bytes{row_bytes}
+        {
+        }
+
+        uint64_t Width() const
+        {
+            return m_width;
+        }
+
+        uint64_t Height() const
+        {
+            return m_height;
+        }
+
+        uint64_t RowBytes() const
+        {
+            return m_row_bytes;
+        }
+
+        // first channel of row y
+        channel_type* Row(const uint64_t y) const
+        {
+            return (channel_type*)(m_data + y * m_row_bytes);
+        }
+
+        // first channel of pixel x, y
+        channel_type* Pixel(const uint64_t x, const uint64_t y) const
+        {
+            return Row(y) + x * F::channels;
+        }
+
+    };
+
+
+}
+
+#endif // BASICBITMAP_HPP
@@ -4,6 +4,7 @@
 
 // Local headers
 #include "pixelrgb.hpp"
+#include "basicbitmap.hpp"
 
 // C++ headers
 #include <string>
@@ -11,6 +12,7 @@
 #include <fstream>
 #include <cstdint>
 #include <vector>
+#include <utility>
 
 
 namespace BMP
@@ -26,12 +28,33 @@ namespace BMP
 
 
 
+    // 64 bit non-cryptographic hash of count bytes (XXH64)
+    uint64_t HashBytes(const uint8_t* const data, const LONG count, const uint64_t seed = 0);
+
+
+    // rectangle in bitmap coordinates
+    // (x, y) is the corner with the lowest memory address, rows are stored
+    // bottom up so this is the lower left corner of the image
+    struct Rect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+
     enum class KernelMode
     {
         UNDEFINED,
         AND,
         OR,
-        XOR
+        XOR,
+        COPY, // output = r
+        ADD, // saturating add
+        SUBTRACT, // saturating subtract, output = l - r
+        MIN,
+        MAX
     };
 
 
@@ -52,52 +75,26 @@ namespace BMP
         {
         }
 
+        KernelMode Mode() const
+        {
+            return mode;
+        }
+
+        // row kernel, output[c] = l[c] (op) r[c] for count consecutive bytes
+        // the mode is dispatched once per call and the loop is SIMD
+        // output may be the same address as l
+        void row(uint8_t * const output, const uint8_t * const l, const uint8_t * const r, const LONG count) const;
+
         // binary kernel
         void operator()(uint8_t * const output, const uint8_t * const l, const uint8_t * const r, const int count = 1)
         {
-            for(int c{0}; c < count; ++ c)
-            {
-                if(mode == KernelMode::UNDEFINED)
-                {
-                    // nothing
-                }
-                else if(mode == KernelMode::AND)
-                {
-                    output[c] = l[c] & r[c];
-                }
-                else if(mode == KernelMode::OR)
-                {
-                    output[c] = l[c] | r[c];
-                }
-                else if(mode == KernelMode::XOR)
-                {
-                    output[c] = l[c] ^ r[c];
-                }
-            }
+            row(output, l, r, count);
         }
 
         // unary kernel
         void operator()(uint8_t * const output, const uint8_t * const input, const int count = 1)
         {
-            for(int c{0}; c < count; ++ c)
-            {
-                if(mode == KernelMode::UNDEFINED)
-                {
-                    // nothing
-                }
-                else if(mode == KernelMode::AND)
-                {
-                    output[c] &= input[c];
-                }
-                else if(mode == KernelMode::OR)
-                {
-                    output[c] |= input[c];
-                }
-                else if(mode == KernelMode::XOR)
-                {
-                    output[c] ^= input[c];
-                }
-            }
+            row(output, output, input, count);
         }
 
 
@@ -120,6 +117,10 @@ namespace BMP
             {
                 output = input_l ^ input_r;
             }
+            else
+            {
+                row((uint8_t*)&output, (const uint8_t*)&input_l, (const uint8_t*)&input_r, 3);
+            }
         }
 
         // unary kernel
@@ -141,6 +142,10 @@ namespace BMP
             {
                 output ^= input;
             }
+            else
+            {
+                row((uint8_t*)&output, (const uint8_t*)&output, (const uint8_t*)&input, 3);
+            }
         }
         
 
@@ -149,6 +154,236 @@ namespace BMP
 
 
 
+    // how pixels outside the bitmap are read by neighbourhood operations
+    enum class EdgeMode
+    {
+        CLAMP, // repeat edge pixel
+        MIRROR, // reflect about edge pixel, edge pixel not repeated
+        WRAP, // tile
+        ZERO // black
+    };
+
+
+    // 2x3 affine transform, maps (x, y) to (a * x + b * y + c, d * x + e * y + f)
+    // coordinates are bitmap coordinates, so positive angles rotate counter
+    // clockwise as the image is displayed
+    struct AffineMatrix
+    {
+        double a;
+        double b;
+        double c;
+        double d;
+        double e;
+        double f;
+
+        static AffineMatrix Identity();
+        static AffineMatrix Translation(const double dx, const double dy);
+        static AffineMatrix Scale(const double sx, const double sy);
+        static AffineMatrix Shear(const double shx, const double shy);
+
+        // rotation by angle (radians) about the origin, or about (cx, cy)
+        static AffineMatrix Rotation(const double angle);
+        static AffineMatrix Rotation(const double angle, const double cx, const double cy);
+
+        // transform which applies r first, then *this
+        AffineMatrix operator*(const AffineMatrix& r) const;
+
+        // inverse transform, the determinant must be non-zero
+        AffineMatrix Inverse() const;
+
+        double Determinant() const;
+    };
+
+
+    enum class Interpolation
+    {
+        NEAREST,
+        BILINEAR
+    };
+
+
+    // how an image is reduced while it is loaded
+    enum class ShrinkMode
+    {
+        AREA, // average of all source pixels covered by each pixel
+        SKIP // nearest source pixel, rows which are not needed are not read
+    };
+
+
+    // result of validating the headers of a bitmap file
+    enum class ProbeStatus
+    {
+        OK,
+        OPEN_FAILED, // file could not be opened
+        TRUNCATED, // file shorter than the headers
+        BAD_SIGNATURE, // no 'B'|'M' at the start
+        FILE_SIZE_MISMATCH, // bfSize differs from the file size
+        BAD_INFO_HEADER_SIZE,
+        BAD_PLANES,
+        BAD_BIT_COUNT, // not 8, 24 or 32 bit
+        DATA_SIZE_MISMATCH, // file size differs from that implied by the headers
+        COMPRESSED,
+        IMAGE_SIZE_MISMATCH, // biSizeImage differs from that implied by the size
+        TOP_DOWN // negative width or height, top down rows are not supported
+    };
+
+
+    // metadata of a bitmap file, the other fields are only valid if status
+    // is ProbeStatus::OK
+    struct BITMAPInfo
+    {
+        ProbeStatus status;
+        LONG width;
+        LONG height;
+        WORD bit_count;
+        DWORD data_offset; // offset of the pixel data in the file
+        uint64_t file_size;
+    };
+
+
+    // the message LoadBITMAP prints for status
+    const char* ProbeStatusMessage(const ProbeStatus status);
+
+
+    // statistics of one channel
+    struct ChannelStatistics
+    {
+        uint8_t min;
+        uint8_t max;
+        double mean;
+        double stddev;
+        uint64_t histogram[256];
+    };
+
+
+    // statistics of a bitmap
+    // channels are in memory order, 0 = blue, 1 = green, 2 = red, 3 = alpha
+    struct BITMAPStatistics
+    {
+        int channels;
+        ChannelStatistics channel[4];
+        uint64_t pixels;
+        uint64_t non_zero_pixels; // pixels with any non-zero channel
+    };
+
+
+    // neighbours of a pixel used by region operations
+    enum class Connectivity
+    {
+        FOUR, // left, right, above, below
+        EIGHT // and diagonals
+    };
+
+
+    // one connected component of a bitmap
+    struct Component
+    {
+        Rect bounds;
+        uint64_t area; // pixels
+        double centroid_x;
+        double centroid_y;
+    };
+
+
+    // result of connected component labelling
+    // labels has width * height entries in the row order of the bitmap (the
+    // label of x, y is labels[y * width + x]), 0 is background and
+    // components[i] has label i + 1
+    struct ComponentLabels
+    {
+        LONG width;
+        LONG height;
+        std::vector<uint32_t> labels;
+        std::vector<Component> components;
+    };
+
+
+    // template matching metrics
+    enum class MatchMetric
+    {
+        SAD, // mean absolute difference per channel value, lower is better
+        NCC // normalized cross correlation of the luma, -1 to 1, higher is better
+    };
+
+
+    // result of FindTemplate, bounds is empty if no position passed the
+    // threshold, score is that of the best position found (0 if none)
+    struct TemplateMatch
+    {
+        Rect bounds;
+        double score;
+    };
+
+
+    // gradient operators for EdgeDetect, named by their smoothing weights
+    enum class EdgeOperator
+    {
+        SOBEL, // 1 2 1
+        SCHARR // 3 10 3, more accurate directions
+    };
+
+
+    // compositing modes for 32 bit (b, g, r, a) images
+    // src is drawn onto the backdrop dst
+    enum class CompositeMode
+    {
+        // Porter-Duff operators
+        CLEAR,
+        SRC,
+        DST,
+        SRC_OVER,
+        DST_OVER,
+        SRC_IN,
+        DST_IN,
+        SRC_OUT,
+        DST_OUT,
+        SRC_ATOP,
+        DST_ATOP,
+        XOR,
+        // blend modes (separable, composited with src over)
+        MULTIPLY,
+        SCREEN,
+        OVERLAY,
+        ADD, // saturating sum
+        LERP // dst + (src - dst) * opacity
+    };
+
+
+    class FunctorComposite
+    {
+
+        CompositeMode mode;
+        uint8_t opacity; // global opacity applied to src, 0xFF = opaque
+        bool premultiplied; // false if color channels are not multiplied by alpha
+
+    public:
+
+        FunctorComposite(const CompositeMode mode, const uint8_t opacity = 0xFF, const bool premultiplied = true)
+            : mode(mode)
+            , opacity(opacity)
+            , premultiplied(premultiplied)
+        {
+        }
+
+        // row kernel, composite count pixels (4 bytes each) of src onto dst
+        // and write the result to output
+        // output may be the same address as dst
+        void row(uint8_t * const output, const uint8_t * const dst, const uint8_t * const src, const LONG count) const;
+
+        // binary kernel
+        void operator()(uint8_t * const output, const uint8_t * const dst, const uint8_t * const src, const int count = 1)
+        {
+            row(output, dst, src, count);
+        }
+
+    };
+
+
+
+
+    class BITMAPMask;
+
+
     // bitmap surface class
     // base class for bitmap canvas and bitmap font classes
     // contains method for blit (copy)
@@ -167,6 +402,16 @@ namespace BMP
         LONG m_width_memory; // not same as width, includes padding (bytes)
         std::vector<uint8_t> m_data; // bitmap data
 
+        // areas changed since the last ResetDirty, only recorded while
+        // m_dirty_tracking is set
+        // the tracking state belongs to the object, it is not copied or
+        // swapped with the pixels
+        bool m_dirty_tracking;
+        std::vector<Rect> m_dirty;
+
+        // regions are merged once there are more than this many
+        static const size_t m_dirty_limit{16};
+
 
         struct BITMAPFILEHEADER
         {
@@ -202,7 +447,15 @@ namespace BMP
         //    return index;
         //}
         inline
-        uint64_t index(const LONG x, const LONG y) const;
+        uint64_t index(const LONG x, const LONG y) const
+        {
+            // note m_width_memory has unit of BYTE
+            // x has units of (index)
+            // y has units of (index)
+            // m_bit_count has units of BYTE
+            uint64_t index = ((m_bit_count / 8) * x + y * m_width_memory);
+            return index;
+        }
 
         // Convert (assumed 32 bit) integer into an array of 4 characters, in reverse order
         // This is required for setting the file length in the BITMAP header, etc
@@ -232,6 +485,21 @@ namespace BMP
         inline
         std::string filename_extension(const std::string& str) const;
 
+        // color palette written to file, empty unless the image is 8 bit
+        std::vector<uint8_t> palette() const;
+
+        // build a fill pattern of repeated pixels with value r, g, b, a
+        // 48 bytes is the lowest common multiple of the pixel size
+        // (1, 2, 3 or 4 bytes) and the width of a 16 byte SIMD register
+        void fill_pattern(uint8_t* const pattern, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a) const;
+
+        // write count bytes of a 48 byte fill pattern to dst
+        // dst must point to the start of a pixel
+        // if stream is true, non-temporal stores are used so that large
+        // fills do not evict the working set from cache
+        static
+        void fill_span(uint8_t* const dst, const LONG count, const uint8_t* const pattern, const bool stream);
+
 
     private:
 
@@ -239,6 +507,9 @@ namespace BMP
         friend
         void swap(BMP::BITMAP& l, BMP::BITMAP& r);
 
+        // reads pixels and file headers directly
+        friend class BITMAPMask;
+
         // TODO: WARNING: bit_count ONLY WORKS FOR 24, 32 BIT IMAGES! (due to / 8 operation)
 
 
@@ -247,6 +518,70 @@ namespace BMP
         void
         reinitialize(const LONG width, const LONG height, const WORD bit_count);
 
+        // sharpen by adding amount * (*this - blurred) where the difference is
+        // at least threshold
+        void unsharp(const BITMAP& blurred, const float amount, const uint8_t threshold);
+
+        // Erode or Dilate
+        void morphology(const bool dilate, const int radius_x, const int radius_y);
+
+        // MedianFilter of rows begin to end of *this into output, by sorting
+        // network (radius 1 or 2) or by sliding column histograms
+        void median_network(std::vector<uint8_t>& output, const int radius, const EdgeMode edge, const LONG begin, const LONG end) const;
+        void median_histogram(std::vector<uint8_t>& output, const int radius, const EdgeMode edge, const LONG begin, const LONG end) const;
+
+        // writable View which marks nothing dirty, for operations which
+        // mark exactly what they change
+        template<typename F>
+        BasicBitmap<F> view_unmarked();
+
+        // EdgeDetect, direction is not written if it is nullptr
+        BITMAP edge_detect(BITMAP * const direction, const EdgeOperator op, const EdgeMode edge) const;
+
+        // map coordinate i of a row or column of length n to a coordinate
+        // inside the bitmap, returns -1 if the pixel should be read as zero
+        static
+        int64_t edge_index(int64_t i, const int64_t n, const EdgeMode edge);
+
+        // copy a row of width pixels into padded, with radius pixels of edge
+        // padding on either side
+        static
+        void pad_row(uint8_t * const padded, const uint8_t * const row, const int64_t width, const int64_t bytes_per_pixel, const int64_t radius, const EdgeMode edge);
+
+        // checks shared by read_header, Probe and BITMAPMask::Load
+        // one_bit accepts only 1 bit images with a 2 entry palette, instead
+        // of 8, 24 and 32 bit images
+        static
+        ProbeStatus validate_header(const BITMAPFILEHEADER& f_head, const BITMAPINFOHEADER& i_head, const uint64_t file_size, const bool one_bit = false);
+
+        // read and validate the headers of a bitmap file, prints the reason
+        // and returns false if the file can not be loaded
+        bool read_header(std::ifstream& inputfile, BITMAPFILEHEADER& f_head, BITMAPINFOHEADER& i_head);
+
+        // LoadBITMAPShrink, if factor is non-zero it replaces width and height
+        void load_bitmap_shrink(const std::string& filename, int width, int height, const int factor, const ShrinkMode mode);
+
+        // area filtered reduction of src into all of dst, which must have
+        // the same bit count and not be larger than src
+        static
+        void resize_area(const BITMAP& src, BITMAP& dst);
+
+        // true if bitmap has the same size and bit count as *this
+        bool same_format(const BITMAP& bitmap) const;
+
+        // record that the area rect (clipped to the bitmap) has changed
+        void mark_dirty(const Rect& rect);
+
+        // record that all pixels have changed
+        void mark_dirty_all();
+
+        // planes in memory order b, g, r, a, a may be nullptr
+        void split_channels(BITMAP* const planes[4]) const;
+        void merge_channels(const BITMAP* const planes[4]);
+
+        // blit implementation, key is nullptr or points to a b, g, r color key
+        void blit(const BITMAP& src, const Rect& src_rect, const int dst_x, const int dst_y, const KernelMode rop, const uint8_t* const key);
+
 
     public:
 
@@ -300,15 +635,68 @@ namespace BMP
 
         void LoadBITMAP(const std::string& filename);
 
+        // load a bitmap reduced to width x height (never enlarged)
+        // the file is read one row at a time into the reduced image, so the
+        // full size image is never held in memory
+        void LoadBITMAPShrink(const std::string& filename, const int width, const int height, const ShrinkMode mode = ShrinkMode::AREA);
+
+        // as above, reduced by factor in each direction
+        void LoadBITMAPShrink(const std::string& filename, const int factor, const ShrinkMode mode = ShrinkMode::AREA);
+
+        // read and validate only the headers of a bitmap file, with the same
+        // checks as LoadBITMAP, nothing is printed
+        static
+        BITMAPInfo Probe(const std::string& filename);
+
+        // Probe each file, files are probed in parallel
+        static
+        std::vector<BITMAPInfo> ProbeMany(const std::vector<std::string>& filenames);
+
         // Saves data in array to file with correctly formatted
         // bitmap file header.
         void SaveAsBitmap(const std::string& filename) const;
 
+        LONG Width() const;
+        LONG Height() const;
+        WORD BitCount() const;
+
+        // set all pixels (and padding) to zero
         void Clear();
 
+        // set all pixels to color r, g, b
+        // a is only used by 32 bit images
+        void Fill(const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a = 0xFF);
+
+        // set all pixels inside rectangle to color r, g, b
+        // rectangle is clipped to the bitmap
+        void FillRect(const int x, const int y, const int width, const int height, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a = 0xFF);
+
         //std::vector<uint8_t>& Data();
 
 
+        ////////////////////////////////////////////////////////////////////////
+        // dirty tracking
+        ////////////////////////////////////////////////////////////////////////
+
+        // while enabled, operations which change pixels record the areas they
+        // changed, so that consumers can save or upload only those
+        // copies of a bitmap start with tracking disabled
+        void EnableDirtyTracking(const bool enable = true);
+        bool DirtyTracking() const;
+
+        // areas changed since the last ResetDirty, clipped to the bitmap
+        // regions may overlap, and are merged into larger ones when there
+        // are many of them
+        const std::vector<Rect>& DirtyRegions() const;
+        void ResetDirty();
+
+        // rewrite only the rows containing dirty regions in filename, which
+        // must hold a bitmap of the same size and bit count (eg, saved by
+        // SaveAsBitmap before the changes), otherwise the whole bitmap is saved
+        // the whole bitmap is also saved if dirty tracking is disabled
+        // dirty regions are not reset
+        void SaveDirtyRows(const std::string& filename) const;
+
         ////////////////////////////////////////////////////////////////////////
         // resize
         ////////////////////////////////////////////////////////////////////////
@@ -316,12 +704,287 @@ namespace BMP
         // dumb algorithm
         void Resize(const int width, const int height);
 
+        // area (box) filtered resize, every source pixel contributes to the
+        // result in proportion to its overlap, enlarging falls back to Resize
+        void ResizeArea(const int width, const int height);
+
+        // successive 2x box reductions in one pass over *this
+        // level i is (Width() >> (i + 1)) x (Height() >> (i + 1)), levels
+        // stop before either size reaches 0, an odd last row or column of a
+        // level is dropped by the next
+        std::vector<BITMAP> BuildPyramid(const int levels) const;
+
+        // area filtered resize of *this to width x height, starting from the
+        // smallest of *this and the pyramid levels not smaller than the target
+        BITMAP ResizeFromPyramid(const std::vector<BITMAP>& pyramid, const int width, const int height) const;
+
         ////////////////////////////////////////////////////////////////////////
         // translation
         ////////////////////////////////////////////////////////////////////////
 
         void Translate(const int dx, const int dy);
 
+        ////////////////////////////////////////////////////////////////////////
+        // warp
+        ////////////////////////////////////////////////////////////////////////
+
+        // draw *this into dst transformed by matrix (source to destination)
+        // pixels of dst which map outside *this are not changed
+        // dst must have the same bit count as *this
+        void Warp(BITMAP& dst, const AffineMatrix& matrix, const Interpolation interpolation = Interpolation::BILINEAR) const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // blit
+        ////////////////////////////////////////////////////////////////////////
+
+        // combine the area src_rect of src with *this using rop, placing the
+        // corner (src_rect.x, src_rect.y) at (dst_x, dst_y)
+        // the rectangle is clipped against both src and *this
+        void Blit(const BITMAP& src, const Rect& src_rect, const int dst_x, const int dst_y, const KernelMode rop = KernelMode::COPY);
+
+        // as above, but pixels of src with color key_r, key_g, key_b are
+        // transparent and leave *this unchanged
+        void BlitColorKey(const BITMAP& src, const Rect& src_rect, const int dst_x, const int dst_y, const uint8_t key_r, const uint8_t key_g, const uint8_t key_b, const KernelMode rop = KernelMode::COPY);
+
+        ////////////////////////////////////////////////////////////////////////
+        // convolution
+        ////////////////////////////////////////////////////////////////////////
+
+        // all channels are filtered, rows are processed in parallel bands
+
+        // separable convolution, kernel_x is applied along rows and kernel_y
+        // along columns, kernels have odd length with the centre at size / 2
+        // weights are used as given (not normalized)
+        void ConvolveSeparable(const std::vector<float>& kernel_x, const std::vector<float>& kernel_y, const EdgeMode edge = EdgeMode::CLAMP);
+
+        // mean of (2 * radius_x + 1) x (2 * radius_y + 1) pixels
+        // sliding window sum, cost does not depend on radius
+        void BoxBlur(const int radius_x, const int radius_y, const EdgeMode edge = EdgeMode::CLAMP);
+
+        // gaussian blur approximated by 3 box blurs, cost does not depend on sigma
+        void GaussianBlur(const float sigma, const EdgeMode edge = EdgeMode::CLAMP);
+
+        // gaussian blur with a true gaussian kernel of radius 3 * sigma
+        void GaussianBlurKernel(const float sigma, const EdgeMode edge = EdgeMode::CLAMP);
+
+        // *this + amount * (*this - 3x3 box blur)
+        void Sharpen(const float amount);
+
+        // *this + amount * (*this - gaussian blur) where the difference is at
+        // least threshold
+        void UnsharpMask(const float sigma, const float amount, const uint8_t threshold = 0);
+
+        // median of each channel over (2 * radius + 1) x (2 * radius + 1)
+        // pixels, radius is at most 127
+        // radius 1 and 2 use sorting networks on 16 bytes at a time, larger
+        // radii sliding column histograms (Perreault and Hebert), whose cost
+        // does not depend on radius
+        void MedianFilter(const int radius, const EdgeMode edge = EdgeMode::CLAMP);
+
+        ////////////////////////////////////////////////////////////////////////
+        // morphology
+        ////////////////////////////////////////////////////////////////////////
+
+        // minimum (Erode) or maximum (Dilate) of each channel over a
+        // (2 * radius_x + 1) x (2 * radius_y + 1) rectangle, pixels outside
+        // the bitmap are ignored
+        // van Herk / Gil-Werman, cost does not depend on radius
+        void Erode(const int radius_x, const int radius_y);
+        void Dilate(const int radius_x, const int radius_y);
+
+        // Erode then Dilate, and Dilate then Erode
+        void Open(const int radius_x, const int radius_y);
+        void Close(const int radius_x, const int radius_y);
+
+        ////////////////////////////////////////////////////////////////////////
+        // regions
+        ////////////////////////////////////////////////////////////////////////
+
+        // fill the 4-connected area of pixels equal to the pixel at x, y with
+        // r, g, b, a (8 bit images use b), scanline spans without recursion
+        // returns the bounding box of the filled pixels, width 0 if none
+        Rect FloodFill(const int x, const int y, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a = 0xFF);
+
+        // label connected areas of foreground pixels, those with a non-zero
+        // color channel (alpha is ignored), components are numbered in the
+        // memory order of their first pixel
+        // bands of rows are labelled in parallel with union-find and merged
+        // at the seams
+        ComponentLabels ConnectedComponents(const Connectivity connectivity = Connectivity::EIGHT) const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // statistics
+        ////////////////////////////////////////////////////////////////////////
+
+        // per channel histograms, min, max, mean, standard deviation and
+        // count of non-zero pixels, computed in a single parallel pass
+        BITMAPStatistics Statistics() const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // look up tables and color conversion
+        ////////////////////////////////////////////////////////////////////////
+
+        // replace each color channel value v with lut[v]
+        // alpha is not changed
+        void ApplyLUT(const uint8_t* const lut);
+
+        // as above with a table per channel, applied in a single pass
+        // 8 and 16 bit images use lut_g
+        void ApplyLUT(const uint8_t* const lut_r, const uint8_t* const lut_g, const uint8_t* const lut_b);
+
+        // v = 255 * (v / 255) ^ (1 / gamma)
+        void Gamma(const float gamma);
+
+        // map in_black..in_white to out_black..out_white with midtone gamma
+        void Levels(const uint8_t in_black, const uint8_t in_white, const float gamma, const uint8_t out_black, const uint8_t out_white);
+
+        // piecewise linear curve through control points (in, out)
+        void Curves(const std::vector<std::pair<uint8_t, uint8_t>>& points);
+
+        void Invert();
+
+        // v = (v >= threshold) ? 255 : 0
+        void Threshold(const uint8_t threshold);
+
+        // in place color space conversion of 24 and 32 bit images
+        // channels are stored in the b, g, r memory slots in the order
+        // (Y, Cb, Cr) and (H, S, V), hue is scaled to 0 - 255
+        // YCbCr is full range BT.601 (JPEG)
+        void ConvertToYCbCr();
+        void ConvertFromYCbCr();
+        void ConvertToHSV();
+        void ConvertFromHSV();
+
+        // luma of 24 or 32 bit image as an 8 bit image
+        BITMAP Grayscale() const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // channels
+        ////////////////////////////////////////////////////////////////////////
+
+        // split a 24 or 32 bit image into one 8 bit image per channel in a
+        // single pass, alpha is 0xFF for 24 bit images
+        void SplitChannels(BITMAP& r, BITMAP& g, BITMAP& b) const;
+        void SplitChannels(BITMAP& r, BITMAP& g, BITMAP& b, BITMAP& a) const;
+
+        // interleave 8 bit images of the same size into *this, which becomes
+        // 24 bit, or 32 bit when alpha is given, *this must not be an input
+        void MergeChannels(const BITMAP& r, const BITMAP& g, const BITMAP& b);
+        void MergeChannels(const BITMAP& r, const BITMAP& g, const BITMAP& b, const BITMAP& a);
+
+        // Translate each color channel by its own offset in one pass over
+        // *this, uncovered values are 0, alpha is not moved
+        void ShiftChannels(const int dx_r, const int dy_r, const int dx_g, const int dy_g, const int dx_b, const int dy_b);
+
+        ////////////////////////////////////////////////////////////////////////
+        // typed pixel access
+        ////////////////////////////////////////////////////////////////////////
+
+        // view of the pixels in format F (Gray8, Gray16, Bgr24 or Bgra32),
+        // F::bit_count must equal BitCount()
+        // the writable view marks the whole bitmap dirty, as the changes made
+        // through it are not seen, so read only access should go through a
+        // const reference
+        template<typename F>
+        BasicBitmap<F> View();
+        template<typename F>
+        BasicBitmap<F, const uint8_t> View() const;
+
+        // call fn once with the view matching the bit count, fn is usually a
+        // generic lambda so that its loops are compiled once per format
+        // 16 bit images are viewed as Gray16
+        // returns false if the bit count has no format
+        // as with View, the non-const overload marks the whole bitmap dirty
+        // and the const overload (eg, through a const reference) does not
+        template<typename FUNCTOR>
+        bool Dispatch(FUNCTOR&& fn);
+        template<typename FUNCTOR>
+        bool Dispatch(FUNCTOR&& fn) const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // RGBA export
+        ////////////////////////////////////////////////////////////////////////
+
+        // write the pixels as r, g, b, a rows ordered top down, the layout
+        // textures are uploaded in (4 * Width() * Height() bytes)
+        // alpha is 0xFF unless the image is 32 bit
+        void CopyToRGBA(uint8_t* const dst) const;
+
+        // as above, for the area rect (4 * rect.width * rect.height bytes)
+        // rect must lie inside the bitmap
+        void CopyToRGBA(uint8_t* const dst, const Rect& rect) const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // hashing
+        ////////////////////////////////////////////////////////////////////////
+
+        // 64 bit non-cryptographic hash of the pixels, width, height and bit
+        // count, padding bytes are ignored
+        // equal images always have equal hashes
+        uint64_t Hash() const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // comparison
+        ////////////////////////////////////////////////////////////////////////
+
+        // padding bytes are ignored
+        // images of different size or bit count are never equal, and the
+        // metrics below report an error for them
+
+        // true if all pixels are equal, stops at the first differing block
+        bool Equals(const BITMAP& bitmap) const;
+
+        // largest absolute difference of any channel of any pixel
+        uint8_t MaxAbsDiff(const BITMAP& bitmap) const;
+
+        // sum over all channels of all pixels of the squared difference
+        uint64_t SumSquaredDifference(const BITMAP& bitmap) const;
+
+        // mean squared error per channel value
+        double MSE(const BITMAP& bitmap) const;
+
+        // peak signal to noise ratio (dB), infinity if the images are equal
+        double PSNR(const BITMAP& bitmap) const;
+
+        // mean structural similarity of the luma of both images, over all
+        // window x window blocks
+        double SSIM(const BITMAP& bitmap, const int window = 8) const;
+
+        // smallest rectangle containing all differing pixels
+        // width and height are 0 if the images are equal
+        Rect DiffBoundingBox(const BITMAP& bitmap) const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // template matching
+        ////////////////////////////////////////////////////////////////////////
+
+        // best position of needle inside *this, which must have the same bit
+        // count, SAD matches must score at most threshold and NCC matches at
+        // least threshold
+        // coarse_to_fine scores every position at the smallest pyramid level
+        // at which needle is still 16 pixels wide and high, then refines the
+        // best few candidates at each finer level, otherwise every position
+        // of *this is scored
+        // SAD stops scoring a position once it is worse than the best so far
+        TemplateMatch FindTemplate(const BITMAP& needle, const MatchMetric metric, const double threshold, const bool coarse_to_fine = true) const;
+
+        ////////////////////////////////////////////////////////////////////////
+        // edge detection
+        ////////////////////////////////////////////////////////////////////////
+
+        // 8 bit gradient magnitude of the luma (as Grayscale) of an 8, 24 or
+        // 32 bit image, sqrt(gx^2 + gy^2) divided by the smoothing weight of
+        // op (4 or 16) so that a step of height h gives h, saturated to 255
+        // computed in one pass, each band of rows converts its rows and the
+        // row either side of it to luma into a rolling window of 3 rows
+        BITMAP EdgeDetect(const EdgeOperator op = EdgeOperator::SOBEL, const EdgeMode edge = EdgeMode::CLAMP) const;
+
+        // as above, and direction is set to an 8 bit image of the gradient
+        // direction in bitmap coordinates quantized to 0 (0 degrees), 1 (45),
+        // 2 (90) or 3 (135), opposite directions share a value
+        // direction must not be *this
+        BITMAP EdgeDetect(BITMAP& direction, const EdgeOperator op = EdgeOperator::SOBEL, const EdgeMode edge = EdgeMode::CLAMP) const;
+
         ////////////////////////////////////////////////////////////////////////
         // filters
         ////////////////////////////////////////////////////////////////////////
@@ -355,14 +1018,94 @@ namespace BMP
         void RGBFilterOR(const uint8_t r, const uint8_t g, const uint8_t b);
         void RGBFilterXOR(const uint8_t r, const uint8_t g, const uint8_t b);
 
+        // byte wise kernel with bitmap over the area common to both, alpha
+        // is not changed, bitmap must have the same bit count
         void Generic(const BITMAP& bitmap, FunctorKernel functorkernel);
         void AND(const BITMAP& bitmap);
         void OR(const BITMAP& bitmap);
         void XOR(const BITMAP& bitmap);
 
+        // *this = bitmaps[0] (mode) bitmaps[1] (mode) ... in a single pass,
+        // each input is read once and the output written once, over the
+        // intersection of the sizes of *this and all inputs
+        // *this may be one of the inputs
+        void Reduce(const KernelMode mode, const std::vector<const BITMAP*>& bitmaps);
+
+        // copy the pixels of bitmap where mask is set, over the area common
+        // to *this, bitmap and mask, bitmap must have the same bit count
+        void Select(const BITMAPMask& mask, const BITMAP& bitmap);
+
+        ////////////////////////////////////////////////////////////////////////
+        // compositing
+        ////////////////////////////////////////////////////////////////////////
+
+        // 32 bit images only
+
+        // apply a composite kernel to *this with src bitmap_r drawn onto backdrop bitmap_l
+        void OperatorCompositeBinary(const BITMAP& bitmap_l, const BITMAP& bitmap_r, FunctorComposite kernel);
+
+        // apply a composite kernel to *this with src bitmap drawn onto *this
+        void OperatorCompositeUnary(const BITMAP& bitmap, FunctorComposite kernel);
+
+        void Composite(const BITMAP& bitmap, const CompositeMode mode, const uint8_t opacity = 0xFF, const bool premultiplied = true);
+
+        // convert between straight and premultiplied alpha
+        void Premultiply();
+        void Unpremultiply();
+
     };
 
 
+    template<typename F>
+    BasicBitmap<F> BITMAP::view_unmarked()
+    {
+        return BasicBitmap<F>(m_data.data(), m_width, m_height, m_width_memory);
+    }
+
+
+    template<typename F>
+    BasicBitmap<F> BITMAP::View()
+    {
+        mark_dirty_all();
+        return view_unmarked<F>();
+    }
+
+
+    template<typename F>
+    BasicBitmap<F, const uint8_t> BITMAP::View() const
+    {
+        return BasicBitmap<F, const uint8_t>(m_data.data(), m_width, m_height, m_width_memory);
+    }
+
+
+    template<typename FUNCTOR>
+    bool BITMAP::Dispatch(FUNCTOR&& fn)
+    {
+        switch(m_bit_count)
+        {
+            case 8: fn(View<Gray8>()); break;
+            case 16: fn(View<Gray16>()); break;
+            case 24: fn(View<Bgr24>()); break;
+            case 32: fn(View<Bgra32>()); break;
+            default: return false;
+        }
+        return true;
+    }
+
+
+    template<typename FUNCTOR>
+    bool BITMAP::Dispatch(FUNCTOR&& fn) const
+    {
+        switch(m_bit_count)
+        {
+            case 8: fn(View<Gray8>()); break;
+            case 16: fn(View<Gray16>()); break;
+            case 24: fn(View<Bgr24>()); break;
+            case 32: fn(View<Bgra32>()); break;
+            default: return false;
+        }
+        return true;
+    }
 
 
 }
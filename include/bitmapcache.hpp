@@ -0,0 +1,140 @@
+#ifndef BITMAPCACHE_HPP
+#define BITMAPCACHE_HPP
+
+
+// Local headers
+#include "bitmap.hpp"
+
+// C++ headers
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+
+namespace BMP
+{
+
+
+    // chain of operations applied to a bitmap
+    // the key names every operation and its parameters, two chains with
+    // the same key produce the same result from the same input
+    class OperationChain
+    {
+
+        std::string m_key;
+        std::vector<std::function<void(BITMAP&)>> m_operations;
+
+        // size set by the last Resize, 0 if the chain keeps the input size
+        // m_opaque once a Custom operation may have changed size or depth
+        int m_width;
+        int m_height;
+        bool m_opaque;
+
+        void append(const std::string& key, const std::function<void(BITMAP&)>& operation);
+
+        // false if the size and bit count of the result of applying the
+        // chain to input can not be known without applying it
+        bool result_format(const BITMAP& input, LONG& width, LONG& height, WORD& bit_count) const;
+
+        friend class BITMAPCache;
+
+    public:
+
+        OperationChain();
+
+        OperationChain& Resize(const int width, const int height);
+        OperationChain& Translate(const int dx, const int dy);
+        OperationChain& BoxBlur(const int radius_x, const int radius_y, const EdgeMode edge = EdgeMode::CLAMP);
+        OperationChain& GaussianBlur(const float sigma, const EdgeMode edge = EdgeMode::CLAMP);
+        OperationChain& Sharpen(const float amount);
+        OperationChain& UnsharpMask(const float sigma, const float amount, const uint8_t threshold = 0);
+        OperationChain& Gamma(const float gamma);
+        OperationChain& Levels(const uint8_t in_black, const uint8_t in_white, const float gamma, const uint8_t out_black, const uint8_t out_white);
+        OperationChain& Invert();
+        OperationChain& Threshold(const uint8_t threshold);
+
+        // any other operation, key must identify the operation and all of
+        // its parameters
+        OperationChain& Custom(const std::string& key, const std::function<void(BITMAP&)>& operation);
+
+        const std::string& Key() const;
+
+        // apply all operations in order
+        void Apply(BITMAP& bitmap) const;
+
+    };
+
+
+    // cache of the results of operation chains
+    // results are keyed by the hash of the input pixels and the key of the
+    // chain, a repeated request costs one hash of the input and a lookup
+    // the least recently used results are evicted when the memory budget is
+    // exceeded, and if a directory is given results are also saved there as
+    // BMP files and loaded again after eviction
+    // files are written under a unique temporary name and renamed into
+    // place, and are only loaded if their headers are valid and match the
+    // size and bit count of the result, otherwise the result is recomputed
+    class BITMAPCache
+    {
+
+        struct Entry
+        {
+            std::string key;
+            std::shared_ptr<const BITMAP> bitmap;
+            size_t bytes;
+        };
+
+        // most recently used at the front
+        std::list<Entry> m_entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+
+        size_t m_memory_budget;
+        size_t m_memory_used;
+        std::string m_directory;
+
+        uint64_t m_hits;
+        uint64_t m_misses;
+
+        mutable std::mutex m_mutex;
+
+        std::string disk_filename(const std::string& key) const;
+
+        // load the result of chain applied to input from filename, nullptr
+        // if the file is missing or does not hold a valid result
+        static
+        std::shared_ptr<const BITMAP> load(const std::string& filename, const BITMAP& input, const OperationChain& chain);
+
+        // save bitmap to a temporary file and rename it to filename
+        static
+        void save(const std::string& filename, const BITMAP& bitmap);
+
+        // insert a result and evict until within budget, m_mutex must be held
+        void insert(const std::string& key, const std::shared_ptr<const BITMAP>& bitmap);
+
+    public:
+
+        // directory may be empty, in which case nothing is saved to disk
+        explicit
+        BITMAPCache(const size_t memory_budget, const std::string& directory = "");
+
+        // result of applying chain to input
+        // computed (or loaded from disk) on a miss
+        std::shared_ptr<const BITMAP> Apply(const BITMAP& input, const OperationChain& chain);
+
+        // remove all results held in memory, files on disk are kept
+        void Clear();
+
+        size_t MemoryUsed() const;
+        uint64_t Hits() const;
+        uint64_t Misses() const;
+
+    };
+
+
+}
+
+#endif // BITMAPCACHE_HPP
@@ -0,0 +1,68 @@
+#ifndef BITMAPCANVAS_HPP
+#define BITMAPCANVAS_HPP
+
+
+// Local headers
+#include "bitmap.hpp"
+#include "bitmapfont.hpp"
+
+// C++ headers
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+namespace BMP
+{
+
+
+    // bitmap canvas class
+    // a bitmap with a font which text can be drawn onto
+    class BITMAPCanvas : public BITMAP
+    {
+
+    protected:
+
+        // glyph spans of a whole string, positioned relative to the lower left
+        // corner of the first line, and merged where glyphs touch
+        struct TextLayout
+        {
+            std::vector<BITMAPFont::Span> spans;
+            int x_min;
+            int y_min;
+            int x_max;
+            int y_max;
+        };
+
+        const BITMAPFont* m_font;
+
+        // laid out strings, most text drawn is repeated (captions, labels)
+        // cleared when the font changes or it grows beyond the limit
+        std::unordered_map<std::string, TextLayout> m_layout_cache;
+        static const size_t m_layout_cache_limit{1024};
+
+        const TextLayout& layout(const std::string& text);
+
+
+    public:
+
+        explicit
+        BITMAPCanvas(const LONG width, const LONG height, const BITMAPFont* const font, const WORD bit_count = 24);
+
+        virtual
+        ~BITMAPCanvas();
+
+        void SetFont(const BITMAPFont* const font);
+
+        // draw text with color r, g, b
+        // (x, y) is the lower left corner of the first line of text,
+        // further lines (separated by '\n') are drawn below it
+        // text is clipped to the canvas
+        void DrawText(const int x, const int y, const std::string& text, const uint8_t r, const uint8_t g, const uint8_t b);
+
+    };
+
+
+}
+
+#endif // BITMAPCANVAS_HPP
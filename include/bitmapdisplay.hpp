@@ -0,0 +1,60 @@
+#ifndef BITMAPDISPLAY_HPP
+#define BITMAPDISPLAY_HPP
+
+
+// Local headers
+#include "bitmap.hpp"
+
+// SFML headers
+#include <SFML/Graphics.hpp>
+
+// C++ headers
+#include <vector>
+
+
+namespace BMP
+{
+
+
+    // shows a bitmap in an SFML window without going through a file
+    // the pixels are converted into a staging buffer and uploaded into a
+    // texture, both of which are kept between updates, the texture is only
+    // recreated when the size of the bitmap changes
+    class BITMAPDisplay
+    {
+
+        sf::Texture m_texture;
+        sf::Sprite m_sprite;
+
+        // top down r, g, b, a pixels
+        std::vector<uint8_t> m_staging;
+
+    public:
+
+        BITMAPDisplay();
+
+        // m_sprite points at m_texture, so a copy would draw the texture of
+        // the original
+        BITMAPDisplay(const BITMAPDisplay&) = delete;
+        BITMAPDisplay& operator=(const BITMAPDisplay&) = delete;
+
+        // upload all of bitmap, returns false if the texture could not be
+        // created
+        bool Update(const BITMAP& bitmap);
+
+        // upload only the dirty regions of bitmap, or all of it if it is not
+        // tracking changes or its size differs from the texture
+        // the dirty regions are not reset
+        bool UpdateDirty(const BITMAP& bitmap);
+
+        // width and height of the texture
+        sf::Vector2u Size() const;
+
+        void Draw(sf::RenderTarget& target) const;
+
+    };
+
+
+}
+
+#endif // BITMAPDISPLAY_HPP
@@ -0,0 +1,75 @@
+#ifndef BITMAPFONT_HPP
+#define BITMAPFONT_HPP
+
+
+// Local headers
+#include "bitmap.hpp"
+
+// C++ headers
+#include <string>
+#include <vector>
+
+
+namespace BMP
+{
+
+
+    // bitmap font class
+    // the font is loaded from a glyph sheet, which is a bitmap containing
+    // a grid of fixed size glyph cells, read left to right, top to bottom
+    // any non-black pixel of a cell is part of the glyph
+    // glyphs are packed into a list of horizontal spans so that drawing
+    // a glyph is one span fill per run of pixels rather than a per-pixel test
+    class BITMAPFont : public BITMAP
+    {
+
+    public:
+
+        // run of glyph pixels, relative to the lower left corner of the glyph
+        struct Span
+        {
+            int x;
+            int y;
+            int length;
+        };
+
+
+    protected:
+
+        int m_glyph_width; // width of glyph cell (pixels)
+        int m_glyph_height; // height of glyph cell (pixels)
+        int m_first_char; // character code of first glyph in sheet
+        int m_glyph_count;
+
+        std::vector<Span> m_spans; // spans of all glyphs, packed
+        std::vector<size_t> m_glyph_offset; // index of first span of each glyph, m_glyph_count + 1 entries
+
+        // build span atlas from the loaded glyph sheet
+        void pack();
+
+
+    public:
+
+        // load glyph sheet from file
+        BITMAPFont(const std::string& filename, const int glyph_width, const int glyph_height, const int first_char = 0);
+
+        virtual
+        ~BITMAPFont();
+
+        int GlyphWidth() const;
+        int GlyphHeight() const;
+
+        // true if the font contains a glyph for character c
+        bool HasGlyph(const unsigned char c) const;
+
+        // spans of glyph for character c
+        // returns pointer to first span and sets count
+        // returns nullptr if there is no glyph for c
+        const Span* GlyphSpans(const unsigned char c, size_t& count) const;
+
+    };
+
+
+}
+
+#endif // BITMAPFONT_HPP
@@ -0,0 +1,100 @@
+#ifndef BITMAPMASK_HPP
+#define BITMAPMASK_HPP
+
+
+// Local headers
+#include "bitmap.hpp"
+
+// C++ headers
+#include <string>
+#include <vector>
+
+
+namespace BMP
+{
+
+
+    // 1 bit per pixel mask
+    // rows are stored bottom up as in BITMAP, each row is a whole number of
+    // 64 bit words, pixel x of a row is bit x % 64 of word x / 64
+    // bits beyond the width are always 0, so logical operations and counts
+    // work on whole words
+    class BITMAPMask
+    {
+
+        LONG m_width;
+        LONG m_height;
+        LONG m_words; // words per row
+        uint64_t m_tail; // valid bits of the last word of each row
+        std::vector<uint64_t> m_data;
+
+        // apply op to each word of *this and mask over the area common to
+        // both, bits of *this outside that area are not changed
+        template<typename OP>
+        void combine(const BITMAPMask& mask, OP op);
+
+        // Erode or Dilate
+        void morphology(const bool dilate, const int radius_x, const int radius_y);
+
+    public:
+
+        BITMAPMask();
+
+        // all pixels clear
+        BITMAPMask(const LONG width, const LONG height);
+
+        BITMAPMask(const std::string& filename);
+
+        LONG Width() const;
+        LONG Height() const;
+
+        // words of row y, Words() long
+        LONG Words() const;
+        const uint64_t* Row(const LONG y) const;
+
+        bool Get(const LONG x, const LONG y) const;
+        void Set(const LONG x, const LONG y, const bool value = true);
+
+        void Fill(const bool value);
+
+        // 1 bit BMP files, a set pixel is the brighter palette entry
+        void Load(const std::string& filename);
+        void SaveAs(const std::string& filename) const;
+
+        // logical operations with another mask, 128 pixels per SSE2 operation
+        void AND(const BITMAPMask& mask);
+        void OR(const BITMAPMask& mask);
+        void XOR(const BITMAPMask& mask);
+        void NOT();
+
+        // AND (Erode) or OR (Dilate) over a (2 * radius_x + 1) x
+        // (2 * radius_y + 1) rectangle, pixels outside the mask are ignored
+        // rows are combined with word shifts, log(radius_x) steps, and
+        // columns with van Herk / Gil-Werman
+        void Erode(const int radius_x, const int radius_y);
+        void Dilate(const int radius_x, const int radius_y);
+        void Open(const int radius_x, const int radius_y);
+        void Close(const int radius_x, const int radius_y);
+
+        // number of set pixels
+        uint64_t Count() const;
+
+        // set where the pixel of an 8 bit image, or the luma of a 24 or 32
+        // bit image, is at least threshold
+        static BITMAPMask Threshold(const BITMAP& bitmap, const uint8_t threshold);
+
+        // set where the value, as for Threshold, is at least the local
+        // mean + k * standard deviation over the (2 * radius + 1)^2 window
+        // clipped to the image, from an IntegralImage so constant time per
+        // pixel for any radius
+        static BITMAPMask AdaptiveThreshold(const BITMAP& bitmap, const int radius, const double k = 0.0);
+
+        // 8 bit image, 0xFF where set and 0 elsewhere
+        BITMAP ToBITMAP() const;
+
+    };
+
+
+}
+
+#endif // BITMAPMASK_HPP
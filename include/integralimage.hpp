@@ -0,0 +1,89 @@
+#ifndef INTEGRALIMAGE_HPP
+#define INTEGRALIMAGE_HPP
+
+
+// Local headers
+#include "bitmap.hpp"
+
+// C++ headers
+#include <cstdint>
+#include <vector>
+
+
+namespace BMP
+{
+
+
+    // summed-area tables of the values of one channel of a bitmap and of
+    // their squares, so that the sum over any rectangle is 4 lookups
+    // entry x, y holds the sum over all pixels below and left of x, y, the
+    // tables have a zero first row and column
+    // entries are 32 bit when the sum over the whole image fits, 64 bit
+    // otherwise, chosen separately for the values and the squares
+    class IntegralImage
+    {
+
+        LONG m_width;
+        LONG m_height;
+        LONG m_stride; // m_width + 1
+
+        bool m_wide_sum;
+        bool m_wide_sum_sq;
+        std::vector<uint32_t> m_sum_32;
+        std::vector<uint64_t> m_sum_64;
+        std::vector<uint32_t> m_sum_sq_32;
+        std::vector<uint64_t> m_sum_sq_64;
+
+    public:
+
+        IntegralImage();
+
+        // channel in memory order (0 = blue, 1 = green, 2 = red, 3 = alpha),
+        // or -1 for the luma of 24 and 32 bit images as Grayscale
+        // the channel of 8 bit images is always their value
+        IntegralImage(const BITMAP& bitmap, const int channel = -1);
+
+        // tables of rows y_begin to y_end of bitmap only, to bound memory
+        // when the image is processed in blocks of rows, Height() is
+        // y_end - y_begin and rect.y is relative to y_begin
+        IntegralImage(const BITMAP& bitmap, const int channel, const LONG y_begin, const LONG y_end);
+
+        LONG Width() const;
+        LONG Height() const;
+
+        // sum of the values, and of their squares, over rect, which must lie
+        // inside the image
+        inline
+        uint64_t Sum(const Rect& rect) const
+        {
+            const LONG a{(LONG)rect.y * m_stride + rect.x};
+            const LONG b{a + rect.width};
+            const LONG c{a + rect.height * m_stride};
+            const LONG d{c + rect.width};
+            if(m_wide_sum)
+            {
+                return m_sum_64[d] - m_sum_64[b] - m_sum_64[c] + m_sum_64[a];
+            }
+            return (uint32_t)(m_sum_32[d] - m_sum_32[b] - m_sum_32[c] + m_sum_32[a]);
+        }
+
+        inline
+        uint64_t SumSq(const Rect& rect) const
+        {
+            const LONG a{(LONG)rect.y * m_stride + rect.x};
+            const LONG b{a + rect.width};
+            const LONG c{a + rect.height * m_stride};
+            const LONG d{c + rect.width};
+            if(m_wide_sum_sq)
+            {
+                return m_sum_sq_64[d] - m_sum_sq_64[b] - m_sum_sq_64[c] + m_sum_sq_64[a];
+            }
+            return (uint32_t)(m_sum_sq_32[d] - m_sum_sq_32[b] - m_sum_sq_32[c] + m_sum_sq_32[a]);
+        }
+
+    };
+
+
+}
+
+#endif // INTEGRALIMAGE_HPP
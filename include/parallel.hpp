@@ -0,0 +1,50 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+
+// C++ headers
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+
+namespace BMP
+{
+
+
+    // split the range [0, count) into contiguous bands, one per hardware
+    // thread, and call body(begin, end) for each band
+    // bands are at least min_band long, so small images are processed on
+    // the calling thread without starting any threads
+    template<typename F>
+    void ParallelBands(const uint64_t count, const uint64_t min_band, F&& body)
+    {
+        uint64_t threads{std::thread::hardware_concurrency()};
+        if(threads == 0) threads = 1;
+        if(min_band > 0 && count / min_band < threads) threads = count / min_band;
+        if(threads <= 1)
+        {
+            if(count > 0) body((uint64_t)0, count);
+            return;
+        }
+
+        std::vector<std::thread> pool;
+        pool.reserve(threads - 1);
+        for(uint64_t t{1}; t < threads; ++ t)
+        {
+            const uint64_t begin{count * t / threads};
+            const uint64_t end{count * (t + 1) / threads};
+            pool.emplace_back([&body, begin, end]() { body(begin, end); });
+        }
+        // first band on the calling thread
+        body((uint64_t)0, count / threads);
+        for(std::thread& thread : pool)
+        {
+            thread.join();
+        }
+    }
+
+
+}
+
+#endif // PARALLEL_HPP
@@ -10,40 +10,14 @@ namespace BMP
 {
 
 
-    //union PixelRGB
-    class PixelRGB
+    // one 24 bit pixel as stored in memory, so that a pointer to pixel data
+    // can be used as a PixelRGB
+    struct PixelRGB
     {
 
-    public:
-
-        uint8_t array[3];
-        /*
-        struct
-        {
-            uint8_t b;
-            uint8_t g;
-            uint8_t r;
-        };
-        */
-        uint8_t &r;
-        uint8_t &g;
-        uint8_t &b;
-
-
-    public:
-
-        PixelRGB()
-            : r{array[2]}
-            , g{array[1]}
-            , b{array[0]}
-        {
-        }
-
-        PixelRGB& operator=(const PixelRGB& pixel)
-        {
-            for(int c{0}; c < 3; ++ c) array[c] = pixel.array[c];
-            return *this;
-        }
+        uint8_t b;
+        uint8_t g;
+        uint8_t r;
 
 
         PixelRGB& operator&=(const PixelRGB& pixel)
@@ -70,6 +44,8 @@ namespace BMP
 
     };
 
+    static_assert(sizeof(PixelRGB) == 3, "PixelRGB must have the size of a 24 bit pixel");
+
     PixelRGB operator&(const PixelRGB&, const PixelRGB&);
     PixelRGB operator|(const PixelRGB&, const PixelRGB&);
     PixelRGB operator^(const PixelRGB&, const PixelRGB&);
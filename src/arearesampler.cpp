@@ -0,0 +1,113 @@
+#include "arearesampler.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+
+// all positions are scaled so that both source and destination pixels
+// have integer bounds: source pixel i covers [i * dst, (i + 1) * dst) and
+// destination pixel x covers [x * src, (x + 1) * src), the weight of a
+// source pixel is the length of its overlap with the destination pixel
+// the weights of each destination pixel sum to src in each direction
+
+BMP::AreaResampler::AreaResampler(const uint64_t src_width, const uint64_t src_height, const uint64_t dst_width, const uint64_t dst_height, const uint64_t channels)
+    : m_src_width{src_width}
+    , m_src_height{src_height}
+    , m_dst_width{std::min(dst_width, src_width)}
+    , m_dst_height{std::min(dst_height, src_height)}
+    , m_channels{channels}
+    , m_tap_begin(m_dst_width + 1, 0)
+    , m_row(m_dst_width * channels, 0)
+    , m_accumulator(m_dst_width * channels, 0)
+    , m_output(m_dst_width * channels, 0)
+    , m_src_row{0}
+    , m_dst_row{0}
+{
+    for(uint64_t x{0}; x < m_dst_width; ++ x)
+    {
+        m_tap_begin[x] = m_tap_source.size();
+        const uint64_t begin{x * m_src_width};
+        const uint64_t end{(x + 1) * m_src_width};
+        for(uint64_t i{begin / m_dst_width}; i * m_dst_width < end; ++ i)
+        {
+            const uint64_t weight{std::min((i + 1) * m_dst_width, end) - std::max(i * m_dst_width, begin)};
+            m_tap_source.push_back(i * m_channels);
+            m_tap_weight.push_back((uint32_t)weight);
+        }
+    }
+    m_tap_begin[m_dst_width] = m_tap_source.size();
+}
+
+
+void BMP::AreaResampler::finish_row()
+{
+    const uint64_t norm{m_src_width * m_src_height};
+    for(uint64_t i{0}; i < m_accumulator.size(); ++ i)
+    {
+        m_output[i] = (uint8_t)((m_accumulator[i] + norm / 2) / norm);
+    }
+}
+
+
+const uint8_t* BMP::AreaResampler::PushRow(const uint8_t * const row)
+{
+    if(m_dst_row >= m_dst_height)
+    {
+        return nullptr;
+    }
+
+    // horizontal
+    for(uint64_t x{0}; x < m_dst_width; ++ x)
+    {
+        uint32_t * const out{&m_row[x * m_channels]};
+        for(uint64_t c{0}; c < m_channels; ++ c)
+        {
+            out[c] = 0;
+        }
+        for(uint64_t t{m_tap_begin[x]}; t < m_tap_begin[x + 1]; ++ t)
+        {
+            const uint8_t * const p{row + m_tap_source[t]};
+            const uint32_t weight{m_tap_weight[t]};
+            for(uint64_t c{0}; c < m_channels; ++ c)
+            {
+                out[c] += weight * p[c];
+            }
+        }
+    }
+
+    // vertical, the destination is not taller than the source so a source
+    // row overlaps at most two destination rows
+    const uint64_t begin{m_src_row * m_dst_height};
+    const uint64_t end{begin + m_dst_height};
+    const uint64_t boundary{(m_dst_row + 1) * m_src_height};
+    ++ m_src_row;
+
+    if(end < boundary)
+    {
+        for(uint64_t i{0}; i < m_accumulator.size(); ++ i)
+        {
+            m_accumulator[i] += (uint64_t)m_dst_height * m_row[i];
+        }
+        return nullptr;
+    }
+
+    const uint64_t weight{boundary - begin};
+    for(uint64_t i{0}; i < m_accumulator.size(); ++ i)
+    {
+        m_accumulator[i] += weight * m_row[i];
+    }
+    finish_row();
+    for(uint64_t i{0}; i < m_accumulator.size(); ++ i)
+    {
+        m_accumulator[i] = (m_dst_height - weight) * m_row[i];
+    }
+    ++ m_dst_row;
+    return m_output.data();
+}
+
+
+uint64_t BMP::AreaResampler::DstRow() const
+{
+    return m_dst_row;
+}
@@ -1,17 +1,15 @@
 #include "bitmap.hpp"
+#include "arearesampler.hpp"
 
 
+// C++ headers
+#include <algorithm>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-inline
-uint64_t BMP::BITMAP::index(const LONG x, const LONG y) const
-{
-    // note m_width_memory has unit of BYTE
-    // x has units of (index)
-    // y has units of (index)
-    // m_bit_count has units of BYTE
-    uint64_t index = ((m_bit_count / 8) * x + y * m_width_memory);
-    return index;
-}
 
 
 uint16_t BMP::BITMAP::ushort_rev(const uint16_t data) const
@@ -109,6 +107,7 @@ void BMP::BITMAP::reinitialize(const LONG width, const LONG height, const WORD b
     m_width_pad = (4 - ((LONG)(bit_count / 8) * width) % 4) % 4; // BYTES!
     m_width_memory = (LONG)(bit_count / 8) * width + m_width_pad; // BYTES!
     m_data.resize(m_width_memory * m_height);
+    mark_dirty_all();
     //std::cout << "BITMAPBase: width=" << m_width << " height=" << m_height << " pad=" << m_width_pad << " width_mem=" << m_width_memory << std::endl;
 }
 
@@ -120,6 +119,7 @@ BMP::BITMAP::BITMAP()
     , m_width_pad{0}
     , m_width_memory{0}
     , m_data(0)
+    , m_dirty_tracking{false}
 {
 }
 
@@ -131,6 +131,7 @@ BMP::BITMAP::BITMAP(const LONG width, const LONG height, const WORD bit_count)
     , m_width_pad{(4 - ((LONG)(bit_count / 8) * width) % 4) % 4}
     , m_width_memory{(bit_count / 8) * width + m_width_pad}
     , m_data(m_width_memory * m_height)
+    , m_dirty_tracking{false}
     //: BITMAP(0, 0, 0) // this is to save duplicate code
 {
     //reinitialize(width, height, bit_count); // this is to save duplicate code
@@ -160,6 +161,7 @@ BMP::BITMAP::BITMAP(const BITMAP& bmpsurface)
     , m_width_pad{bmpsurface.m_width_pad}
     , m_width_memory{bmpsurface.m_width_memory}
     , m_data{bmpsurface.m_data}
+    , m_dirty_tracking{false}
 {
 }
 
@@ -174,6 +176,7 @@ BMP::BITMAP::BITMAP(BITMAP&& bmpsurface)
 BMP::BITMAP& BMP::BITMAP::operator=(BITMAP bmpsurface)
 {
     swap(*this, bmpsurface);
+    mark_dirty_all();
 
     return *this;
 }
@@ -221,6 +224,25 @@ void BMP::BITMAP::SaveAs(const std::string& filename) const
 }
 
 
+std::vector<uint8_t> BMP::BITMAP::palette() const
+{
+    // 8 bit images are saved with a grayscale color palette
+    std::vector<uint8_t> color_palette;
+    if(m_bit_count == 8)
+    {
+        color_palette.resize(4 * 256);
+        for(int i{0}; i < 256; ++ i)
+        {
+            color_palette[4 * i + 0] = i;
+            color_palette[4 * i + 1] = i;
+            color_palette[4 * i + 2] = i;
+            color_palette[4 * i + 3] = 0;
+        }
+    }
+    return color_palette;
+}
+
+
 #include <cstring>
 std::vector<unsigned char> BMP::BITMAP::SaveMem() const
 {
@@ -229,12 +251,14 @@ std::vector<unsigned char> BMP::BITMAP::SaveMem() const
     std::vector<unsigned char> memory;
 
 
+    const std::vector<uint8_t> color_palette{palette()};
+
     BITMAPFILEHEADER f_head;
     f_head.bfType = ushort_rev(((WORD)'B' << 0x08) | ((WORD)'M' << 0x00));
-    f_head.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + m_width_memory * m_height; //m_bit_count *
+    f_head.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + color_palette.size() + m_width_memory * m_height; //m_bit_count *
     f_head.bfReserved1 = 0;
     f_head.bfReserved2 = 0;
-    f_head.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+    f_head.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + color_palette.size();
 
 
     // build standard bitmap file header
@@ -248,7 +272,7 @@ std::vector<unsigned char> BMP::BITMAP::SaveMem() const
     i_head.biSizeImage = m_width_memory * m_height;
     i_head.biXPelsPerMeter = 0;
     i_head.biYPelsPerMeter = 0;
-    i_head.biClrUsed = 0;
+    i_head.biClrUsed = color_palette.size() / 4;
     i_head.biClrImportant = 0;
 
 
@@ -259,6 +283,10 @@ std::vector<unsigned char> BMP::BITMAP::SaveMem() const
     //std::copy(&i_head, &i_head + sizeof(i_head), memory.at(0) + sizeof(f_head));
     memcpy(memory.data() + 0, &f_head, sizeof(f_head));
     memcpy(memory.data() + sizeof(f_head), &i_head, sizeof(i_head));
+    if(!color_palette.empty())
+    {
+        memcpy(memory.data() + sizeof(f_head) + sizeof(i_head), color_palette.data(), color_palette.size());
+    }
 
 
     // write data
@@ -267,7 +295,7 @@ std::vector<unsigned char> BMP::BITMAP::SaveMem() const
         //outputfile.write((char*)(m_data + y * (3 * m_size_x)), 3 * m_size_x);
         //outputfile.write((char*)(&m_data[y * m_width_memory]), m_width_memory);
         //std::copy(&m_data[y * m_width_memory], m_data[y * m_width_memory + m_width_memory], memory.at(0) + sizeof(f_head) + sizeof(i_head));
-        memcpy(memory.data() + sizeof(f_head) + sizeof(i_head) + y * m_width_memory, m_data.data() + y * m_width_memory, m_width_memory);
+        memcpy(memory.data() + f_head.bfOffBits + y * m_width_memory, m_data.data() + y * m_width_memory, m_width_memory);
 
         // TODO: need to add a m_size_x_pad variable and m_x_pad variable, and include the padding in memory
         // don't bother putting zeros for padding, just write whatever is in the memory array
@@ -280,187 +308,206 @@ std::vector<unsigned char> BMP::BITMAP::SaveMem() const
 
 
 
+bool BMP::BITMAP::read_header(std::ifstream& inputfile, BITMAPFILEHEADER& f_head, BITMAPINFOHEADER& i_head)
+{
+    inputfile.read((char*)&f_head, sizeof(BITMAPFILEHEADER));
+    inputfile.read((char*)&i_head, sizeof(BITMAPINFOHEADER));
+
+    //std::cout << "BITMAPFILEHEADER: " << sizeof(BITMAPFILEHEADER) << std::endl;
+    //std::cout << "BITMAPINFOHEADER: " << sizeof(BITMAPINFOHEADER) << std::endl;
+
+    if(!inputfile)
+    {
+        std::cerr << ProbeStatusMessage(ProbeStatus::TRUNCATED) << std::endl;
+        return false;
+    }
+
+    std::streampos /*size_t*/ index_temp{inputfile.tellg()};
+    inputfile.seekg(0, std::ios::end);
+    /*size_t*/ std::streampos file_size{inputfile.tellg()};
+    inputfile.seekg(index_temp, std::ios::beg);
+
+    const ProbeStatus status{validate_header(f_head, i_head, (uint64_t)file_size)};
+    if(status != ProbeStatus::OK)
+    {
+        std::cerr << ProbeStatusMessage(status) << std::endl;
+        if(status == ProbeStatus::BAD_INFO_HEADER_SIZE)
+        {
+            std::cerr << sizeof(BITMAPINFOHEADER) << std::endl;
+            std::cerr << i_head.biSize << std::endl;
+        }
+        return false;
+    }
+
+    if(f_head.bfReserved1 != 0)
+    {
+        std::cerr << "Warning: bfReserved1 non-zero, ignore" << std::endl;
+    }
+    // don't care about this result
+
+    if(f_head.bfReserved2 != 0)
+    {
+        std::cerr << "Warning: bfReserved2 non-zero, ignore" << std::endl;
+    }
+    // don't care about this result
+
+    if(i_head.biXPelsPerMeter)
+    {
+        #ifdef WARNINGS_ON
+        std::cerr << "Warning: Ignoring non-zero value for biXPelsPerMeter" << std::endl;
+        #endif
+    }
+
+    if(i_head.biYPelsPerMeter)
+    {
+        #ifdef WARNINGS_ON
+        std::cerr << "Warning: Ignoring non-zero value for biYPelsPerMeter" << std::endl;
+        #endif
+    }
+
+    if(i_head.biClrUsed && i_head.biBitCount != 8)
+    {
+        std::cerr << "Warning: Ignoring non-zero value for color pallet, used" << std::endl;
+    }
+
+    if(i_head.biClrImportant)
+    {
+        std::cerr << "Warning: Ignoring non-zero value for color pallet, important" << std::endl;
+    }
+
+    return true;
+}
+
+
 void BMP::BITMAP::LoadBITMAP(const std::string& filename)
 {
     std::ifstream inputfile(filename.c_str(), std::ios::binary);
     if(!inputfile.is_open())
     {
         std::cerr << "Unable to open input file " << filename << std::endl;
+        return;
     }
-    else
+
+    BITMAPFILEHEADER f_head;
+    BITMAPINFOHEADER i_head;
+    if(!read_header(inputfile, f_head, i_head))
     {
-        BITMAPFILEHEADER f_head;
-        //f_head.bfType = ((WORD)'B' << 0x08) | ((WORD)'M' << 0x00);
-        //f_head.bfSize = uint_rev(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + m_bit_count * m_width_memory * m_height);
-        //f_head.bfReserved1 = 0;
-        //f_head.bfReserved2 = 0;
-        //f_head.bfOffBits = uint_rev(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER));
+        return;
+    }
 
+    // init memory
+    reinitialize(i_head.biWidth, i_head.biHeight, i_head.biBitCount);
 
-        // build standard bitmap file header
-        BITMAPINFOHEADER i_head;
-        //i_head.biSize = uint_rev(sizeof(BITMAPINFOHEADER));
-        //i_head.biWidth = ulong_rev(m_width);
-        //i_head.biHeight = ulong_rev(m_height);
-        //i_head.biPlanes = ushort_rev(1);
-        //i_head.biBitCount = ushort_rev(m_bit_count);
-        //i_head.biCompression = 0;
-        //i_head.biSizeImage = uint_rev(m_bit_count * m_width_memory * m_height);
-        //i_head.biXPelsPerMeter = 0;
-        //i_head.biYPelsPerMeter = 0;
-        //i_head.biClrUsed = 0;
-        //i_head.biClrImportant = 0;
-
-        inputfile.read((char*)&f_head, sizeof(BITMAPFILEHEADER));
-        inputfile.read((char*)&i_head, sizeof(BITMAPINFOHEADER));
-
-        //std::cout << "BITMAPFILEHEADER: " << sizeof(BITMAPFILEHEADER) << std::endl;
-        //std::cout << "BITMAPINFOHEADER: " << sizeof(BITMAPINFOHEADER) << std::endl;
-
-        if(f_head.bfType == ushort_rev(((WORD)'B' << 0x08) | ((WORD)'M' << 0x00)))
-        {
-            std::streampos /*size_t*/ index_temp{inputfile.tellg()};
-            inputfile.seekg(0, std::ios::end);
-            /*size_t*/ std::streampos file_size{inputfile.tellg()};
-            if(f_head.bfSize != file_size)
-            {
-                std::cerr << "File head error: Head file size label does not match file size." << std::endl;
-                    //std::cerr << "f_head.bfSize=" << f_head.bfSize << std::endl;
-                    //std::cerr << file_size << std::endl;
-                    //std::cerr << file_size << std::endl;
-                    //std::cout << ((f_head.bfSize & 0xff000000) >> 24) << std::endl;
-                    //std::cout << ((f_head.bfSize & 0x00ff0000) >> 16) << std::endl;
-                    //std::cout << ((f_head.bfSize & 0x0000ff00) >>  8) << std::endl;
-                    //std::cout << ((f_head.bfSize & 0x000000ff) >>  0) << std::endl;
-            }
-            else
-            {
-                inputfile.seekg(index_temp, std::ios::beg);
-                if(f_head.bfReserved1 != 0)
-                {
-                    std::cerr << "Warning: bfReserved1 non-zero, ignore" << std::endl;
-                }
-                // don't care about this result
+    // load memory
+    inputfile.seekg(f_head.bfOffBits);
 
-                if(f_head.bfReserved2 != 0)
-                {
-                    std::cerr << "Warning: bfReserved2 non-zero, ignore" << std::endl;
-                }
-                // don't care about this result
+    // read data, rows in the file have the same padding as m_data
+    inputfile.read((char*)m_data.data(), m_data.size());
 
-                // get offset
-                //size_t bitmap_data_offset{uint_rev(f_head.bfOffBits)};
+    inputfile.close();
+}
 
-                if(i_head.biSize != sizeof(BITMAPINFOHEADER))
-                {
-                    std::cerr << "File info head error: Unexpected info head size value" << std::endl;
-                        std::cerr << sizeof(BITMAPINFOHEADER) << std::endl;
-                        std::cerr << i_head.biSize << std::endl;
-                }
-                else
-                {
-                    if(i_head.biPlanes != 1)
-                    {
-                        std::cerr << "File info head error: Unexpected info head planes value" << std::endl;
-                    }
-                    else
-                    {
-                        if(i_head.biBitCount != 24)
-                        {
-                            std::cerr << "File info head error: Unexpected info head bit count value" << std::endl;
-                        }
-                        else
-                        {
-                            size_t expected_pad{(4 - ((LONG)(i_head.biBitCount / 8) * i_head.biWidth) % 4) % 4};
-                            size_t expected_width_memory{((i_head.biBitCount / 8) * i_head.biWidth) + expected_pad};
-                            size_t expected_size{expected_width_memory * i_head.biHeight};
-                            if(file_size != expected_size + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
-                            {
-                                std::cerr << "File info head error: Calculated file size does not match value calculated from header size, info header size, image width, height, depth." << std::endl;
-                                //std::cerr << file_size << std::endl;
-                                //std::cerr << expected_size + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) << std::endl;
-                                //std::cerr << i_head.biWidth << ", " << i_head.biHeight << ", " << expected_pad << std::endl;
-                                // TODO: leave these debug statements in
-                            }
-                            else
-                            {
-                                if(i_head.biCompression != 0)
-                                {
-                                    std::cerr << "Image is compressed, load abort" << std::endl;
-                                }
-                                else
-                                {
-                                    if(i_head.biSizeImage != expected_size)
-                                    {
-                                        std::cerr << "File info head error: Calculated file size does not match value calculated from image width, height, depth." << std::endl;
-                                    }
-                                    else
-                                    {
-                                        if(i_head.biXPelsPerMeter)
-                                        {
-                                            #ifdef WARNINGS_ON
-                                            std::cerr << "Warning: Ignoring non-zero value for biXPelsPerMeter" << std::endl;
-                                            #endif
-                                        }
-
-                                        if(i_head.biYPelsPerMeter)
-                                        {
-                                            #ifdef WARNINGS_ON
-                                            std::cerr << "Warning: Ignoring non-zero value for biYPelsPerMeter" << std::endl;
-                                            #endif
-                                        }
-
-                                        if(i_head.biClrUsed)
-                                        {
-                                            std::cerr << "Warning: Ignoring non-zero value for color pallet, used" << std::endl;
-                                        }
-
-                                        if(i_head.biClrImportant)
-                                        {
-                                            std::cerr << "Warning: Ignoring non-zero value for color pallet, important" << std::endl;
-                                        }
-
-                                        // init memory
-                                        reinitialize(i_head.biWidth, i_head.biHeight, i_head.biBitCount);
-
-                                        // load memory
-                                        inputfile.seekg(f_head.bfOffBits);
-                                        //std::cout << "SEEK: " << f_head.bfOffBits << std::endl;
-
-                                        // read data
-                                        for(unsigned int y = 0; y < m_height; ++ y)
-                                        {
-                                            inputfile.read((char*)(&m_data[y * m_width_memory]), m_width_memory);
-
-                                            // TODO: need to add a m_size_x_pad variable and m_x_pad variable, and include the padding in memory
-                                            // don't bother putting zeros for padding, just write whatever is in the memory array
-                                            //for(unsigned int p = 0; p < x_pad; ++ p)
-                                            //	outputfile.put(0); // put as many zeros required for padding
-                                        }
-
-                                        //outputfile.flush();
-                                        inputfile.close();
-
-                                        //std::clog << "Canvas read from input file " << filename << std::endl;
-
-
-                                    } // biSizeImage
-                                } // biCompression
-
-                            } // file_size
-
-
-                        } // biBitCount
-                    } // biPlanes
-                } // biSize
-
-            } // f_head.bfSize
-        } // f_head.bfType
-        else
+
+void BMP::BITMAP::LoadBITMAPShrink(const std::string& filename, const int width, const int height, const ShrinkMode mode)
+{
+    load_bitmap_shrink(filename, width, height, 0, mode);
+}
+
+
+void BMP::BITMAP::LoadBITMAPShrink(const std::string& filename, const int factor, const ShrinkMode mode)
+{
+    if(factor <= 0)
+    {
+        std::cerr << "Load error: invalid shrink factor " << factor << std::endl;
+        return;
+    }
+    load_bitmap_shrink(filename, 0, 0, factor, mode);
+}
+
+
+void BMP::BITMAP::load_bitmap_shrink(const std::string& filename, int width, int height, const int factor, const ShrinkMode mode)
+{
+    std::ifstream inputfile(filename.c_str(), std::ios::binary);
+    if(!inputfile.is_open())
+    {
+        std::cerr << "Unable to open input file " << filename << std::endl;
+        return;
+    }
+
+    BITMAPFILEHEADER f_head;
+    BITMAPINFOHEADER i_head;
+    if(!read_header(inputfile, f_head, i_head))
+    {
+        return;
+    }
+
+    const LONG src_width{i_head.biWidth};
+    const LONG src_height{i_head.biHeight};
+    const LONG bytes_per_pixel{(LONG)(i_head.biBitCount / 8)};
+    const LONG src_width_memory{bytes_per_pixel * src_width + (4 - (bytes_per_pixel * src_width) % 4) % 4};
+
+    if(factor > 0)
+    {
+        width = (int)std::max((LONG)1, src_width / factor);
+        height = (int)std::max((LONG)1, src_height / factor);
+    }
+    if(width <= 0 || height <= 0)
+    {
+        std::cerr << "Load error: invalid size " << width << "x" << height << std::endl;
+        return;
+    }
+    // never enlarge
+    const LONG dst_width{std::min((LONG)width, src_width)};
+    const LONG dst_height{std::min((LONG)height, src_height)};
+
+    reinitialize(dst_width, dst_height, i_head.biBitCount);
+    std::fill(m_data.begin(), m_data.end(), 0);
+    const LONG row_bytes{dst_width * bytes_per_pixel};
+
+    // one source row is held at a time, the full size image never exists
+    std::vector<uint8_t> row(src_width_memory);
+    if(mode == ShrinkMode::AREA)
+    {
+        inputfile.seekg(f_head.bfOffBits);
+        AreaResampler resampler(src_width, src_height, dst_width, dst_height, bytes_per_pixel);
+        for(LONG y{0}; y < src_height; ++ y)
+        {
+            inputfile.read((char*)row.data(), src_width_memory);
+            const LONG dst_y{resampler.DstRow()};
+            const uint8_t * const output{resampler.PushRow(row.data())};
+            if(output != nullptr)
+            {
+                memcpy(&m_data[index(0, dst_y)], output, row_bytes);
+            }
+        }
+    }
+    else
+    {
+        // nearest pixel to the center of each destination pixel, rows which
+        // are not needed are skipped without being read
+        std::vector<LONG> columns(dst_width);
+        for(LONG x{0}; x < dst_width; ++ x)
+        {
+            columns[x] = ((2 * x + 1) * src_width / (2 * dst_width)) * bytes_per_pixel;
+        }
+        for(LONG y{0}; y < dst_height; ++ y)
         {
-            std::cerr << "File format error: Missing 'B'|'M' from head." << std::endl;
+            const LONG src_y{(2 * y + 1) * src_height / (2 * dst_height)};
+            inputfile.seekg(f_head.bfOffBits + src_y * src_width_memory);
+            inputfile.read((char*)row.data(), src_width_memory);
+            uint8_t * const dst{&m_data[index(0, y)]};
+            for(LONG x{0}; x < dst_width; ++ x)
+            {
+                memcpy(dst + x * bytes_per_pixel, &row[columns[x]], bytes_per_pixel);
+            }
         }
     }
+
+    if(!inputfile)
+    {
+        std::cerr << "Load error: unexpected end of file " << filename << std::endl;
+    }
+    inputfile.close();
 }
 
 
@@ -497,12 +544,14 @@ void BMP::BITMAP::SaveAsBitmap(const std::string& filename) const
         //	x_pad = 4 - (3 * m_size_x) % 4;
         //}
 
+        const std::vector<uint8_t> color_palette{palette()};
+
         BITMAPFILEHEADER f_head;
         f_head.bfType = ushort_rev(((WORD)'B' << 0x08) | ((WORD)'M' << 0x00));
-        f_head.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + m_width_memory * m_height; //m_bit_count *
+        f_head.bfSize = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + color_palette.size() + m_width_memory * m_height; //m_bit_count *
         f_head.bfReserved1 = 0;
         f_head.bfReserved2 = 0;
-        f_head.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+        f_head.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + color_palette.size();
 
 
         // build standard bitmap file header
@@ -516,11 +565,12 @@ void BMP::BITMAP::SaveAsBitmap(const std::string& filename) const
         i_head.biSizeImage = m_width_memory * m_height;
         i_head.biXPelsPerMeter = 0;
         i_head.biYPelsPerMeter = 0;
-        i_head.biClrUsed = 0;
+        i_head.biClrUsed = color_palette.size() / 4;
         i_head.biClrImportant = 0;
 
         outputfile.write((char*)&f_head, sizeof(BITMAPFILEHEADER));
         outputfile.write((char*)&i_head, sizeof(BITMAPINFOHEADER));
+        outputfile.write((char*)color_palette.data(), color_palette.size());
 
     /*
         // build the standard bitmap file header
@@ -571,18 +621,170 @@ void BMP::BITMAP::SaveAsBitmap(const std::string& filename) const
 }
 
 
+BMP::LONG BMP::BITMAP::Width() const
+{
+    return m_width;
+}
+
+
+BMP::LONG BMP::BITMAP::Height() const
+{
+    return m_height;
+}
+
+
+BMP::WORD BMP::BITMAP::BitCount() const
+{
+    return m_bit_count;
+}
+
+
+// fills larger than this (bytes) use non-temporal stores
+// roughly the size of a last level cache slice, above which the
+// destination would be evicted before it is read again anyway
+static const BMP::LONG fill_stream_threshold{1 << 23};
+
+
+void BMP::BITMAP::fill_pattern(uint8_t* const pattern, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a) const
+{
+    // memory order is b, g, r, a
+    const uint8_t pixel[4]{b, g, r, a};
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel == 0)
+    {
+        memset(pattern, 0x00, 48);
+        return;
+    }
+    for(LONG i{0}; i < 48; ++ i)
+    {
+        pattern[i] = pixel[i % bytes_per_pixel];
+    }
+}
+
+
+void BMP::BITMAP::fill_span(uint8_t* const dst, const LONG count, const uint8_t* const pattern, const bool stream)
+{
+    // dst[i] = pattern[i % 48] for all i
+    LONG i{0};
+
+#if defined(__SSE2__)
+    if(stream)
+    {
+        // non-temporal stores require 16 byte alignment
+        LONG head{(16 - ((uintptr_t)dst & 15)) & 15};
+        if(head > count) head = count;
+        for(; i < head; ++ i)
+        {
+            dst[i] = pattern[i];
+        }
+
+        // rotate pattern so that it starts at the phase of the first
+        // aligned byte
+        uint8_t rotated[48];
+        for(LONG c{0}; c < 48; ++ c)
+        {
+            rotated[c] = pattern[(c + head) % 48];
+        }
+        const __m128i p0{_mm_loadu_si128((const __m128i*)(rotated + 0))};
+        const __m128i p1{_mm_loadu_si128((const __m128i*)(rotated + 16))};
+        const __m128i p2{_mm_loadu_si128((const __m128i*)(rotated + 32))};
+        for(; i + 48 <= count; i += 48)
+        {
+            _mm_stream_si128((__m128i*)(dst + i + 0), p0);
+            _mm_stream_si128((__m128i*)(dst + i + 16), p1);
+            _mm_stream_si128((__m128i*)(dst + i + 32), p2);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        const __m128i p0{_mm_loadu_si128((const __m128i*)(pattern + 0))};
+        const __m128i p1{_mm_loadu_si128((const __m128i*)(pattern + 16))};
+        const __m128i p2{_mm_loadu_si128((const __m128i*)(pattern + 32))};
+        for(; i + 48 <= count; i += 48)
+        {
+            _mm_storeu_si128((__m128i*)(dst + i + 0), p0);
+            _mm_storeu_si128((__m128i*)(dst + i + 16), p1);
+            _mm_storeu_si128((__m128i*)(dst + i + 32), p2);
+        }
+    }
+#else
+    (void)stream;
+    for(; i + 48 <= count; i += 48)
+    {
+        memcpy(dst + i, pattern, 48);
+    }
+#endif
+
+    // tail
+    for(; i < count; ++ i)
+    {
+        dst[i] = pattern[i % 48];
+    }
+}
+
+
 void BMP::BITMAP::Clear()
 {
-    for(unsigned int y{0}; y < m_height; ++ y)
+    // padding is cleared as well, so this is a single memset
+    memset(m_data.data(), 0x00, m_data.size());
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::Fill(const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a)
+{
+    uint8_t pattern[48];
+    fill_pattern(pattern, r, g, b, a);
+
+    const bool stream{m_data.size() >= fill_stream_threshold};
+
+    if(m_width_pad == 0)
     {
-        for(unsigned int x{0}; x < m_width; ++ x)
+        // rows are contiguous, and the pattern phase carries over from
+        // one row to the next
+        fill_span(m_data.data(), m_data.size(), pattern, stream);
+    }
+    else
+    {
+        const LONG row_bytes{m_width_memory - m_width_pad};
+        for(LONG y{0}; y < m_height; ++ y)
         {
-            //m_data[x + y * m_width_memory] &=
-            m_data[index(x, y) + 2] = 0x00;
-            m_data[index(x, y) + 1] = 0x00;
-            m_data[index(x, y) + 0] = 0x00;
+            uint8_t* const row{&m_data[y * m_width_memory]};
+            fill_span(row, row_bytes, pattern, stream);
+            memset(row + row_bytes, 0x00, m_width_pad);
         }
     }
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::FillRect(const int x, const int y, const int width, const int height, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a)
+{
+    // clip to bitmap
+    int64_t x_min{x};
+    int64_t y_min{y};
+    int64_t x_max{(int64_t)x + width};
+    int64_t y_max{(int64_t)y + height};
+    if(x_min < 0) x_min = 0;
+    if(y_min < 0) y_min = 0;
+    if(x_max > (int64_t)m_width) x_max = m_width;
+    if(y_max > (int64_t)m_height) y_max = m_height;
+    if(x_min >= x_max || y_min >= y_max)
+    {
+        return;
+    }
+
+    uint8_t pattern[48];
+    fill_pattern(pattern, r, g, b, a);
+
+    const LONG row_bytes{(LONG)(x_max - x_min) * (m_bit_count / 8)};
+    const bool stream{row_bytes * (LONG)(y_max - y_min) >= fill_stream_threshold};
+    for(int64_t yy{y_min}; yy < y_max; ++ yy)
+    {
+        fill_span(&m_data[index(x_min, yy)], row_bytes, pattern, stream);
+    }
+    mark_dirty(Rect{(int)x_min, (int)y_min, (int)(x_max - x_min), (int)(y_max - y_min)});
 }
 
 /*
@@ -604,6 +806,7 @@ void BMP::BITMAP::RGBFilterGeneric(const uint8_t r, const uint8_t g, const uint8
             functorkernel.operator()(&m_data[index(x, y) + 0], &m_data[index(x, y) + 0], &b);
         }
     }
+    mark_dirty_all();
 }
 
 void BMP::BITMAP::RGBFilterAND(const uint8_t r, const uint8_t g, const uint8_t b)
@@ -644,49 +847,129 @@ void BMP::BITMAP::Resize(const int width, const int height)
 }
 
 
-// TODO: want to implement using pixels (RGB)
-// require get/set and pixel struct
-// TODO: LONG vs int
-void BMP::BITMAP::Translate(const int dx, const int dy)
+void BMP::BITMAP::Blit(const BITMAP& src, const Rect& src_rect, const int dst_x, const int dst_y, const KernelMode rop)
 {
-    BITMAP temp(m_width, m_height, m_bit_count);
-    //temp.Clear();
-    // assume init to zero?
-    
-    // iterate over output
-    for(int y{0}; y < m_height; ++ y)
+    blit(src, src_rect, dst_x, dst_y, rop, nullptr);
+}
+
+
+void BMP::BITMAP::BlitColorKey(const BITMAP& src, const Rect& src_rect, const int dst_x, const int dst_y, const uint8_t key_r, const uint8_t key_g, const uint8_t key_b, const KernelMode rop)
+{
+    const uint8_t key[3]{key_b, key_g, key_r};
+    blit(src, src_rect, dst_x, dst_y, rop, key);
+}
+
+
+void BMP::BITMAP::blit(const BITMAP& src, const Rect& src_rect, const int dst_x, const int dst_y, const KernelMode rop, const uint8_t* const key)
+{
+    if(&src == this)
     {
-        for(int x{0}; x < m_width; ++ x)
-        {
-            int y_in{y - dy};
-            int x_in{x - dx};
-            if(y_in >= m_height)
-            {
-            
-            }
-            else if(y_in < 0)
-            {
+        // source and destination overlap, blit from a copy
+        const BITMAP copy(src);
+        blit(copy, src_rect, dst_x, dst_y, rop, key);
+        return;
+    }
 
-            }
-            else
+    if(src.m_bit_count != m_bit_count)
+    {
+        std::cerr << "Blit error: source and destination bit count differ" << std::endl;
+        return;
+    }
+
+    // clip against source
+    int64_t src_x{src_rect.x};
+    int64_t src_y{src_rect.y};
+    int64_t x{dst_x};
+    int64_t y{dst_y};
+    int64_t width{src_rect.width};
+    int64_t height{src_rect.height};
+    if(src_x < 0) { x -= src_x; width += src_x; src_x = 0; }
+    if(src_y < 0) { y -= src_y; height += src_y; src_y = 0; }
+    if(src_x + width > (int64_t)src.m_width) width = (int64_t)src.m_width - src_x;
+    if(src_y + height > (int64_t)src.m_height) height = (int64_t)src.m_height - src_y;
+
+    // clip against destination
+    if(x < 0) { src_x -= x; width += x; x = 0; }
+    if(y < 0) { src_y -= y; height += y; y = 0; }
+    if(x + width > (int64_t)m_width) width = (int64_t)m_width - x;
+    if(y + height > (int64_t)m_height) height = (int64_t)m_height - y;
+
+    if(width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    // iterate over rows of the clipped rectangle, no per pixel bounds checks
+    const FunctorKernel kernel(rop);
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    for(int64_t j{0}; j < height; ++ j)
+    {
+        uint8_t* const output{&m_data[index(x, y + j)]};
+        const uint8_t* const input{&src.m_data[src.index(src_x, src_y + j)]};
+
+        if(key == nullptr)
+        {
+            kernel.row(output, output, input, width * bytes_per_pixel);
+        }
+        else
+        {
+            // apply kernel to each run of pixels which do not match the key
+            int64_t i{0};
+            while(i < width)
             {
-                if(x_in >= m_width)
+                while(i < width)
                 {
-                
+                    const uint8_t* const p{input + i * bytes_per_pixel};
+                    if(p[0] != key[0] || p[1] != key[1] || p[2] != key[2]) break;
+                    ++ i;
                 }
-                else if(x_in < 0)
+                const int64_t run_start{i};
+                while(i < width)
                 {
-
+                    const uint8_t* const p{input + i * bytes_per_pixel};
+                    if(p[0] == key[0] && p[1] == key[1] && p[2] == key[2]) break;
+                    ++ i;
                 }
-                else
+                if(i > run_start)
                 {
-                    temp.m_data[temp.index(x, y) + 2] = m_data[index(x_in, y_in) + 2];
-                    temp.m_data[temp.index(x, y) + 1] = m_data[index(x_in, y_in) + 1];
-                    temp.m_data[temp.index(x, y) + 0] = m_data[index(x_in, y_in) + 0];
+                    const LONG offset{run_start * bytes_per_pixel};
+                    kernel.row(output + offset, output + offset, input + offset, (i - run_start) * bytes_per_pixel);
                 }
             }
         }
     }
+    mark_dirty(Rect{(int)x, (int)y, (int)width, (int)height});
+}
+
+
+void BMP::BITMAP::Translate(const int dx, const int dy)
+{
+    BITMAP temp(m_width, m_height, m_bit_count);
+    const BITMAP& source{*this};
+    source.Dispatch([&temp, dx, dy](const auto input)
+        {
+            typedef typename std::decay<decltype(input)>::type::format_type F;
+            const BasicBitmap<F> output{temp.View<F>()};
+            const int64_t width{(int64_t)input.Width()};
+            const int64_t height{(int64_t)input.Height()};
+
+            // output x in [x_begin, x_end) reads x - dx, the rest is left zero
+            const int64_t x_begin{std::min(std::max((int64_t)dx, (int64_t)0), width)};
+            const int64_t x_end{std::max(std::min(width + dx, width), x_begin)};
+            if(x_begin == x_end)
+            {
+                return;
+            }
+            for(int64_t y{0}; y < height; ++ y)
+            {
+                const int64_t y_in{y - dy};
+                if(y_in < 0 || y_in >= height)
+                {
+                    continue;
+                }
+                memcpy(output.Pixel(x_begin, y), input.Pixel(x_begin - dx, y_in), (x_end - x_begin) * input.bytes_per_pixel);
+            }
+        });
 
     *this = temp;
 }
@@ -758,6 +1041,7 @@ void BMP::BITMAP::OperatorKernelBinary(const BITMAP& bitmap_l, const BITMAP& bit
             kernel.operator()(output_ref, input_ref_l, input_ref_r);
         }
     }
+    mark_dirty_all();
 }
 
 void BMP::BITMAP::OperatorKernelUnary(const BITMAP& bitmap, FunctorKernel kernel)
@@ -780,43 +1064,48 @@ void BMP::BITMAP::OperatorKernelUnary(const BITMAP& bitmap, FunctorKernel kernel
             kernel.operator()(output_ref, input_ref);
         }
     }
+    mark_dirty_all();
 }
 
-// TODO delete
 void BMP::BITMAP::Generic(const BITMAP& bitmap, FunctorKernel functorkernel)
 {
-    // iterate over output
-    for(int y{0}; y < m_height; ++ y)
+    if(bitmap.m_bit_count != m_bit_count)
     {
-        for(int x{0}; x < m_width; ++ x)
-        {
-            if(y >= m_height)
-            {
+        std::cerr << "Generic error: bit count mismatch" << std::endl;
+        return;
+    }
 
-            }
-            else if(y >= bitmap.m_height)
-            {
+    // iterate over the area common to both
+    const LONG width{std::min(m_width, bitmap.m_width)};
+    const LONG height{std::min(m_height, bitmap.m_height)};
+    Dispatch([&bitmap, &functorkernel, width, height](const auto output)
+        {
+            typedef typename std::decay<decltype(output)>::type::format_type F;
+            const BasicBitmap<F, const uint8_t> input{bitmap.View<F>()};
+            const LONG count{width * output.bytes_per_pixel};
 
-            }
-            else
+            // alpha is not changed, it is saved and restored around each row
+            std::vector<typename F::channel_type> alpha(F::a >= 0 ? width : 0);
+            for(LONG y{0}; y < height; ++ y)
             {
-                if(x >= m_width)
+                typename F::channel_type * const row{output.Row(y)};
+                if(F::a >= 0)
                 {
-
-                }
-                else if(x >= bitmap.m_width)
-                {
-
+                    for(LONG x{0}; x < width; ++ x)
+                    {
+                        alpha[x] = row[x * F::channels + F::a];
+                    }
                 }
-                else
+                functorkernel.row((uint8_t*)row, (const uint8_t*)row, (const uint8_t*)input.Row(y), count);
+                if(F::a >= 0)
                 {
-                    functorkernel.operator()(&m_data[index(x, y) + 2], &bitmap.m_data[index(x, y) + 2]);
-                    functorkernel.operator()(&m_data[index(x, y) + 1], &bitmap.m_data[index(x, y) + 1]);
-                    functorkernel.operator()(&m_data[index(x, y) + 0], &bitmap.m_data[index(x, y) + 0]);
+                    for(LONG x{0}; x < width; ++ x)
+                    {
+                        row[x * F::channels + F::a] = alpha[x];
+                    }
                 }
             }
-        }
-    }
+        });
 }
 
 
@@ -836,3 +1125,89 @@ void BMP::BITMAP::XOR(const BITMAP& bitmap)
 {
     Generic(bitmap, FunctorKernel(KernelMode::XOR));
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+// row kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// one scalar and one SIMD implementation per kernel mode, selected at
+// compile time so that the inner loop contains no branches
+
+template<BMP::KernelMode MODE>
+static inline uint8_t kernel_scalar(const uint8_t l, const uint8_t r);
+
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::AND>(const uint8_t l, const uint8_t r) { return l & r; }
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::OR>(const uint8_t l, const uint8_t r) { return l | r; }
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::XOR>(const uint8_t l, const uint8_t r) { return l ^ r; }
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::ADD>(const uint8_t l, const uint8_t r) { return (l + r > 0xFF) ? 0xFF : l + r; }
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::SUBTRACT>(const uint8_t l, const uint8_t r) { return (l > r) ? l - r : 0x00; }
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::MIN>(const uint8_t l, const uint8_t r) { return (l < r) ? l : r; }
+template<> inline uint8_t kernel_scalar<BMP::KernelMode::MAX>(const uint8_t l, const uint8_t r) { return (l > r) ? l : r; }
+
+#if defined(__SSE2__)
+template<BMP::KernelMode MODE>
+static inline __m128i kernel_sse2(const __m128i l, const __m128i r);
+
+template<> inline __m128i kernel_sse2<BMP::KernelMode::AND>(const __m128i l, const __m128i r) { return _mm_and_si128(l, r); }
+template<> inline __m128i kernel_sse2<BMP::KernelMode::OR>(const __m128i l, const __m128i r) { return _mm_or_si128(l, r); }
+template<> inline __m128i kernel_sse2<BMP::KernelMode::XOR>(const __m128i l, const __m128i r) { return _mm_xor_si128(l, r); }
+template<> inline __m128i kernel_sse2<BMP::KernelMode::ADD>(const __m128i l, const __m128i r) { return _mm_adds_epu8(l, r); }
+template<> inline __m128i kernel_sse2<BMP::KernelMode::SUBTRACT>(const __m128i l, const __m128i r) { return _mm_subs_epu8(l, r); }
+template<> inline __m128i kernel_sse2<BMP::KernelMode::MIN>(const __m128i l, const __m128i r) { return _mm_min_epu8(l, r); }
+template<> inline __m128i kernel_sse2<BMP::KernelMode::MAX>(const __m128i l, const __m128i r) { return _mm_max_epu8(l, r); }
+#endif
+
+
+template<BMP::KernelMode MODE>
+static void kernel_row(uint8_t * const output, const uint8_t * const l, const uint8_t * const r, const BMP::LONG count)
+{
+    BMP::LONG c{0};
+#if defined(__SSE2__)
+    for(; c + 16 <= count; c += 16)
+    {
+        const __m128i vl{_mm_loadu_si128((const __m128i*)(l + c))};
+        const __m128i vr{_mm_loadu_si128((const __m128i*)(r + c))};
+        _mm_storeu_si128((__m128i*)(output + c), kernel_sse2<MODE>(vl, vr));
+    }
+#endif
+    for(; c < count; ++ c)
+    {
+        output[c] = kernel_scalar<MODE>(l[c], r[c]);
+    }
+}
+
+
+void BMP::FunctorKernel::row(uint8_t * const output, const uint8_t * const l, const uint8_t * const r, const LONG count) const
+{
+    switch(mode)
+    {
+        case KernelMode::UNDEFINED:
+            // nothing
+            break;
+        case KernelMode::AND:
+            kernel_row<KernelMode::AND>(output, l, r, count);
+            break;
+        case KernelMode::OR:
+            kernel_row<KernelMode::OR>(output, l, r, count);
+            break;
+        case KernelMode::XOR:
+            kernel_row<KernelMode::XOR>(output, l, r, count);
+            break;
+        case KernelMode::COPY:
+            if(output != r) memmove(output, r, count);
+            break;
+        case KernelMode::ADD:
+            kernel_row<KernelMode::ADD>(output, l, r, count);
+            break;
+        case KernelMode::SUBTRACT:
+            kernel_row<KernelMode::SUBTRACT>(output, l, r, count);
+            break;
+        case KernelMode::MIN:
+            kernel_row<KernelMode::MIN>(output, l, r, count);
+            break;
+        case KernelMode::MAX:
+            kernel_row<KernelMode::MAX>(output, l, r, count);
+            break;
+    }
+}
@@ -0,0 +1,342 @@
+#include "bitmapcache.hpp"
+
+
+// C headers
+#include <cstdio>
+#include <cinttypes>
+
+// C++ headers
+#include <atomic>
+
+// POSIX headers
+#include <unistd.h>
+
+
+// format a float exactly, so that keys of chains with different
+// parameters never collide through rounding
+static std::string key_float(const float value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%a", (double)value);
+    return std::string(buffer);
+}
+
+
+// edge mode as a short name
+static std::string key_edge(const BMP::EdgeMode edge)
+{
+    switch(edge)
+    {
+        case BMP::EdgeMode::CLAMP: return "clamp";
+        case BMP::EdgeMode::MIRROR: return "mirror";
+        case BMP::EdgeMode::WRAP: return "wrap";
+        case BMP::EdgeMode::ZERO: return "zero";
+    }
+    return "";
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OperationChain
+////////////////////////////////////////////////////////////////////////////////
+
+BMP::OperationChain::OperationChain()
+    : m_width{0}
+    , m_height{0}
+    , m_opaque{false}
+{
+}
+
+
+void BMP::OperationChain::append(const std::string& key, const std::function<void(BITMAP&)>& operation)
+{
+    m_key += key;
+    m_key += ';';
+    m_operations.push_back(operation);
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Resize(const int width, const int height)
+{
+    append("Resize(" + std::to_string(width) + "," + std::to_string(height) + ")",
+        [width, height](BITMAP& bitmap) { bitmap.Resize(width, height); });
+    m_width = width;
+    m_height = height;
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Translate(const int dx, const int dy)
+{
+    append("Translate(" + std::to_string(dx) + "," + std::to_string(dy) + ")",
+        [dx, dy](BITMAP& bitmap) { bitmap.Translate(dx, dy); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::BoxBlur(const int radius_x, const int radius_y, const EdgeMode edge)
+{
+    append("BoxBlur(" + std::to_string(radius_x) + "," + std::to_string(radius_y) + "," + key_edge(edge) + ")",
+        [radius_x, radius_y, edge](BITMAP& bitmap) { bitmap.BoxBlur(radius_x, radius_y, edge); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::GaussianBlur(const float sigma, const EdgeMode edge)
+{
+    append("GaussianBlur(" + key_float(sigma) + "," + key_edge(edge) + ")",
+        [sigma, edge](BITMAP& bitmap) { bitmap.GaussianBlur(sigma, edge); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Sharpen(const float amount)
+{
+    append("Sharpen(" + key_float(amount) + ")",
+        [amount](BITMAP& bitmap) { bitmap.Sharpen(amount); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::UnsharpMask(const float sigma, const float amount, const uint8_t threshold)
+{
+    append("UnsharpMask(" + key_float(sigma) + "," + key_float(amount) + "," + std::to_string(threshold) + ")",
+        [sigma, amount, threshold](BITMAP& bitmap) { bitmap.UnsharpMask(sigma, amount, threshold); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Gamma(const float gamma)
+{
+    append("Gamma(" + key_float(gamma) + ")",
+        [gamma](BITMAP& bitmap) { bitmap.Gamma(gamma); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Levels(const uint8_t in_black, const uint8_t in_white, const float gamma, const uint8_t out_black, const uint8_t out_white)
+{
+    append("Levels(" + std::to_string(in_black) + "," + std::to_string(in_white) + "," + key_float(gamma) + "," +
+           std::to_string(out_black) + "," + std::to_string(out_white) + ")",
+        [in_black, in_white, gamma, out_black, out_white](BITMAP& bitmap) { bitmap.Levels(in_black, in_white, gamma, out_black, out_white); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Invert()
+{
+    append("Invert()",
+        [](BITMAP& bitmap) { bitmap.Invert(); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Threshold(const uint8_t threshold)
+{
+    append("Threshold(" + std::to_string(threshold) + ")",
+        [threshold](BITMAP& bitmap) { bitmap.Threshold(threshold); });
+    return *this;
+}
+
+
+BMP::OperationChain& BMP::OperationChain::Custom(const std::string& key, const std::function<void(BITMAP&)>& operation)
+{
+    append("Custom(" + key + ")", operation);
+    m_opaque = true;
+    return *this;
+}
+
+
+const std::string& BMP::OperationChain::Key() const
+{
+    return m_key;
+}
+
+
+bool BMP::OperationChain::result_format(const BITMAP& input, LONG& width, LONG& height, WORD& bit_count) const
+{
+    if(m_opaque || m_width < 0 || m_height < 0)
+    {
+        return false;
+    }
+    width = (m_width > 0) ? (LONG)m_width : input.Width();
+    height = (m_height > 0) ? (LONG)m_height : input.Height();
+    bit_count = input.BitCount();
+    return true;
+}
+
+
+void BMP::OperationChain::Apply(BITMAP& bitmap) const
+{
+    for(const std::function<void(BITMAP&)>& operation : m_operations)
+    {
+        operation(bitmap);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BITMAPCache
+////////////////////////////////////////////////////////////////////////////////
+
+// bytes of pixel data held by a bitmap, rows are padded to 4 bytes
+static size_t bitmap_bytes(const BMP::BITMAP& bitmap)
+{
+    const size_t row{(size_t)((bitmap.Width() * (bitmap.BitCount() / 8) + 3) & ~(BMP::LONG)3)};
+    return row * bitmap.Height();
+}
+
+
+BMP::BITMAPCache::BITMAPCache(const size_t memory_budget, const std::string& directory)
+    : m_memory_budget{memory_budget}
+    , m_memory_used{0}
+    , m_directory{directory}
+    , m_hits{0}
+    , m_misses{0}
+{
+}
+
+
+std::string BMP::BITMAPCache::disk_filename(const std::string& key) const
+{
+    // the key may contain any characters, so the file is named after its hash
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".bmp", HashBytes((const uint8_t*)key.data(), key.size()));
+    return m_directory + "/" + name;
+}
+
+
+std::shared_ptr<const BMP::BITMAP> BMP::BITMAPCache::load(const std::string& filename, const BITMAP& input, const OperationChain& chain)
+{
+    const BITMAPInfo info{BITMAP::Probe(filename)};
+    if(info.status != ProbeStatus::OK || info.width == 0 || info.height == 0)
+    {
+        return nullptr;
+    }
+
+    // results of chains with Custom operations only need a valid file
+    LONG width;
+    LONG height;
+    WORD bit_count;
+    if(chain.result_format(input, width, height, bit_count) &&
+       (info.width != width || info.height != height || info.bit_count != bit_count))
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<const BITMAP> bitmap{std::make_shared<const BITMAP>(filename)};
+    if(bitmap->Width() != info.width || bitmap->Height() != info.height || bitmap->BitCount() != info.bit_count)
+    {
+        return nullptr;
+    }
+    return bitmap;
+}
+
+
+void BMP::BITMAPCache::save(const std::string& filename, const BITMAP& bitmap)
+{
+    // a unique temporary name per process and call, so that concurrent
+    // misses on the same key never write the same file, and readers only
+    // ever see a complete file
+    static std::atomic<uint64_t> counter{0};
+    const std::string temp{filename + "." + std::to_string((long long)getpid()) + "." + std::to_string(counter++) + ".tmp"};
+    bitmap.SaveAsBitmap(temp);
+    if(BITMAP::Probe(temp).status != ProbeStatus::OK || std::rename(temp.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+    }
+}
+
+
+void BMP::BITMAPCache::insert(const std::string& key, const std::shared_ptr<const BITMAP>& bitmap)
+{
+    const size_t bytes{bitmap_bytes(*bitmap)};
+    if(bytes > m_memory_budget || m_index.count(key) != 0)
+    {
+        return;
+    }
+
+    m_entries.push_front(Entry{key, bitmap, bytes});
+    m_index[key] = m_entries.begin();
+    m_memory_used += bytes;
+
+    while(m_memory_used > m_memory_budget)
+    {
+        const Entry& last{m_entries.back()};
+        m_memory_used -= last.bytes;
+        m_index.erase(last.key);
+        m_entries.pop_back();
+    }
+}
+
+
+std::shared_ptr<const BMP::BITMAP> BMP::BITMAPCache::Apply(const BITMAP& input, const OperationChain& chain)
+{
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016" PRIx64 "|", input.Hash());
+    const std::string key{hash + chain.Key()};
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if(it != m_index.end())
+        {
+            // move to the front of the LRU list
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            ++ m_hits;
+            return it->second->bitmap;
+        }
+        ++ m_misses;
+    }
+
+    // computed without holding the lock, so other lookups are not blocked
+    std::shared_ptr<const BITMAP> result;
+    if(!m_directory.empty())
+    {
+        result = load(disk_filename(key), input, chain);
+    }
+    if(!result)
+    {
+        std::shared_ptr<BITMAP> output{std::make_shared<BITMAP>(input)};
+        chain.Apply(*output);
+        if(!m_directory.empty())
+        {
+            save(disk_filename(key), *output);
+        }
+        result = output;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insert(key, result);
+    return result;
+}
+
+
+void BMP::BITMAPCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_memory_used = 0;
+}
+
+
+size_t BMP::BITMAPCache::MemoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memory_used;
+}
+
+
+uint64_t BMP::BITMAPCache::Hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+
+uint64_t BMP::BITMAPCache::Misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
@@ -0,0 +1,165 @@
+#include "bitmapcanvas.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+
+BMP::BITMAPCanvas::BITMAPCanvas(const LONG width, const LONG height, const BITMAPFont* const font, const WORD bit_count)
+    : BITMAP(width, height, bit_count)
+    , m_font{font}
+{
+}
+
+
+BMP::BITMAPCanvas::~BITMAPCanvas()
+{
+}
+
+
+void BMP::BITMAPCanvas::SetFont(const BITMAPFont* const font)
+{
+    if(font != m_font)
+    {
+        m_font = font;
+        m_layout_cache.clear();
+    }
+}
+
+
+const BMP::BITMAPCanvas::TextLayout& BMP::BITMAPCanvas::layout(const std::string& text)
+{
+    auto it = m_layout_cache.find(text);
+    if(it != m_layout_cache.end())
+    {
+        return it->second;
+    }
+
+    if(m_layout_cache.size() >= m_layout_cache_limit)
+    {
+        m_layout_cache.clear();
+    }
+
+    TextLayout layout;
+    layout.x_min = 0;
+    layout.y_min = 0;
+    layout.x_max = 0;
+    layout.y_max = 0;
+
+    const int glyph_width{m_font->GlyphWidth()};
+    const int glyph_height{m_font->GlyphHeight()};
+
+    int pen_x{0};
+    int pen_y{0};
+    for(const char ch : text)
+    {
+        if(ch == '\n')
+        {
+            pen_x = 0;
+            pen_y -= glyph_height;
+            continue;
+        }
+
+        size_t count{0};
+        const BITMAPFont::Span* const spans{m_font->GlyphSpans((unsigned char)ch, count)};
+        for(size_t i{0}; i < count; ++ i)
+        {
+            layout.spans.push_back(BITMAPFont::Span{pen_x + spans[i].x, pen_y + spans[i].y, spans[i].length});
+        }
+        pen_x += glyph_width;
+    }
+
+    // sort into rows and merge spans which touch across glyph boundaries
+    std::sort(layout.spans.begin(), layout.spans.end(),
+        [](const BITMAPFont::Span& l, const BITMAPFont::Span& r)
+        {
+            return (l.y < r.y) || (l.y == r.y && l.x < r.x);
+        });
+    std::vector<BITMAPFont::Span> merged;
+    for(const BITMAPFont::Span& span : layout.spans)
+    {
+        if(!merged.empty() && merged.back().y == span.y && merged.back().x + merged.back().length == span.x)
+        {
+            merged.back().length += span.length;
+        }
+        else
+        {
+            merged.push_back(span);
+        }
+    }
+    layout.spans.swap(merged);
+
+    if(!layout.spans.empty())
+    {
+        layout.x_min = layout.spans.front().x;
+        layout.x_max = layout.spans.front().x + layout.spans.front().length;
+        layout.y_min = layout.spans.front().y;
+        layout.y_max = layout.spans.back().y + 1;
+        for(const BITMAPFont::Span& span : layout.spans)
+        {
+            layout.x_min = std::min(layout.x_min, span.x);
+            layout.x_max = std::max(layout.x_max, span.x + span.length);
+        }
+    }
+
+    return m_layout_cache.emplace(text, std::move(layout)).first->second;
+}
+
+
+void BMP::BITMAPCanvas::DrawText(const int x, const int y, const std::string& text, const uint8_t r, const uint8_t g, const uint8_t b)
+{
+    if(m_font == nullptr)
+    {
+        std::cerr << "Canvas error: no font set" << std::endl;
+        return;
+    }
+
+    const TextLayout& text_layout{layout(text)};
+    if(text_layout.spans.empty())
+    {
+        return;
+    }
+
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+
+    // reject text entirely outside the canvas
+    if((int64_t)x + text_layout.x_max <= 0 || (int64_t)x + text_layout.x_min >= width ||
+       (int64_t)y + text_layout.y_max <= 0 || (int64_t)y + text_layout.y_min >= height)
+    {
+        return;
+    }
+
+    uint8_t pattern[48];
+    fill_pattern(pattern, r, g, b, 0xFF);
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+
+    const bool inside{(int64_t)x + text_layout.x_min >= 0 && (int64_t)x + text_layout.x_max <= width &&
+                      (int64_t)y + text_layout.y_min >= 0 && (int64_t)y + text_layout.y_max <= height};
+
+    if(inside)
+    {
+        // no clipping required
+        for(const BITMAPFont::Span& span : text_layout.spans)
+        {
+            fill_span(&m_data[index(x + span.x, y + span.y)], span.length * bytes_per_pixel, pattern, false);
+        }
+    }
+    else
+    {
+        for(const BITMAPFont::Span& span : text_layout.spans)
+        {
+            const int64_t yy{(int64_t)y + span.y};
+            if(yy < 0 || yy >= height) continue;
+            int64_t x_min{(int64_t)x + span.x};
+            int64_t x_max{x_min + span.length};
+            if(x_min < 0) x_min = 0;
+            if(x_max > width) x_max = width;
+            if(x_min >= x_max) continue;
+            fill_span(&m_data[index(x_min, yy)], (x_max - x_min) * bytes_per_pixel, pattern, false);
+        }
+    }
+
+    // mark_dirty clips to the canvas
+    mark_dirty(Rect{x + text_layout.x_min, y + text_layout.y_min, text_layout.x_max - text_layout.x_min, text_layout.y_max - text_layout.y_min});
+}
@@ -0,0 +1,256 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+// C headers
+#include <cstring>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG channels_min_band{256};
+
+
+void BMP::BITMAP::SplitChannels(BITMAP& r, BITMAP& g, BITMAP& b) const
+{
+    BITMAP* const planes[4]{&b, &g, &r, nullptr};
+    split_channels(planes);
+}
+
+
+void BMP::BITMAP::SplitChannels(BITMAP& r, BITMAP& g, BITMAP& b, BITMAP& a) const
+{
+    BITMAP* const planes[4]{&b, &g, &r, &a};
+    split_channels(planes);
+}
+
+
+void BMP::BITMAP::MergeChannels(const BITMAP& r, const BITMAP& g, const BITMAP& b)
+{
+    const BITMAP* const planes[4]{&b, &g, &r, nullptr};
+    merge_channels(planes);
+}
+
+
+void BMP::BITMAP::MergeChannels(const BITMAP& r, const BITMAP& g, const BITMAP& b, const BITMAP& a)
+{
+    const BITMAP* const planes[4]{&b, &g, &r, &a};
+    merge_channels(planes);
+}
+
+
+void BMP::BITMAP::split_channels(BITMAP* const planes[4]) const
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "SplitChannels error: requires 24 or 32 bit image" << std::endl;
+        return;
+    }
+
+    const int count{planes[3] != nullptr ? 4 : 3};
+    for(int c{0}; c < count; ++ c)
+    {
+        planes[c]->reinitialize(m_width, m_height, 8);
+    }
+
+    ParallelBands(m_height, channels_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                const uint8_t * const row{&m_data[index(0, y)]};
+                uint8_t* output[4]{nullptr, nullptr, nullptr, nullptr};
+                for(int c{0}; c < count; ++ c)
+                {
+                    output[c] = &planes[c]->m_data[planes[c]->index(0, y)];
+                }
+
+                LONG x{0};
+                if(bytes_per_pixel == 4)
+                {
+#if defined(__SSE2__)
+                    // 16 pixels per iteration, each channel is shifted to the
+                    // low byte of its lane and packed down to bytes
+                    const __m128i mask{_mm_set1_epi32(0xFF)};
+                    for(; x + 16 <= m_width; x += 16)
+                    {
+                        __m128i v[4];
+                        for(int i{0}; i < 4; ++ i)
+                        {
+                            v[i] = _mm_loadu_si128((const __m128i*)(row + 4 * x + 16 * i));
+                        }
+                        for(int c{0}; c < count; ++ c)
+                        {
+                            const __m128i lo{_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v[0], 8 * c), mask), _mm_and_si128(_mm_srli_epi32(v[1], 8 * c), mask))};
+                            const __m128i hi{_mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(v[2], 8 * c), mask), _mm_and_si128(_mm_srli_epi32(v[3], 8 * c), mask))};
+                            _mm_storeu_si128((__m128i*)(output[c] + x), _mm_packus_epi16(lo, hi));
+                        }
+                    }
+#endif
+                    for(; x < m_width; ++ x)
+                    {
+                        for(int c{0}; c < count; ++ c)
+                        {
+                            output[c][x] = row[4 * x + c];
+                        }
+                    }
+                }
+                else
+                {
+                    for(; x < m_width; ++ x)
+                    {
+                        output[0][x] = row[3 * x + 0];
+                        output[1][x] = row[3 * x + 1];
+                        output[2][x] = row[3 * x + 2];
+                    }
+                    if(count == 4)
+                    {
+                        memset(output[3], 0xFF, m_width);
+                    }
+                }
+            }
+        });
+
+    for(int c{0}; c < count; ++ c)
+    {
+        planes[c]->mark_dirty_all();
+    }
+}
+
+
+void BMP::BITMAP::merge_channels(const BITMAP* const planes[4])
+{
+    const int count{planes[3] != nullptr ? 4 : 3};
+    for(int c{0}; c < count; ++ c)
+    {
+        if(planes[c]->m_bit_count != 8 ||
+           planes[c]->m_width != planes[0]->m_width || planes[c]->m_height != planes[0]->m_height)
+        {
+            std::cerr << "MergeChannels error: channels must be 8 bit images of the same size" << std::endl;
+            return;
+        }
+    }
+
+    const LONG width{planes[0]->m_width};
+    const LONG height{planes[0]->m_height};
+    // *this may be resized, so it must not be one of the planes
+    reinitialize(width, height, 8 * count);
+
+    ParallelBands(height, channels_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const row{&m_data[index(0, y)]};
+                const uint8_t* input[4]{nullptr, nullptr, nullptr, nullptr};
+                for(int c{0}; c < count; ++ c)
+                {
+                    input[c] = &planes[c]->m_data[planes[c]->index(0, y)];
+                }
+
+                LONG x{0};
+                if(count == 4)
+                {
+#if defined(__SSE2__)
+                    // interleave b with g and r with a into 16 bit pairs, then
+                    // the pairs into 32 bit pixels
+                    for(; x + 16 <= width; x += 16)
+                    {
+                        const __m128i b{_mm_loadu_si128((const __m128i*)(input[0] + x))};
+                        const __m128i g{_mm_loadu_si128((const __m128i*)(input[1] + x))};
+                        const __m128i r{_mm_loadu_si128((const __m128i*)(input[2] + x))};
+                        const __m128i a{_mm_loadu_si128((const __m128i*)(input[3] + x))};
+                        const __m128i bg_lo{_mm_unpacklo_epi8(b, g)};
+                        const __m128i bg_hi{_mm_unpackhi_epi8(b, g)};
+                        const __m128i ra_lo{_mm_unpacklo_epi8(r, a)};
+                        const __m128i ra_hi{_mm_unpackhi_epi8(r, a)};
+                        _mm_storeu_si128((__m128i*)(row + 4 * x + 0), _mm_unpacklo_epi16(bg_lo, ra_lo));
+                        _mm_storeu_si128((__m128i*)(row + 4 * x + 16), _mm_unpackhi_epi16(bg_lo, ra_lo));
+                        _mm_storeu_si128((__m128i*)(row + 4 * x + 32), _mm_unpacklo_epi16(bg_hi, ra_hi));
+                        _mm_storeu_si128((__m128i*)(row + 4 * x + 48), _mm_unpackhi_epi16(bg_hi, ra_hi));
+                    }
+#endif
+                    for(; x < width; ++ x)
+                    {
+                        row[4 * x + 0] = input[0][x];
+                        row[4 * x + 1] = input[1][x];
+                        row[4 * x + 2] = input[2][x];
+                        row[4 * x + 3] = input[3][x];
+                    }
+                }
+                else
+                {
+                    for(; x < width; ++ x)
+                    {
+                        row[3 * x + 0] = input[0][x];
+                        row[3 * x + 1] = input[1][x];
+                        row[3 * x + 2] = input[2][x];
+                    }
+                }
+            }
+        });
+
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::ShiftChannels(const int dx_r, const int dy_r, const int dx_g, const int dy_g, const int dx_b, const int dy_b)
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "ShiftChannels error: requires 24 or 32 bit image" << std::endl;
+        return;
+    }
+
+    // memory order b, g, r
+    const int64_t dx[3]{dx_b, dx_g, dx_r};
+    const int64_t dy[3]{dy_b, dy_g, dy_r};
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+
+    std::vector<uint8_t> data(m_data.size());
+    ParallelBands(m_height, channels_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const output{&data[index(0, y)]};
+                for(int c{0}; c < 3; ++ c)
+                {
+                    const int64_t y_in{(int64_t)y - dy[c]};
+                    if(y_in < 0 || y_in >= height)
+                    {
+                        // left zero
+                        continue;
+                    }
+
+                    // output x in [x_begin, x_end) reads x - dx[c], the rest
+                    // of the row is left zero
+                    const int64_t x_begin{std::min(std::max(dx[c], (int64_t)0), width)};
+                    const int64_t x_end{std::max(std::min(width + dx[c], width), x_begin)};
+                    const uint8_t * const input{&m_data[index(0, y_in)] + c};
+                    for(int64_t x{x_begin}; x < x_end; ++ x)
+                    {
+                        output[x * bytes_per_pixel + c] = input[(x - dx[c]) * bytes_per_pixel];
+                    }
+                }
+                if(bytes_per_pixel == 4)
+                {
+                    const uint8_t * const input{&m_data[index(0, y)]};
+                    for(LONG x{0}; x < m_width; ++ x)
+                    {
+                        output[4 * x + 3] = input[4 * x + 3];
+                    }
+                }
+            }
+        });
+
+    m_data.swap(data);
+    mark_dirty_all();
+}
@@ -0,0 +1,570 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cmath>
+#include <cstring>
+
+// C++ headers
+#include <algorithm>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG color_min_band{256};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// fixed point color conversion coefficients
+////////////////////////////////////////////////////////////////////////////////
+
+// all coefficients are 16.16 fixed point, BT.601 full range
+
+// luma
+static const int32_t coeff_y_r{19595}; // 0.299
+static const int32_t coeff_y_g{38470}; // 0.587
+static const int32_t coeff_y_b{7471}; // 0.114
+
+// chroma
+static const int32_t coeff_cb_r{-11059}; // -0.168736
+static const int32_t coeff_cb_g{-21709}; // -0.331264
+static const int32_t coeff_cb_b{32768}; // 0.5
+static const int32_t coeff_cr_r{32768}; // 0.5
+static const int32_t coeff_cr_g{-27439}; // -0.418688
+static const int32_t coeff_cr_b{-5329}; // -0.081312
+
+// inverse
+static const int32_t coeff_r_cr{91881}; // 1.402
+static const int32_t coeff_g_cb{-22554}; // -0.344136
+static const int32_t coeff_g_cr{-46802}; // -0.714136
+static const int32_t coeff_b_cb{116130}; // 1.772
+
+
+static inline uint8_t clamp_uint8(const int32_t v)
+{
+    return (uint8_t)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+static inline uint8_t div255(const int32_t x)
+{
+    const int32_t t{x + 128};
+    return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+
+#if defined(__SSE2__)
+
+////////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// 4 pixels are loaded as 32 bit lanes b | g << 8 | r << 16 | x << 24, where x
+// is alpha, or the next byte of the row for 24 bit images, and is written
+// back unchanged
+// the channels are multiplied in the 16 bit halves of the lanes, (b, r) and
+// (g, x), with _mm_madd_epi16, which needs coefficients in 16 bits: those
+// that are not are halved (or split into 3 or 5 equal parts) and the sum
+// scaled back, or the whole sum is negated so that 32768 becomes -32768
+
+static_assert(coeff_y_g % 2 == 0 && coeff_b_cb % 5 == 0 && coeff_r_cr % 3 == 0 &&
+    coeff_g_cb % 2 == 0 && coeff_g_cr % 2 == 0, "fixed point coefficients must split exactly");
+
+
+// number of pixels that must remain in the row to load 16 bytes from a pixel
+static inline BMP::LONG sse2_reach(const BMP::LONG bytes_per_pixel)
+{
+    return (bytes_per_pixel == 3) ? 6 : 4;
+}
+
+static inline __m128i load_pixels(const uint8_t * const p, const BMP::LONG bytes_per_pixel)
+{
+    const __m128i v{_mm_loadu_si128((const __m128i*)p)};
+    if(bytes_per_pixel == 4)
+    {
+        return v;
+    }
+    const __m128i p01{_mm_unpacklo_epi32(v, _mm_srli_si128(v, 3))};
+    const __m128i p23{_mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9))};
+    return _mm_unpacklo_epi64(p01, p23);
+}
+
+// overlapping stores for 24 bit images, each restores the byte after its
+// pixel, which the next store overwrites
+static inline void store_pixels(uint8_t * const p, const __m128i v, const BMP::LONG bytes_per_pixel)
+{
+    if(bytes_per_pixel == 4)
+    {
+        _mm_storeu_si128((__m128i*)p, v);
+        return;
+    }
+    const int32_t lanes[4]{_mm_cvtsi128_si32(v), _mm_cvtsi128_si32(_mm_srli_si128(v, 4)),
+                           _mm_cvtsi128_si32(_mm_srli_si128(v, 8)), _mm_cvtsi128_si32(_mm_srli_si128(v, 12))};
+    for(int i{0}; i < 4; ++ i)
+    {
+        memcpy(p + 3 * i, &lanes[i], 4);
+    }
+}
+
+// 32 bit lane holding lo in its low and hi in its high 16 bits
+static inline __m128i coeff_pair(const int32_t lo, const int32_t hi)
+{
+    return _mm_set1_epi32((int32_t)(((uint32_t)hi << 16) | ((uint32_t)lo & 0xFFFF)));
+}
+
+// (v + 2^15) >> 16 of signed 32 bit lanes
+static inline __m128i round_16(const __m128i v)
+{
+    return _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(1 << 15)), 16);
+}
+
+// lanes c0 | c1 << 8 | c2 << 16 with each channel clamped to 0..255, and
+// the top byte of keep
+static inline __m128i pack_pixels(const __m128i c0, const __m128i c1, const __m128i c2, const __m128i keep)
+{
+    const __m128i zero{_mm_setzero_si128()};
+    const __m128i bytes{_mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c2))};
+    const __m128i lo{_mm_unpacklo_epi8(bytes, zero)};
+    const __m128i hi{_mm_unpackhi_epi8(bytes, zero)};
+    const __m128i v0{_mm_unpacklo_epi16(lo, zero)};
+    const __m128i v1{_mm_unpackhi_epi16(lo, zero)};
+    const __m128i v2{_mm_unpacklo_epi16(hi, zero)};
+    const __m128i top{_mm_and_si128(keep, _mm_set1_epi32((int32_t)0xFF000000))};
+    return _mm_or_si128(_mm_or_si128(v0, _mm_slli_epi32(v1, 8)), _mm_or_si128(_mm_slli_epi32(v2, 16), top));
+}
+
+// luma of 4 pixels as 32 bit lanes
+static inline __m128i luma_4(const __m128i v)
+{
+    const __m128i mask{_mm_set1_epi32(0x00FF00FF)};
+    const __m128i br{_mm_and_si128(v, mask)};
+    const __m128i gx{_mm_and_si128(_mm_srli_epi32(v, 8), mask)};
+    const __m128i y{_mm_add_epi32(_mm_madd_epi16(br, coeff_pair(coeff_y_b, coeff_y_r)),
+                                  _mm_slli_epi32(_mm_madd_epi16(gx, coeff_pair(coeff_y_g / 2, 0)), 1))};
+    return round_16(y);
+}
+
+// ConvertToYCbCr of the pixels of a row up to the last sse2_reach from its end
+static BMP::LONG ycbcr_row_sse2(uint8_t * const row, const BMP::LONG width, const BMP::LONG bytes_per_pixel)
+{
+    const __m128i mask{_mm_set1_epi32(0x00FF00FF)};
+    const __m128i offset{_mm_set1_epi32(128)};
+    BMP::LONG x{0};
+    for(; x + sse2_reach(bytes_per_pixel) <= width; x += 4)
+    {
+        uint8_t * const p{row + x * bytes_per_pixel};
+        const __m128i v{load_pixels(p, bytes_per_pixel)};
+        const __m128i br{_mm_and_si128(v, mask)};
+        const __m128i gx{_mm_and_si128(_mm_srli_epi32(v, 8), mask)};
+        const __m128i y{luma_4(v)};
+        const __m128i cb_neg{_mm_add_epi32(_mm_madd_epi16(br, coeff_pair(-coeff_cb_b, -coeff_cb_r)),
+                                           _mm_madd_epi16(gx, coeff_pair(-coeff_cb_g, 0)))};
+        const __m128i cr_neg{_mm_add_epi32(_mm_madd_epi16(br, coeff_pair(-coeff_cr_b, -coeff_cr_r)),
+                                           _mm_madd_epi16(gx, coeff_pair(-coeff_cr_g, 0)))};
+        const __m128i cb{_mm_add_epi32(round_16(_mm_sub_epi32(_mm_setzero_si128(), cb_neg)), offset)};
+        const __m128i cr{_mm_add_epi32(round_16(_mm_sub_epi32(_mm_setzero_si128(), cr_neg)), offset)};
+        store_pixels(p, pack_pixels(y, cb, cr, v), bytes_per_pixel);
+    }
+    return x;
+}
+
+// ConvertFromYCbCr of the pixels of a row up to the last sse2_reach from its
+// end, (luma << 16 + c + 2^15) >> 16 is formed as luma + (c + 2^15) >> 16
+static BMP::LONG from_ycbcr_row_sse2(uint8_t * const row, const BMP::LONG width, const BMP::LONG bytes_per_pixel)
+{
+    const __m128i low{_mm_set1_epi32(0xFF)};
+    BMP::LONG x{0};
+    for(; x + sse2_reach(bytes_per_pixel) <= width; x += 4)
+    {
+        uint8_t * const p{row + x * bytes_per_pixel};
+        const __m128i v{load_pixels(p, bytes_per_pixel)};
+        const __m128i luma{_mm_and_si128(v, low)};
+        // (cb - 128, cr - 128) in the halves of each lane
+        const __m128i cbcr{_mm_sub_epi16(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 8), low), _mm_and_si128(v, _mm_set1_epi32(0x00FF0000))),
+                                         _mm_set1_epi16(128))};
+        const __m128i b5{_mm_madd_epi16(cbcr, coeff_pair(coeff_b_cb / 5, 0))};
+        const __m128i g2{_mm_madd_epi16(cbcr, coeff_pair(coeff_g_cb / 2, coeff_g_cr / 2))};
+        const __m128i r3{_mm_madd_epi16(cbcr, coeff_pair(0, coeff_r_cr / 3))};
+        const __m128i b{_mm_add_epi32(luma, round_16(_mm_add_epi32(_mm_slli_epi32(b5, 2), b5)))};
+        const __m128i g{_mm_add_epi32(luma, round_16(_mm_slli_epi32(g2, 1)))};
+        const __m128i r{_mm_add_epi32(luma, round_16(_mm_add_epi32(_mm_slli_epi32(r3, 1), r3)))};
+        store_pixels(p, pack_pixels(b, g, r, v), bytes_per_pixel);
+    }
+    return x;
+}
+
+// Grayscale of the pixels of a row up to the last sse2_reach from its end,
+// 8 pixels per iteration
+static BMP::LONG luma_row_sse2(const uint8_t * const row, uint8_t * const output, const BMP::LONG width, const BMP::LONG bytes_per_pixel)
+{
+    BMP::LONG x{0};
+    for(; x + 4 + sse2_reach(bytes_per_pixel) <= width; x += 8)
+    {
+        const __m128i lo{luma_4(load_pixels(row + x * bytes_per_pixel, bytes_per_pixel))};
+        const __m128i hi{luma_4(load_pixels(row + (x + 4) * bytes_per_pixel, bytes_per_pixel))};
+        const __m128i y{_mm_packs_epi32(lo, hi)};
+        _mm_storel_epi64((__m128i*)(output + x), _mm_packus_epi16(y, y));
+    }
+    return x;
+}
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// look up tables
+////////////////////////////////////////////////////////////////////////////////
+
+void BMP::BITMAP::ApplyLUT(const uint8_t* const lut)
+{
+    ApplyLUT(lut, lut, lut);
+}
+
+
+void BMP::BITMAP::ApplyLUT(const uint8_t* const lut_r, const uint8_t* const lut_g, const uint8_t* const lut_b)
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel == 0)
+    {
+        return;
+    }
+
+    // when all channels share one table and there is no alpha (or there is
+    // only one channel), the row is a single contiguous run of bytes
+    const bool single{(bytes_per_pixel < 3) || (bytes_per_pixel == 3 && lut_r == lut_g && lut_g == lut_b)};
+
+    ParallelBands(m_height, color_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const row{&m_data[index(0, y)]};
+                if(single)
+                {
+                    const uint8_t * const lut{(bytes_per_pixel < 3) ? lut_g : lut_r};
+                    const LONG row_bytes{m_width * bytes_per_pixel};
+                    for(LONG i{0}; i < row_bytes; ++ i)
+                    {
+                        row[i] = lut[row[i]];
+                    }
+                }
+                else
+                {
+                    for(LONG x{0}; x < m_width; ++ x)
+                    {
+                        uint8_t * const p{row + x * bytes_per_pixel};
+                        p[0] = lut_b[p[0]];
+                        p[1] = lut_g[p[1]];
+                        p[2] = lut_r[p[2]];
+                    }
+                }
+            }
+        });
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::Gamma(const float gamma)
+{
+    if(gamma <= 0.0f)
+    {
+        std::cerr << "Gamma error: gamma must be positive" << std::endl;
+        return;
+    }
+
+    uint8_t lut[256];
+    for(int v{0}; v < 256; ++ v)
+    {
+        lut[v] = clamp_uint8((int32_t)std::lround(255.0 * std::pow(v / 255.0, 1.0 / gamma)));
+    }
+    ApplyLUT(lut);
+}
+
+
+void BMP::BITMAP::Levels(const uint8_t in_black, const uint8_t in_white, const float gamma, const uint8_t out_black, const uint8_t out_white)
+{
+    if(in_white <= in_black || gamma <= 0.0f)
+    {
+        std::cerr << "Levels error: invalid input range or gamma" << std::endl;
+        return;
+    }
+
+    uint8_t lut[256];
+    for(int v{0}; v < 256; ++ v)
+    {
+        double t{(double)(v - in_black) / (double)(in_white - in_black)};
+        t = std::max(0.0, std::min(1.0, t));
+        t = std::pow(t, 1.0 / gamma);
+        lut[v] = clamp_uint8((int32_t)std::lround(out_black + (out_white - out_black) * t));
+    }
+    ApplyLUT(lut);
+}
+
+
+void BMP::BITMAP::Curves(const std::vector<std::pair<uint8_t, uint8_t>>& points)
+{
+    if(points.empty())
+    {
+        return;
+    }
+
+    std::vector<std::pair<uint8_t, uint8_t>> sorted(points);
+    std::sort(sorted.begin(), sorted.end());
+
+    uint8_t lut[256];
+    size_t segment{0};
+    for(int v{0}; v < 256; ++ v)
+    {
+        while(segment + 1 < sorted.size() && sorted[segment + 1].first <= v)
+        {
+            ++ segment;
+        }
+
+        if(v <= sorted.front().first)
+        {
+            lut[v] = sorted.front().second;
+        }
+        else if(segment + 1 >= sorted.size())
+        {
+            lut[v] = sorted.back().second;
+        }
+        else
+        {
+            const int x0{sorted[segment].first};
+            const int y0{sorted[segment].second};
+            const int x1{sorted[segment + 1].first};
+            const int y1{sorted[segment + 1].second};
+            lut[v] = clamp_uint8(y0 + ((y1 - y0) * (v - x0) * 2 + (x1 - x0)) / (2 * (x1 - x0)));
+        }
+    }
+    ApplyLUT(lut);
+}
+
+
+void BMP::BITMAP::Invert()
+{
+    uint8_t lut[256];
+    for(int v{0}; v < 256; ++ v)
+    {
+        lut[v] = 255 - v;
+    }
+    ApplyLUT(lut);
+}
+
+
+void BMP::BITMAP::Threshold(const uint8_t threshold)
+{
+    uint8_t lut[256];
+    for(int v{0}; v < 256; ++ v)
+    {
+        lut[v] = (v >= threshold) ? 255 : 0;
+    }
+    ApplyLUT(lut);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// color space conversion
+////////////////////////////////////////////////////////////////////////////////
+
+// the matrix conversions are fixed point arithmetic, with SSE2 kernels for
+// 4 pixels at a time and a scalar loop for the rest of the row
+
+void BMP::BITMAP::ConvertToYCbCr()
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "ConvertToYCbCr error: requires 24 or 32 bit image" << std::endl;
+        return;
+    }
+
+    ParallelBands(m_height, color_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const row{&m_data[index(0, y)]};
+                LONG x{0};
+#if defined(__SSE2__)
+                x = ycbcr_row_sse2(row, m_width, bytes_per_pixel);
+#endif
+                for(; x < m_width; ++ x)
+                {
+                    uint8_t * const p{row + x * bytes_per_pixel};
+                    const int32_t b{p[0]};
+                    const int32_t g{p[1]};
+                    const int32_t r{p[2]};
+                    p[0] = clamp_uint8((coeff_y_r * r + coeff_y_g * g + coeff_y_b * b + (1 << 15)) >> 16);
+                    p[1] = clamp_uint8(((coeff_cb_r * r + coeff_cb_g * g + coeff_cb_b * b + (1 << 15)) >> 16) + 128);
+                    p[2] = clamp_uint8(((coeff_cr_r * r + coeff_cr_g * g + coeff_cr_b * b + (1 << 15)) >> 16) + 128);
+                }
+            }
+        });
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::ConvertFromYCbCr()
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "ConvertFromYCbCr error: requires 24 or 32 bit image" << std::endl;
+        return;
+    }
+
+    ParallelBands(m_height, color_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const row{&m_data[index(0, y)]};
+                LONG x{0};
+#if defined(__SSE2__)
+                x = from_ycbcr_row_sse2(row, m_width, bytes_per_pixel);
+#endif
+                for(; x < m_width; ++ x)
+                {
+                    uint8_t * const p{row + x * bytes_per_pixel};
+                    const int32_t luma{p[0] << 16};
+                    const int32_t cb{p[1] - 128};
+                    const int32_t cr{p[2] - 128};
+                    p[0] = clamp_uint8((luma + coeff_b_cb * cb + (1 << 15)) >> 16);
+                    p[1] = clamp_uint8((luma + coeff_g_cb * cb + coeff_g_cr * cr + (1 << 15)) >> 16);
+                    p[2] = clamp_uint8((luma + coeff_r_cr * cr + (1 << 15)) >> 16);
+                }
+            }
+        });
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::ConvertToHSV()
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "ConvertToHSV error: requires 24 or 32 bit image" << std::endl;
+        return;
+    }
+
+    ParallelBands(m_height, color_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const row{&m_data[index(0, y)]};
+                for(LONG x{0}; x < m_width; ++ x)
+                {
+                    uint8_t * const p{row + x * bytes_per_pixel};
+                    const int32_t b{p[0]};
+                    const int32_t g{p[1]};
+                    const int32_t r{p[2]};
+                    const int32_t max{std::max(r, std::max(g, b))};
+                    const int32_t min{std::min(r, std::min(g, b))};
+                    const int32_t delta{max - min};
+
+                    // hue in units of 1 / 1536 of a turn (256 per sector)
+                    int32_t hue{0};
+                    if(delta != 0)
+                    {
+                        if(max == r) hue = (256 * (g - b)) / delta;
+                        else if(max == g) hue = 512 + (256 * (b - r)) / delta;
+                        else hue = 1024 + (256 * (r - g)) / delta;
+                        if(hue < 0) hue += 1536;
+                    }
+
+                    p[0] = (uint8_t)(((hue + 3) / 6) & 0xFF);
+                    p[1] = (max == 0) ? 0 : clamp_uint8((255 * delta + max / 2) / max);
+                    p[2] = (uint8_t)max;
+                }
+            }
+        });
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::ConvertFromHSV()
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "ConvertFromHSV error: requires 24 or 32 bit image" << std::endl;
+        return;
+    }
+
+    ParallelBands(m_height, color_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                uint8_t * const row{&m_data[index(0, y)]};
+                for(LONG x{0}; x < m_width; ++ x)
+                {
+                    uint8_t * const p{row + x * bytes_per_pixel};
+                    const int32_t hue{p[0] * 6}; // 256 per sector
+                    const int32_t s{p[1]};
+                    const int32_t v{p[2]};
+                    const int32_t sector{hue >> 8};
+                    const int32_t f{hue & 0xFF};
+                    const uint8_t lo{div255(v * (255 - s))};
+                    const uint8_t fall{div255(v * (255 - div255(s * f)))};
+                    const uint8_t rise{div255(v * (255 - div255(s * (255 - f))))};
+
+                    uint8_t r{0};
+                    uint8_t g{0};
+                    uint8_t b{0};
+                    switch(sector)
+                    {
+                        case 0: r = v; g = rise; b = lo; break;
+                        case 1: r = fall; g = v; b = lo; break;
+                        case 2: r = lo; g = v; b = rise; break;
+                        case 3: r = lo; g = fall; b = v; break;
+                        case 4: r = rise; g = lo; b = v; break;
+                        default: r = v; g = lo; b = fall; break;
+                    }
+                    p[0] = b;
+                    p[1] = g;
+                    p[2] = r;
+                }
+            }
+        });
+    mark_dirty_all();
+}
+
+
+BMP::BITMAP BMP::BITMAP::Grayscale() const
+{
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel == 1)
+    {
+        return *this;
+    }
+
+    BITMAP gray(m_width, m_height, 8);
+    if(bytes_per_pixel < 3)
+    {
+        std::cerr << "Grayscale error: requires 24 or 32 bit image" << std::endl;
+        return gray;
+    }
+
+    ParallelBands(m_height, color_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                const uint8_t * const row{&m_data[index(0, y)]};
+                uint8_t * const output{&gray.m_data[gray.index(0, y)]};
+                LONG x{0};
+#if defined(__SSE2__)
+                x = luma_row_sse2(row, output, m_width, bytes_per_pixel);
+#endif
+                for(; x < m_width; ++ x)
+                {
+                    const uint8_t * const p{row + x * bytes_per_pixel};
+                    output[x] = (uint8_t)((coeff_y_b * p[0] + coeff_y_g * p[1] + coeff_y_r * p[2] + (1 << 15)) >> 16);
+                }
+            }
+        });
+
+    return gray;
+}
@@ -0,0 +1,412 @@
+#include "bitmap.hpp"
+#include "integralimage.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+#include <cmath>
+
+// C++ headers
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG compare_min_band{256};
+
+// number of window rows covered by each block of integral images in SSIM,
+// and the minimum number of them evaluated by each thread
+static const BMP::LONG ssim_block_rows{256};
+static const BMP::LONG ssim_min_band{16};
+
+
+// compare count bytes, 64 bytes (one cache line) at a time
+// returns at the first block which differs
+static bool bytes_equal(const uint8_t * const l, const uint8_t * const r, const BMP::LONG count)
+{
+    BMP::LONG i{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    for(; i + 64 <= count; i += 64)
+    {
+        const __m128i x0{_mm_xor_si128(_mm_loadu_si128((const __m128i*)(l + i + 0)), _mm_loadu_si128((const __m128i*)(r + i + 0)))};
+        const __m128i x1{_mm_xor_si128(_mm_loadu_si128((const __m128i*)(l + i + 16)), _mm_loadu_si128((const __m128i*)(r + i + 16)))};
+        const __m128i x2{_mm_xor_si128(_mm_loadu_si128((const __m128i*)(l + i + 32)), _mm_loadu_si128((const __m128i*)(r + i + 32)))};
+        const __m128i x3{_mm_xor_si128(_mm_loadu_si128((const __m128i*)(l + i + 48)), _mm_loadu_si128((const __m128i*)(r + i + 48)))};
+        const __m128i x{_mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3))};
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+#endif
+
+    return memcmp(l + i, r + i, count - i) == 0;
+}
+
+
+// sum of squared differences of count bytes
+static uint64_t bytes_ssd(const uint8_t * const l, const uint8_t * const r, const BMP::LONG count)
+{
+    uint64_t sum{0};
+    BMP::LONG i{0};
+
+#if defined(__SSE2__)
+    // each iteration adds at most 4 * 255 * 255 to each 32 bit lane, so
+    // lanes are flushed to the 64 bit sum every 2048 iterations
+    const __m128i zero{_mm_setzero_si128()};
+    while(i + 16 <= count)
+    {
+        __m128i acc{_mm_setzero_si128()};
+        for(BMP::LONG n{0}; n < 2048 && i + 16 <= count; ++ n, i += 16)
+        {
+            const __m128i vl{_mm_loadu_si128((const __m128i*)(l + i))};
+            const __m128i vr{_mm_loadu_si128((const __m128i*)(r + i))};
+            const __m128i d_lo{_mm_sub_epi16(_mm_unpacklo_epi8(vl, zero), _mm_unpacklo_epi8(vr, zero))};
+            const __m128i d_hi{_mm_sub_epi16(_mm_unpackhi_epi8(vl, zero), _mm_unpackhi_epi8(vr, zero))};
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(d_lo, d_lo));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(d_hi, d_hi));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        const int32_t d{(int32_t)l[i] - (int32_t)r[i]};
+        sum += d * d;
+    }
+    return sum;
+}
+
+
+// largest absolute difference of count bytes
+static uint8_t bytes_max_abs_diff(const uint8_t * const l, const uint8_t * const r, const BMP::LONG count)
+{
+    uint8_t max{0};
+    BMP::LONG i{0};
+
+#if defined(__SSE2__)
+    __m128i vmax{_mm_setzero_si128()};
+    for(; i + 16 <= count; i += 16)
+    {
+        const __m128i vl{_mm_loadu_si128((const __m128i*)(l + i))};
+        const __m128i vr{_mm_loadu_si128((const __m128i*)(r + i))};
+        const __m128i diff{_mm_or_si128(_mm_subs_epu8(vl, vr), _mm_subs_epu8(vr, vl))};
+        vmax = _mm_max_epu8(vmax, diff);
+    }
+    uint8_t lanes[16];
+    _mm_storeu_si128((__m128i*)lanes, vmax);
+    for(int c{0}; c < 16; ++ c)
+    {
+        if(lanes[c] > max) max = lanes[c];
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        const uint8_t d{(l[i] > r[i]) ? (uint8_t)(l[i] - r[i]) : (uint8_t)(r[i] - l[i])};
+        if(d > max) max = d;
+    }
+    return max;
+}
+
+
+bool BMP::BITMAP::same_format(const BITMAP& bitmap) const
+{
+    return m_width == bitmap.m_width && m_height == bitmap.m_height && m_bit_count == bitmap.m_bit_count;
+}
+
+
+bool BMP::BITMAP::Equals(const BITMAP& bitmap) const
+{
+    if(!same_format(bitmap))
+    {
+        return false;
+    }
+
+    if(m_width_pad == 0)
+    {
+        // no padding, compare the whole image as one block
+        return bytes_equal(m_data.data(), bitmap.m_data.data(), m_data.size());
+    }
+
+    const LONG row_bytes{m_width_memory - m_width_pad};
+    for(LONG y{0}; y < m_height; ++ y)
+    {
+        if(!bytes_equal(&m_data[index(0, y)], &bitmap.m_data[bitmap.index(0, y)], row_bytes))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+uint8_t BMP::BITMAP::MaxAbsDiff(const BITMAP& bitmap) const
+{
+    if(!same_format(bitmap))
+    {
+        std::cerr << "Compare error: images differ in size or bit count" << std::endl;
+        return 0xFF;
+    }
+
+    const LONG row_bytes{m_width_memory - m_width_pad};
+    uint8_t max{0};
+    for(LONG y{0}; y < m_height && max < 0xFF; ++ y)
+    {
+        const uint8_t row_max{bytes_max_abs_diff(&m_data[index(0, y)], &bitmap.m_data[bitmap.index(0, y)], row_bytes)};
+        if(row_max > max) max = row_max;
+    }
+    return max;
+}
+
+
+uint64_t BMP::BITMAP::SumSquaredDifference(const BITMAP& bitmap) const
+{
+    if(!same_format(bitmap))
+    {
+        std::cerr << "Compare error: images differ in size or bit count" << std::endl;
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    const LONG row_bytes{m_width_memory - m_width_pad};
+    uint64_t sum{0};
+    std::mutex sum_mutex;
+    ParallelBands(m_height, compare_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            uint64_t band_sum{0};
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                band_sum += bytes_ssd(&m_data[index(0, y)], &bitmap.m_data[bitmap.index(0, y)], row_bytes);
+            }
+            std::lock_guard<std::mutex> lock(sum_mutex);
+            sum += band_sum;
+        });
+    return sum;
+}
+
+
+double BMP::BITMAP::MSE(const BITMAP& bitmap) const
+{
+    if(!same_format(bitmap))
+    {
+        std::cerr << "Compare error: images differ in size or bit count" << std::endl;
+        return std::numeric_limits<double>::infinity();
+    }
+
+    const LONG values{m_width * m_height * (m_bit_count / 8)};
+    if(values == 0)
+    {
+        return 0.0;
+    }
+    return (double)SumSquaredDifference(bitmap) / (double)values;
+}
+
+
+double BMP::BITMAP::PSNR(const BITMAP& bitmap) const
+{
+    const double mse{MSE(bitmap)};
+    if(mse == 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+
+// luma of width pixels of row as Grayscale
+static void luma_row(const uint8_t * const row, uint8_t * const gray, const BMP::LONG width, const BMP::LONG bytes_per_pixel)
+{
+    if(bytes_per_pixel == 1)
+    {
+        memcpy(gray, row, width);
+        return;
+    }
+    for(BMP::LONG x{0}; x < width; ++ x)
+    {
+        const uint8_t * const p{row + x * bytes_per_pixel};
+        gray[x] = (uint8_t)((7471 * p[0] + 38470 * p[1] + 19595 * p[2] + (1 << 15)) >> 16);
+    }
+}
+
+
+// output[x] = |l[x] - r[x]|
+static void abs_diff_row(const uint8_t * const l, const uint8_t * const r, uint8_t * const output, const BMP::LONG width)
+{
+    BMP::LONG x{0};
+#if defined(__SSE2__)
+    for(; x + 16 <= width; x += 16)
+    {
+        const __m128i vl{_mm_loadu_si128((const __m128i*)(l + x))};
+        const __m128i vr{_mm_loadu_si128((const __m128i*)(r + x))};
+        _mm_storeu_si128((__m128i*)(output + x), _mm_or_si128(_mm_subs_epu8(vl, vr), _mm_subs_epu8(vr, vl)));
+    }
+#endif
+    for(; x < width; ++ x)
+    {
+        output[x] = (l[x] > r[x]) ? l[x] - r[x] : r[x] - l[x];
+    }
+}
+
+
+double BMP::BITMAP::SSIM(const BITMAP& bitmap, const int window) const
+{
+    if(!same_format(bitmap))
+    {
+        std::cerr << "Compare error: images differ in size or bit count" << std::endl;
+        return 0.0;
+    }
+
+    LONG size{(window < 1) ? 1 : (LONG)window};
+    if(size > m_width) size = m_width;
+    if(size > m_height) size = m_height;
+    if(size == 0)
+    {
+        return 1.0;
+    }
+
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel != 1 && bytes_per_pixel != 3 && bytes_per_pixel != 4)
+    {
+        std::cerr << "SSIM error: requires 8, 24 or 32 bit image" << std::endl;
+        return 0.0;
+    }
+
+    const double c1{(0.01 * 255.0) * (0.01 * 255.0)};
+    const double c2{(0.03 * 255.0) * (0.03 * 255.0)};
+    const double n{(double)(size * size)};
+    const LONG positions_x{m_width - size + 1};
+    const LONG positions_y{m_height - size + 1};
+
+    // window sums come from integral images of the luma of both images and
+    // of their absolute difference, built for a block of rows at a time to
+    // bound memory use
+    // sums of x * y come from the squares of |x - y|, as
+    // 2 x y = x^2 + y^2 - (x - y)^2, which is exact in integers
+    double total{0.0};
+    std::mutex total_mutex;
+    for(LONG block{0}; block < positions_y; block += ssim_block_rows)
+    {
+        const LONG block_end{std::min(block + ssim_block_rows, positions_y)};
+        const LONG y_end{block_end + size - 1};
+        const IntegralImage integral_l(*this, -1, block, y_end);
+        const IntegralImage integral_r(bitmap, -1, block, y_end);
+
+        BITMAP gray_diff(m_width, y_end - block, 8);
+        ParallelBands(y_end - block, compare_min_band, [&](const uint64_t begin, const uint64_t end)
+            {
+                std::vector<uint8_t> row_l(m_width);
+                std::vector<uint8_t> row_r(m_width);
+                for(LONG y{begin}; y < end; ++ y)
+                {
+                    luma_row(&m_data[index(0, block + y)], row_l.data(), m_width, bytes_per_pixel);
+                    luma_row(&bitmap.m_data[bitmap.index(0, block + y)], row_r.data(), m_width, bytes_per_pixel);
+                    abs_diff_row(row_l.data(), row_r.data(), &gray_diff.m_data[gray_diff.index(0, y)], m_width);
+                }
+            });
+        const IntegralImage integral_diff(gray_diff);
+
+        ParallelBands(block_end - block, ssim_min_band, [&](const uint64_t begin, const uint64_t end)
+            {
+                double band_total{0.0};
+                for(LONG wy{begin}; wy < end; ++ wy)
+                {
+                    for(LONG wx{0}; wx < positions_x; ++ wx)
+                    {
+                        const Rect rect{(int)wx, (int)wy, (int)size, (int)size};
+                        const uint64_t sum_xx{integral_l.SumSq(rect)};
+                        const uint64_t sum_yy{integral_r.SumSq(rect)};
+                        const uint64_t sum_xy{(sum_xx + sum_yy - integral_diff.SumSq(rect)) / 2};
+                        const double mean_x{(double)integral_l.Sum(rect) / n};
+                        const double mean_y{(double)integral_r.Sum(rect) / n};
+                        const double var_x{(double)sum_xx / n - mean_x * mean_x};
+                        const double var_y{(double)sum_yy / n - mean_y * mean_y};
+                        const double cov{(double)sum_xy / n - mean_x * mean_y};
+                        band_total += ((2.0 * mean_x * mean_y + c1) * (2.0 * cov + c2)) /
+                                      ((mean_x * mean_x + mean_y * mean_y + c1) * (var_x + var_y + c2));
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(total_mutex);
+                total += band_total;
+            });
+    }
+
+    return total / (double)(positions_x * positions_y);
+}
+
+
+BMP::Rect BMP::BITMAP::DiffBoundingBox(const BITMAP& bitmap) const
+{
+    Rect rect{0, 0, 0, 0};
+    if(!same_format(bitmap))
+    {
+        std::cerr << "Compare error: images differ in size or bit count" << std::endl;
+        return rect;
+    }
+
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    const LONG row_bytes{m_width * bytes_per_pixel};
+
+    // first and last differing rows
+    LONG y_min{0};
+    while(y_min < m_height && bytes_equal(&m_data[index(0, y_min)], &bitmap.m_data[bitmap.index(0, y_min)], row_bytes))
+    {
+        ++ y_min;
+    }
+    if(y_min == m_height)
+    {
+        return rect;
+    }
+    LONG y_max{m_height - 1};
+    while(y_max > y_min && bytes_equal(&m_data[index(0, y_max)], &bitmap.m_data[bitmap.index(0, y_max)], row_bytes))
+    {
+        -- y_max;
+    }
+
+    // columns, each row only needs to be searched outside the current bounds
+    LONG x_min{m_width};
+    LONG x_max{0};
+    for(LONG y{y_min}; y <= y_max; ++ y)
+    {
+        const uint8_t * const row_l{&m_data[index(0, y)]};
+        const uint8_t * const row_r{&bitmap.m_data[bitmap.index(0, y)]};
+        for(LONG x{0}; x < x_min; ++ x)
+        {
+            if(memcmp(row_l + x * bytes_per_pixel, row_r + x * bytes_per_pixel, bytes_per_pixel) != 0)
+            {
+                x_min = x;
+                break;
+            }
+        }
+        for(LONG x{m_width}; x > x_max + 1; -- x)
+        {
+            if(memcmp(row_l + (x - 1) * bytes_per_pixel, row_r + (x - 1) * bytes_per_pixel, bytes_per_pixel) != 0)
+            {
+                x_max = x - 1;
+                break;
+            }
+        }
+    }
+    if(x_max < x_min)
+    {
+        x_max = x_min;
+    }
+
+    rect.x = x_min;
+    rect.y = y_min;
+    rect.width = x_max - x_min + 1;
+    rect.height = y_max - y_min + 1;
+    return rect;
+}
@@ -0,0 +1,469 @@
+#include "bitmap.hpp"
+
+
+// C headers
+#include <cstring>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// fixed point helpers
+////////////////////////////////////////////////////////////////////////////////
+
+// all arithmetic is done in 8.8 fixed point on 16 bit lanes
+// x / 255 is computed as (t + (t >> 8)) >> 8 with t = x + 128, which is
+// exact rounding for x <= 255 * 255
+// the scalar and SIMD versions round identically, so the SIMD loop and the
+// scalar tail produce the same result
+
+static inline int div255(const int x)
+{
+    const int t{x + 128};
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline int sat_add(const int l, const int r)
+{
+    return (l + r > 0xFFFF) ? 0xFFFF : l + r;
+}
+
+static inline int sat_sub(const int l, const int r)
+{
+    return (l > r) ? l - r : 0;
+}
+
+#if defined(__SSE2__)
+static inline __m128i div255_epu16(const __m128i x)
+{
+    const __m128i t{_mm_add_epi16(x, _mm_set1_epi16(128))};
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static inline __m128i mul255_epu16(const __m128i l, const __m128i r)
+{
+    return div255_epu16(_mm_mullo_epi16(l, r));
+}
+
+// copy the alpha lane of each of the two pixels in a vector to all 4 lanes
+static inline __m128i broadcast_alpha(const __m128i x)
+{
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// composite operators
+////////////////////////////////////////////////////////////////////////////////
+
+// every operator works on premultiplied values
+// s, d are the src and dst channel values, sa, da the src and dst alpha
+// the same formula applied to the alpha channel gives the correct output
+// alpha, so all 4 channels are processed identically
+
+// Porter-Duff: result = s * Fa + d * Fb
+enum class Factor
+{
+    ZERO,
+    ONE,
+    SA,
+    DA,
+    INV_SA,
+    INV_DA
+};
+
+template<Factor F>
+static inline int factor_scalar(const int x, const int sa, const int da)
+{
+    switch(F)
+    {
+        case Factor::ZERO: return 0;
+        case Factor::ONE: return x;
+        case Factor::SA: return div255(x * sa);
+        case Factor::DA: return div255(x * da);
+        case Factor::INV_SA: return div255(x * (255 - sa));
+        case Factor::INV_DA: return div255(x * (255 - da));
+    }
+    return 0;
+}
+
+#if defined(__SSE2__)
+template<Factor F>
+static inline __m128i factor_sse2(const __m128i x, const __m128i sa, const __m128i da)
+{
+    const __m128i v255{_mm_set1_epi16(255)};
+    switch(F)
+    {
+        case Factor::ZERO: return _mm_setzero_si128();
+        case Factor::ONE: return x;
+        case Factor::SA: return mul255_epu16(x, sa);
+        case Factor::DA: return mul255_epu16(x, da);
+        case Factor::INV_SA: return mul255_epu16(x, _mm_sub_epi16(v255, sa));
+        case Factor::INV_DA: return mul255_epu16(x, _mm_sub_epi16(v255, da));
+    }
+    return x;
+}
+#endif
+
+
+template<Factor FA, Factor FB>
+struct porter_duff
+{
+    static inline int scalar(const int s, const int d, const int sa, const int da, const int)
+    {
+        return sat_add(factor_scalar<FA>(s, sa, da), factor_scalar<FB>(d, sa, da));
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i sse2(const __m128i s, const __m128i d, const __m128i sa, const __m128i da, const __m128i)
+    {
+        return _mm_adds_epu16(factor_sse2<FA>(s, sa, da), factor_sse2<FB>(d, sa, da));
+    }
+#endif
+};
+
+
+template<BMP::CompositeMode MODE>
+struct composite_op;
+
+template<> struct composite_op<BMP::CompositeMode::CLEAR> : porter_duff<Factor::ZERO, Factor::ZERO> {};
+template<> struct composite_op<BMP::CompositeMode::SRC> : porter_duff<Factor::ONE, Factor::ZERO> {};
+template<> struct composite_op<BMP::CompositeMode::DST> : porter_duff<Factor::ZERO, Factor::ONE> {};
+template<> struct composite_op<BMP::CompositeMode::SRC_OVER> : porter_duff<Factor::ONE, Factor::INV_SA> {};
+template<> struct composite_op<BMP::CompositeMode::DST_OVER> : porter_duff<Factor::INV_DA, Factor::ONE> {};
+template<> struct composite_op<BMP::CompositeMode::SRC_IN> : porter_duff<Factor::DA, Factor::ZERO> {};
+template<> struct composite_op<BMP::CompositeMode::DST_IN> : porter_duff<Factor::ZERO, Factor::SA> {};
+template<> struct composite_op<BMP::CompositeMode::SRC_OUT> : porter_duff<Factor::INV_DA, Factor::ZERO> {};
+template<> struct composite_op<BMP::CompositeMode::DST_OUT> : porter_duff<Factor::ZERO, Factor::INV_SA> {};
+template<> struct composite_op<BMP::CompositeMode::SRC_ATOP> : porter_duff<Factor::DA, Factor::INV_SA> {};
+template<> struct composite_op<BMP::CompositeMode::DST_ATOP> : porter_duff<Factor::INV_DA, Factor::SA> {};
+template<> struct composite_op<BMP::CompositeMode::XOR> : porter_duff<Factor::INV_DA, Factor::INV_SA> {};
+
+
+// s * (1 - da) + d * (1 - sa) + s * d
+template<> struct composite_op<BMP::CompositeMode::MULTIPLY>
+{
+    static inline int scalar(const int s, const int d, const int sa, const int da, const int)
+    {
+        return sat_add(sat_add(div255(s * (255 - da)), div255(d * (255 - sa))), div255(s * d));
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i sse2(const __m128i s, const __m128i d, const __m128i sa, const __m128i da, const __m128i)
+    {
+        const __m128i v255{_mm_set1_epi16(255)};
+        const __m128i l{mul255_epu16(s, _mm_sub_epi16(v255, da))};
+        const __m128i r{mul255_epu16(d, _mm_sub_epi16(v255, sa))};
+        return _mm_adds_epu16(_mm_adds_epu16(l, r), mul255_epu16(s, d));
+    }
+#endif
+};
+
+
+// s + d - s * d
+template<> struct composite_op<BMP::CompositeMode::SCREEN>
+{
+    static inline int scalar(const int s, const int d, const int, const int, const int)
+    {
+        return sat_sub(s + d, div255(s * d));
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i sse2(const __m128i s, const __m128i d, const __m128i, const __m128i, const __m128i)
+    {
+        return _mm_subs_epu16(_mm_add_epi16(s, d), mul255_epu16(s, d));
+    }
+#endif
+};
+
+
+// s * (1 - da) + d * (1 - sa) + (2 * d <= da ? 2 * s * d : sa * da - 2 * (da - d) * (sa - s))
+template<> struct composite_op<BMP::CompositeMode::OVERLAY>
+{
+    static inline int scalar(const int s, const int d, const int sa, const int da, const int)
+    {
+        const int base{sat_add(div255(s * (255 - da)), div255(d * (255 - sa)))};
+        int select;
+        if(2 * d <= da)
+        {
+            select = 2 * div255(s * d);
+        }
+        else
+        {
+            select = sat_sub(div255(sa * da), 2 * div255(sat_sub(da, d) * sat_sub(sa, s)));
+        }
+        return sat_add(base, select);
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i sse2(const __m128i s, const __m128i d, const __m128i sa, const __m128i da, const __m128i)
+    {
+        const __m128i v255{_mm_set1_epi16(255)};
+        const __m128i base{_mm_adds_epu16(mul255_epu16(s, _mm_sub_epi16(v255, da)), mul255_epu16(d, _mm_sub_epi16(v255, sa)))};
+        const __m128i low{_mm_slli_epi16(mul255_epu16(s, d), 1)};
+        const __m128i high{_mm_subs_epu16(mul255_epu16(sa, da), _mm_slli_epi16(mul255_epu16(_mm_subs_epu16(da, d), _mm_subs_epu16(sa, s)), 1))};
+        // lanes are <= 510 so a signed compare is safe
+        const __m128i mask{_mm_cmpgt_epi16(_mm_slli_epi16(d, 1), da)};
+        const __m128i select{_mm_or_si128(_mm_and_si128(mask, high), _mm_andnot_si128(mask, low))};
+        return _mm_adds_epu16(base, select);
+    }
+#endif
+};
+
+
+// s + d
+template<> struct composite_op<BMP::CompositeMode::ADD>
+{
+    static inline int scalar(const int s, const int d, const int, const int, const int)
+    {
+        return s + d;
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i sse2(const __m128i s, const __m128i d, const __m128i, const __m128i, const __m128i)
+    {
+        return _mm_add_epi16(s, d);
+    }
+#endif
+};
+
+
+// d + (s - d) * opacity
+// opacity is not applied to src beforehand for this mode
+template<> struct composite_op<BMP::CompositeMode::LERP>
+{
+    static inline int scalar(const int s, const int d, const int, const int, const int opacity)
+    {
+        return div255(s * opacity + d * (255 - opacity));
+    }
+
+#if defined(__SSE2__)
+    static inline __m128i sse2(const __m128i s, const __m128i d, const __m128i, const __m128i, const __m128i opacity)
+    {
+        const __m128i inv{_mm_sub_epi16(_mm_set1_epi16(255), opacity)};
+        return div255_epu16(_mm_add_epi16(_mm_mullo_epi16(s, opacity), _mm_mullo_epi16(d, inv)));
+    }
+#endif
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// row kernels
+////////////////////////////////////////////////////////////////////////////////
+
+// premultiplied row, 4 pixels per iteration
+template<BMP::CompositeMode MODE>
+static void composite_row(uint8_t * const output, const uint8_t * const dst, const uint8_t * const src, const BMP::LONG count, const int opacity)
+{
+    // global opacity scales all channels of src, except for LERP where it
+    // is the interpolation weight
+    const bool scale_src{MODE != BMP::CompositeMode::LERP && opacity != 0xFF};
+
+    BMP::LONG i{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    const __m128i vopacity{_mm_set1_epi16(opacity)};
+    for(; i + 4 <= count; i += 4)
+    {
+        const __m128i s{_mm_loadu_si128((const __m128i*)(src + 4 * i))};
+        const __m128i d{_mm_loadu_si128((const __m128i*)(dst + 4 * i))};
+        __m128i s_lo{_mm_unpacklo_epi8(s, zero)};
+        __m128i s_hi{_mm_unpackhi_epi8(s, zero)};
+        const __m128i d_lo{_mm_unpacklo_epi8(d, zero)};
+        const __m128i d_hi{_mm_unpackhi_epi8(d, zero)};
+        if(scale_src)
+        {
+            s_lo = mul255_epu16(s_lo, vopacity);
+            s_hi = mul255_epu16(s_hi, vopacity);
+        }
+        const __m128i r_lo{composite_op<MODE>::sse2(s_lo, d_lo, broadcast_alpha(s_lo), broadcast_alpha(d_lo), vopacity)};
+        const __m128i r_hi{composite_op<MODE>::sse2(s_hi, d_hi, broadcast_alpha(s_hi), broadcast_alpha(d_hi), vopacity)};
+        _mm_storeu_si128((__m128i*)(output + 4 * i), _mm_packus_epi16(r_lo, r_hi));
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        int s[4];
+        for(int c{0}; c < 4; ++ c)
+        {
+            s[c] = scale_src ? div255(src[4 * i + c] * opacity) : src[4 * i + c];
+        }
+        const int da{dst[4 * i + 3]};
+        for(int c{0}; c < 4; ++ c)
+        {
+            const int v{composite_op<MODE>::scalar(s[c], dst[4 * i + c], s[3], da, opacity)};
+            output[4 * i + c] = (v > 0xFF) ? 0xFF : v;
+        }
+    }
+}
+
+
+static void composite_row(const BMP::CompositeMode mode, uint8_t * const output, const uint8_t * const dst, const uint8_t * const src, const BMP::LONG count, const int opacity)
+{
+    switch(mode)
+    {
+        case BMP::CompositeMode::CLEAR: composite_row<BMP::CompositeMode::CLEAR>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::SRC: composite_row<BMP::CompositeMode::SRC>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::DST: composite_row<BMP::CompositeMode::DST>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::SRC_OVER: composite_row<BMP::CompositeMode::SRC_OVER>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::DST_OVER: composite_row<BMP::CompositeMode::DST_OVER>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::SRC_IN: composite_row<BMP::CompositeMode::SRC_IN>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::DST_IN: composite_row<BMP::CompositeMode::DST_IN>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::SRC_OUT: composite_row<BMP::CompositeMode::SRC_OUT>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::DST_OUT: composite_row<BMP::CompositeMode::DST_OUT>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::SRC_ATOP: composite_row<BMP::CompositeMode::SRC_ATOP>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::DST_ATOP: composite_row<BMP::CompositeMode::DST_ATOP>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::XOR: composite_row<BMP::CompositeMode::XOR>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::MULTIPLY: composite_row<BMP::CompositeMode::MULTIPLY>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::SCREEN: composite_row<BMP::CompositeMode::SCREEN>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::OVERLAY: composite_row<BMP::CompositeMode::OVERLAY>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::ADD: composite_row<BMP::CompositeMode::ADD>(output, dst, src, count, opacity); break;
+        case BMP::CompositeMode::LERP: composite_row<BMP::CompositeMode::LERP>(output, dst, src, count, opacity); break;
+    }
+}
+
+
+// straight <-> premultiplied alpha conversion of count pixels
+
+static void premultiply_row(uint8_t * const output, const uint8_t * const input, const BMP::LONG count)
+{
+    for(BMP::LONG i{0}; i < count; ++ i)
+    {
+        const int a{input[4 * i + 3]};
+        output[4 * i + 0] = div255(input[4 * i + 0] * a);
+        output[4 * i + 1] = div255(input[4 * i + 1] * a);
+        output[4 * i + 2] = div255(input[4 * i + 2] * a);
+        output[4 * i + 3] = a;
+    }
+}
+
+
+static void unpremultiply_row(uint8_t * const output, const uint8_t * const input, const BMP::LONG count)
+{
+    // reciprocal table, c * 255 / a in 16.16 fixed point
+    static const std::vector<uint32_t> reciprocal{[]()
+        {
+            std::vector<uint32_t> table(256, 0);
+            for(uint32_t a{1}; a < 256; ++ a)
+            {
+                table[a] = ((255 << 16) + a / 2) / a;
+            }
+            return table;
+        }()};
+
+    for(BMP::LONG i{0}; i < count; ++ i)
+    {
+        const uint32_t a{input[4 * i + 3]};
+        const uint32_t r{reciprocal[a]};
+        for(int c{0}; c < 3; ++ c)
+        {
+            const uint32_t v{(input[4 * i + c] * r + (1 << 15)) >> 16};
+            output[4 * i + c] = (v > 0xFF) ? 0xFF : v;
+        }
+        output[4 * i + 3] = a;
+    }
+}
+
+
+void BMP::FunctorComposite::row(uint8_t * const output, const uint8_t * const dst, const uint8_t * const src, const LONG count) const
+{
+    if(premultiplied)
+    {
+        composite_row(mode, output, dst, src, count, opacity);
+    }
+    else
+    {
+        // convert chunks of the row to premultiplied alpha in buffers which
+        // stay in L1 cache, composite, then convert back
+        const LONG chunk{256};
+        uint8_t buffer_dst[4 * chunk];
+        uint8_t buffer_src[4 * chunk];
+        for(LONG i{0}; i < count; i += chunk)
+        {
+            const LONG n{(count - i < chunk) ? count - i : chunk};
+            premultiply_row(buffer_dst, dst + 4 * i, n);
+            premultiply_row(buffer_src, src + 4 * i, n);
+            composite_row(mode, buffer_dst, buffer_dst, buffer_src, n, opacity);
+            unpremultiply_row(output + 4 * i, buffer_dst, n);
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BITMAP compositing
+////////////////////////////////////////////////////////////////////////////////
+
+void BMP::BITMAP::OperatorCompositeBinary(const BITMAP& bitmap_l, const BITMAP& bitmap_r, FunctorComposite kernel)
+{
+    if(m_bit_count != 32 || bitmap_l.m_bit_count != 32 || bitmap_r.m_bit_count != 32)
+    {
+        std::cerr << "Composite error: compositing requires 32 bit images" << std::endl;
+        return;
+    }
+
+    // iterate over output
+    LONG y_max{m_height};
+    if(y_max >= bitmap_l.m_height) y_max = bitmap_l.m_height;
+    if(y_max >= bitmap_r.m_height) y_max = bitmap_r.m_height;
+    LONG x_max{m_width};
+    if(x_max >= bitmap_l.m_width) x_max = bitmap_l.m_width;
+    if(x_max >= bitmap_r.m_width) x_max = bitmap_r.m_width;
+    for(LONG y{0}; y < y_max; ++ y)
+    {
+        kernel.row(&m_data[index(0, y)], &bitmap_l.m_data[bitmap_l.index(0, y)], &bitmap_r.m_data[bitmap_r.index(0, y)], x_max);
+    }
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::OperatorCompositeUnary(const BITMAP& bitmap, FunctorComposite kernel)
+{
+    OperatorCompositeBinary(*this, bitmap, kernel);
+}
+
+
+void BMP::BITMAP::Composite(const BITMAP& bitmap, const CompositeMode mode, const uint8_t opacity, const bool premultiplied)
+{
+    OperatorCompositeUnary(bitmap, FunctorComposite(mode, opacity, premultiplied));
+}
+
+
+void BMP::BITMAP::Premultiply()
+{
+    if(m_bit_count != 32)
+    {
+        std::cerr << "Premultiply error: requires 32 bit image" << std::endl;
+        return;
+    }
+
+    for(LONG y{0}; y < m_height; ++ y)
+    {
+        uint8_t* const row{&m_data[index(0, y)]};
+        premultiply_row(row, row, m_width);
+    }
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::Unpremultiply()
+{
+    if(m_bit_count != 32)
+    {
+        std::cerr << "Unpremultiply error: requires 32 bit image" << std::endl;
+        return;
+    }
+
+    for(LONG y{0}; y < m_height; ++ y)
+    {
+        uint8_t* const row{&m_data[index(0, y)]};
+        unpremultiply_row(row, row, m_width);
+    }
+    mark_dirty_all();
+}
@@ -0,0 +1,542 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+#include <cmath>
+
+// C++ headers
+#include <algorithm>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG convolve_min_band{64};
+
+
+int64_t BMP::BITMAP::edge_index(int64_t i, const int64_t n, const EdgeMode edge)
+{
+    if(i >= 0 && i < n)
+    {
+        return i;
+    }
+
+    switch(edge)
+    {
+        case BMP::EdgeMode::CLAMP:
+            return (i < 0) ? 0 : n - 1;
+
+        case BMP::EdgeMode::MIRROR:
+            if(n == 1) return 0;
+            {
+                const int64_t period{2 * n - 2};
+                i %= period;
+                if(i < 0) i += period;
+                return (i < n) ? i : period - i;
+            }
+
+        case BMP::EdgeMode::WRAP:
+            i %= n;
+            if(i < 0) i += n;
+            return i;
+
+        case BMP::EdgeMode::ZERO:
+            return -1;
+    }
+
+    return -1;
+}
+
+
+void BMP::BITMAP::pad_row(uint8_t * const padded, const uint8_t * const row, const int64_t width, const int64_t bytes_per_pixel, const int64_t radius, const EdgeMode edge)
+{
+    memcpy(padded + radius * bytes_per_pixel, row, width * bytes_per_pixel);
+    for(int64_t x{-radius}; x < 0; ++ x)
+    {
+        const int64_t x_in{edge_index(x, width, edge)};
+        uint8_t * const p{padded + (x + radius) * bytes_per_pixel};
+        if(x_in < 0) memset(p, 0x00, bytes_per_pixel);
+        else memcpy(p, row + x_in * bytes_per_pixel, bytes_per_pixel);
+    }
+    for(int64_t x{width}; x < width + radius; ++ x)
+    {
+        const int64_t x_in{edge_index(x, width, edge)};
+        uint8_t * const p{padded + (x + radius) * bytes_per_pixel};
+        if(x_in < 0) memset(p, 0x00, bytes_per_pixel);
+        else memcpy(p, row + x_in * bytes_per_pixel, bytes_per_pixel);
+    }
+}
+
+
+// convert kernel weights to 4.12 fixed point
+// rounding error is added to the centre weight so that the fixed point
+// kernel sums to the same value as the floating point one
+static std::vector<int32_t> fixed_kernel(const std::vector<float>& kernel)
+{
+    std::vector<int32_t> fixed(kernel.size());
+    double sum{0.0};
+    int32_t fixed_sum{0};
+    for(size_t k{0}; k < kernel.size(); ++ k)
+    {
+        fixed[k] = (int32_t)std::lround(kernel[k] * 4096.0);
+        sum += kernel[k];
+        fixed_sum += fixed[k];
+    }
+    fixed[kernel.size() / 2] += (int32_t)std::lround(sum * 4096.0) - fixed_sum;
+    return fixed;
+}
+
+
+// x / n rounded, for x <= 255 * n, using a 32.32 fixed point reciprocal
+static inline uint8_t scale_box(const uint64_t sum, const uint64_t reciprocal)
+{
+    return (uint8_t)((sum * reciprocal + ((uint64_t)1 << 31)) >> 32);
+}
+
+static inline uint64_t box_reciprocal(const uint64_t n)
+{
+    return (((uint64_t)1 << 32) + n / 2) / n;
+}
+
+
+// acc[i] += w0 * input0[i] + w1 * input1[i], the weights fit in 16 bits
+// SSE2 interleaves the two taps and multiplies-adds them in one go
+template<typename T>
+static void multiply_add_taps(int32_t * const acc, const T * const input0, const T * const input1,
+    const int32_t w0, const int32_t w1, const int64_t count)
+{
+    int64_t i{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    const __m128i weights{_mm_set1_epi32((int32_t)(((uint32_t)w1 << 16) | ((uint32_t)w0 & 0xFFFF)))};
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i a;
+        __m128i b;
+        if(sizeof(T) == 1)
+        {
+            a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(input0 + i)), zero);
+            b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(input1 + i)), zero);
+        }
+        else
+        {
+            a = _mm_loadu_si128((const __m128i*)(input0 + i));
+            b = _mm_loadu_si128((const __m128i*)(input1 + i));
+        }
+        const __m128i lo{_mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights)};
+        const __m128i hi{_mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights)};
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i)), lo));
+        _mm_storeu_si128((__m128i*)(acc + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i + 4)), hi));
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        acc[i] += w0 * input0[i] + w1 * input1[i];
+    }
+}
+
+
+// true when every weight fits in the 16 bit lanes of multiply_add_taps
+static bool taps_fit_16(const std::vector<int32_t>& weight)
+{
+    for(const int32_t w : weight)
+    {
+        if(w < -32768 || w > 32767) return false;
+    }
+    return true;
+}
+
+
+// output[i] = (acc[i] + 2^7) >> 8 saturated to 16 bits, 12.4 fixed point
+static void narrow_to_12_4(const int32_t * const acc, int16_t * const output, const int64_t count)
+{
+    int64_t i{0};
+
+#if defined(__SSE2__)
+    const __m128i round{_mm_set1_epi32(1 << 7)};
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m128i lo{_mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i)), round), 8)};
+        const __m128i hi{_mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i + 4)), round), 8)};
+        _mm_storeu_si128((__m128i*)(output + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        const int32_t v{(acc[i] + (1 << 7)) >> 8};
+        output[i] = (int16_t)std::max(-32768, std::min(32767, v));
+    }
+}
+
+
+// output[i] = (acc[i] + 2^15) >> 16 saturated to 0..255
+static void narrow_to_8(const int32_t * const acc, uint8_t * const output, const int64_t count)
+{
+    int64_t i{0};
+
+#if defined(__SSE2__)
+    const __m128i round{_mm_set1_epi32(1 << 15)};
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m128i lo{_mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i)), round), 16)};
+        const __m128i hi{_mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i + 4)), round), 16)};
+        const __m128i v{_mm_packs_epi32(lo, hi)};
+        _mm_storel_epi64((__m128i*)(output + i), _mm_packus_epi16(v, v));
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        const int32_t v{(acc[i] + (1 << 15)) >> 16};
+        output[i] = (uint8_t)std::max(0, std::min(255, v));
+    }
+}
+
+
+// sum[i] += input[i], or -= when subtract
+static void accumulate_row(uint32_t * const sum, const uint8_t * const input, const int64_t count, const bool subtract)
+{
+    int64_t i{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m128i v{_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(input + i)), zero)};
+        const __m128i lo{_mm_unpacklo_epi16(v, zero)};
+        const __m128i hi{_mm_unpackhi_epi16(v, zero)};
+        const __m128i s_lo{_mm_loadu_si128((const __m128i*)(sum + i))};
+        const __m128i s_hi{_mm_loadu_si128((const __m128i*)(sum + i + 4))};
+        _mm_storeu_si128((__m128i*)(sum + i), subtract ? _mm_sub_epi32(s_lo, lo) : _mm_add_epi32(s_lo, lo));
+        _mm_storeu_si128((__m128i*)(sum + i + 4), subtract ? _mm_sub_epi32(s_hi, hi) : _mm_add_epi32(s_hi, hi));
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        if(subtract) sum[i] -= input[i];
+        else sum[i] += input[i];
+    }
+}
+
+
+// output[i] = scale_box(sum[i], reciprocal), reciprocal must fit in 32 bits
+// SSE2 forms the 64 bit products of the even and odd lanes separately
+static void scale_box_row(const uint32_t * const sum, uint8_t * const output, const int64_t count, const uint64_t reciprocal)
+{
+    int64_t i{0};
+
+#if defined(__SSE2__)
+    const __m128i r{_mm_set1_epi32((int32_t)(uint32_t)reciprocal)};
+    const __m128i round{_mm_set1_epi64x((int64_t)1 << 31)};
+    auto scale = [&](const __m128i s)
+        {
+            const __m128i even{_mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(s, r), round), 32)};
+            const __m128i odd{_mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(s, 32), r), round), 32)};
+            return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+        };
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m128i lo{scale(_mm_loadu_si128((const __m128i*)(sum + i)))};
+        const __m128i hi{scale(_mm_loadu_si128((const __m128i*)(sum + i + 4)))};
+        const __m128i v{_mm_packs_epi32(lo, hi)};
+        _mm_storel_epi64((__m128i*)(output + i), _mm_packus_epi16(v, v));
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        output[i] = scale_box(sum[i], reciprocal);
+    }
+}
+
+
+void BMP::BITMAP::ConvolveSeparable(const std::vector<float>& kernel_x, const std::vector<float>& kernel_y, const EdgeMode edge)
+{
+    if(kernel_x.size() % 2 == 0 || kernel_y.size() % 2 == 0)
+    {
+        std::cerr << "Convolve error: kernel length must be odd" << std::endl;
+        return;
+    }
+
+    const int64_t bytes_per_pixel{m_bit_count / 8};
+    if(bytes_per_pixel == 0 || m_width == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+    const int64_t row_bytes{width * bytes_per_pixel};
+    const std::vector<int32_t> weight_x{fixed_kernel(kernel_x)};
+    const std::vector<int32_t> weight_y{fixed_kernel(kernel_y)};
+    const int64_t radius_x{(int64_t)kernel_x.size() / 2};
+    const int64_t radius_y{(int64_t)kernel_y.size() / 2};
+    const bool fit_x{taps_fit_16(weight_x)};
+    const bool fit_y{taps_fit_16(weight_y)};
+
+    // horizontal pass, output is 12.4 fixed point
+    // the neighbouring pixel of every channel byte is bytes_per_pixel bytes
+    // away, so each tap is a multiply-add over the whole contiguous row
+    std::vector<int16_t> temp(row_bytes * height);
+    ParallelBands(height, convolve_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            std::vector<uint8_t> padded((width + 2 * radius_x) * bytes_per_pixel);
+            std::vector<int32_t> acc(row_bytes);
+            for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+            {
+                pad_row(padded.data(), &m_data[index(0, y)], width, bytes_per_pixel, radius_x, edge);
+                std::fill(acc.begin(), acc.end(), 0);
+                if(fit_x)
+                {
+                    // taps in pairs, the odd one out paired with a zero weight
+                    for(int64_t k{0}; k <= 2 * radius_x; k += 2)
+                    {
+                        const uint8_t * const input{padded.data() + k * bytes_per_pixel};
+                        const bool pair{k + 1 <= 2 * radius_x};
+                        multiply_add_taps(acc.data(), input, pair ? input + bytes_per_pixel : input,
+                            weight_x[k], pair ? weight_x[k + 1] : 0, row_bytes);
+                    }
+                }
+                else
+                {
+                    for(int64_t k{0}; k <= 2 * radius_x; ++ k)
+                    {
+                        const int32_t w{weight_x[k]};
+                        if(w == 0) continue;
+                        const uint8_t * const input{padded.data() + k * bytes_per_pixel};
+                        for(int64_t i{0}; i < row_bytes; ++ i)
+                        {
+                            acc[i] += w * input[i];
+                        }
+                    }
+                }
+                narrow_to_12_4(acc.data(), &temp[y * row_bytes], row_bytes);
+            }
+        });
+
+    // vertical pass, each tap is a multiply-add of a whole row
+    ParallelBands(height, convolve_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            std::vector<int32_t> acc(row_bytes);
+            for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+            {
+                std::fill(acc.begin(), acc.end(), 0);
+                if(fit_y)
+                {
+                    // rows in pairs, zero rows and the odd one out are
+                    // paired with a zero weight
+                    for(int64_t k{0}; k <= 2 * radius_y; k += 2)
+                    {
+                        const int64_t y_0{edge_index(y + k - radius_y, height, edge)};
+                        const int64_t y_1{(k + 1 <= 2 * radius_y) ? edge_index(y + k + 1 - radius_y, height, edge) : -1};
+                        if(y_0 < 0 && y_1 < 0) continue;
+                        const int16_t * const input0{&temp[((y_0 < 0) ? y_1 : y_0) * row_bytes]};
+                        const int16_t * const input1{&temp[((y_1 < 0) ? y_0 : y_1) * row_bytes]};
+                        multiply_add_taps(acc.data(), input0, input1,
+                            (y_0 < 0) ? 0 : weight_y[k], (y_1 < 0) ? 0 : weight_y[k + 1], row_bytes);
+                    }
+                }
+                else
+                {
+                    for(int64_t k{0}; k <= 2 * radius_y; ++ k)
+                    {
+                        const int32_t w{weight_y[k]};
+                        const int64_t y_in{edge_index(y + k - radius_y, height, edge)};
+                        if(w == 0 || y_in < 0) continue;
+                        const int16_t * const input{&temp[y_in * row_bytes]};
+                        for(int64_t i{0}; i < row_bytes; ++ i)
+                        {
+                            acc[i] += w * input[i];
+                        }
+                    }
+                }
+                narrow_to_8(acc.data(), &m_data[index(0, y)], row_bytes);
+            }
+        });
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::BoxBlur(const int radius_x, const int radius_y, const EdgeMode edge)
+{
+    if(radius_x < 0 || radius_y < 0)
+    {
+        std::cerr << "BoxBlur error: negative radius" << std::endl;
+        return;
+    }
+
+    const int64_t bytes_per_pixel{m_bit_count / 8};
+    if(bytes_per_pixel == 0 || m_width == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+    const int64_t row_bytes{width * bytes_per_pixel};
+
+    // horizontal pass, in place
+    // running sum per channel, one add and one subtract per pixel
+    if(radius_x > 0)
+    {
+        const int64_t n{2 * (int64_t)radius_x + 1};
+        const uint64_t reciprocal{box_reciprocal(n)};
+        ParallelBands(height, convolve_min_band, [&](const uint64_t begin, const uint64_t end)
+            {
+                std::vector<uint8_t> padded((width + 2 * radius_x) * bytes_per_pixel);
+                for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+                {
+                    uint8_t * const row{&m_data[index(0, y)]};
+                    pad_row(padded.data(), row, width, bytes_per_pixel, radius_x, edge);
+                    for(int64_t c{0}; c < bytes_per_pixel; ++ c)
+                    {
+                        uint64_t sum{0};
+                        for(int64_t k{0}; k < n; ++ k)
+                        {
+                            sum += padded[k * bytes_per_pixel + c];
+                        }
+                        for(int64_t x{0}; x < width; ++ x)
+                        {
+                            row[x * bytes_per_pixel + c] = scale_box(sum, reciprocal);
+                            if(x + 1 < width)
+                            {
+                                sum += padded[(x + n) * bytes_per_pixel + c];
+                                sum -= padded[x * bytes_per_pixel + c];
+                            }
+                        }
+                    }
+                }
+            });
+    }
+
+    // vertical pass
+    // running sum of whole rows, one row add and one row subtract per row
+    if(radius_y > 0)
+    {
+        const int64_t n{2 * (int64_t)radius_y + 1};
+        const uint64_t reciprocal{box_reciprocal(n)};
+        std::vector<uint8_t> output(m_data.size(), 0x00);
+        ParallelBands(height, convolve_min_band, [&](const uint64_t begin, const uint64_t end)
+            {
+                std::vector<uint32_t> sum(row_bytes, 0);
+                for(int64_t k{-(int64_t)radius_y}; k <= radius_y; ++ k)
+                {
+                    const int64_t y_in{edge_index((int64_t)begin + k, height, edge)};
+                    if(y_in < 0) continue;
+                    accumulate_row(sum.data(), &m_data[index(0, y_in)], row_bytes, false);
+                }
+
+                for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+                {
+                    scale_box_row(sum.data(), &output[index(0, y)], row_bytes, reciprocal);
+
+                    if(y + 1 < (int64_t)end)
+                    {
+                        const int64_t y_add{edge_index(y + radius_y + 1, height, edge)};
+                        const int64_t y_sub{edge_index(y - radius_y, height, edge)};
+                        if(y_add >= 0) accumulate_row(sum.data(), &m_data[index(0, y_add)], row_bytes, false);
+                        if(y_sub >= 0) accumulate_row(sum.data(), &m_data[index(0, y_sub)], row_bytes, true);
+                    }
+                }
+            });
+        m_data.swap(output);
+    }
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::GaussianBlur(const float sigma, const EdgeMode edge)
+{
+    if(sigma <= 0.0f)
+    {
+        return;
+    }
+
+    // widths of 3 box filters whose repeated application has standard
+    // deviation sigma (Kovesi, "Fast Almost-Gaussian Filtering")
+    const int passes{3};
+    const double ideal{std::sqrt(12.0 * sigma * sigma / passes + 1.0)};
+    int lower{(int)std::floor(ideal)};
+    if(lower % 2 == 0) -- lower;
+    const int upper{lower + 2};
+    const int lower_count{(int)std::lround((12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4.0))};
+
+    for(int pass{0}; pass < passes; ++ pass)
+    {
+        const int size{(pass < lower_count) ? lower : upper};
+        const int radius{(size - 1) / 2};
+        BoxBlur(radius, radius, edge);
+    }
+}
+
+
+void BMP::BITMAP::GaussianBlurKernel(const float sigma, const EdgeMode edge)
+{
+    if(sigma <= 0.0f)
+    {
+        return;
+    }
+
+    const int radius{(int)std::ceil(3.0f * sigma)};
+    std::vector<float> kernel(2 * radius + 1);
+    float sum{0.0f};
+    for(int k{-radius}; k <= radius; ++ k)
+    {
+        kernel[k + radius] = std::exp(-(float)(k * k) / (2.0f * sigma * sigma));
+        sum += kernel[k + radius];
+    }
+    for(float& w : kernel)
+    {
+        w /= sum;
+    }
+
+    ConvolveSeparable(kernel, kernel, edge);
+}
+
+
+void BMP::BITMAP::unsharp(const BITMAP& blurred, const float amount, const uint8_t threshold)
+{
+    // amount in 8.8 fixed point
+    const int32_t a{(int32_t)std::lround(amount * 256.0f)};
+    const LONG row_bytes{m_width * (m_bit_count / 8)};
+    for(LONG y{0}; y < m_height; ++ y)
+    {
+        uint8_t * const row{&m_data[index(0, y)]};
+        const uint8_t * const blur{&blurred.m_data[blurred.index(0, y)]};
+        for(LONG i{0}; i < row_bytes; ++ i)
+        {
+            const int32_t diff{(int32_t)row[i] - (int32_t)blur[i]};
+            if(std::abs(diff) >= threshold)
+            {
+                const int32_t v{row[i] + ((diff * a + 128) >> 8)};
+                row[i] = (uint8_t)std::max(0, std::min(255, v));
+            }
+        }
+    }
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::Sharpen(const float amount)
+{
+    BITMAP blurred(*this);
+    blurred.BoxBlur(1, 1);
+    unsharp(blurred, amount, 0);
+}
+
+
+void BMP::BITMAP::UnsharpMask(const float sigma, const float amount, const uint8_t threshold)
+{
+    BITMAP blurred(*this);
+    blurred.GaussianBlur(sigma);
+    unsharp(blurred, amount, threshold);
+}
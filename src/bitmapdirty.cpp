@@ -0,0 +1,197 @@
+#include "bitmap.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+// POSIX headers
+#include <fcntl.h>
+#include <unistd.h>
+
+
+static bool rect_contains(const BMP::Rect& outer, const BMP::Rect& inner)
+{
+    return inner.x >= outer.x && inner.y >= outer.y &&
+           inner.x + inner.width <= outer.x + outer.width &&
+           inner.y + inner.height <= outer.y + outer.height;
+}
+
+
+static BMP::Rect rect_union(const BMP::Rect& l, const BMP::Rect& r)
+{
+    const int x_min{std::min(l.x, r.x)};
+    const int y_min{std::min(l.y, r.y)};
+    const int x_max{std::max(l.x + l.width, r.x + r.width)};
+    const int y_max{std::max(l.y + l.height, r.y + r.height)};
+    return BMP::Rect{x_min, y_min, x_max - x_min, y_max - y_min};
+}
+
+
+static int64_t rect_area(const BMP::Rect& rect)
+{
+    return (int64_t)rect.width * rect.height;
+}
+
+
+void BMP::BITMAP::EnableDirtyTracking(const bool enable)
+{
+    m_dirty_tracking = enable;
+    if(!enable)
+    {
+        m_dirty.clear();
+    }
+}
+
+
+bool BMP::BITMAP::DirtyTracking() const
+{
+    return m_dirty_tracking;
+}
+
+
+const std::vector<BMP::Rect>& BMP::BITMAP::DirtyRegions() const
+{
+    return m_dirty;
+}
+
+
+void BMP::BITMAP::ResetDirty()
+{
+    m_dirty.clear();
+}
+
+
+void BMP::BITMAP::mark_dirty(const Rect& rect)
+{
+    if(!m_dirty_tracking)
+    {
+        return;
+    }
+
+    // clip to bitmap
+    const int64_t x_min{std::max((int64_t)rect.x, (int64_t)0)};
+    const int64_t y_min{std::max((int64_t)rect.y, (int64_t)0)};
+    const int64_t x_max{std::min((int64_t)rect.x + rect.width, (int64_t)m_width)};
+    const int64_t y_max{std::min((int64_t)rect.y + rect.height, (int64_t)m_height)};
+    if(x_min >= x_max || y_min >= y_max)
+    {
+        return;
+    }
+    const Rect clipped{(int)x_min, (int)y_min, (int)(x_max - x_min), (int)(y_max - y_min)};
+
+    for(const Rect& region : m_dirty)
+    {
+        if(rect_contains(region, clipped))
+        {
+            return;
+        }
+    }
+    m_dirty.erase(std::remove_if(m_dirty.begin(), m_dirty.end(),
+        [&clipped](const Rect& region)
+        {
+            return rect_contains(clipped, region);
+        }), m_dirty.end());
+    m_dirty.push_back(clipped);
+
+    // too many regions, repeatedly merge the pair whose bounding box adds
+    // the least area until half the limit remains
+    if(m_dirty.size() > m_dirty_limit)
+    {
+        while(m_dirty.size() > m_dirty_limit / 2)
+        {
+            size_t best_i{0};
+            size_t best_j{1};
+            int64_t best_cost{INT64_MAX};
+            for(size_t i{0}; i < m_dirty.size(); ++ i)
+            {
+                for(size_t j{i + 1}; j < m_dirty.size(); ++ j)
+                {
+                    const int64_t cost{rect_area(rect_union(m_dirty[i], m_dirty[j])) - rect_area(m_dirty[i]) - rect_area(m_dirty[j])};
+                    if(cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_i = i;
+                        best_j = j;
+                    }
+                }
+            }
+            m_dirty[best_i] = rect_union(m_dirty[best_i], m_dirty[best_j]);
+            m_dirty.erase(m_dirty.begin() + best_j);
+        }
+    }
+}
+
+
+void BMP::BITMAP::mark_dirty_all()
+{
+    if(!m_dirty_tracking)
+    {
+        return;
+    }
+
+    m_dirty.clear();
+    if(m_width > 0 && m_height > 0)
+    {
+        m_dirty.push_back(Rect{0, 0, (int)m_width, (int)m_height});
+    }
+}
+
+
+void BMP::BITMAP::SaveDirtyRows(const std::string& filename) const
+{
+    // without tracking nothing is known to be clean
+    if(!m_dirty_tracking)
+    {
+        SaveAsBitmap(filename);
+        return;
+    }
+
+    const BITMAPInfo info{Probe(filename)};
+    if(info.status != ProbeStatus::OK || info.width != m_width || info.height != m_height || info.bit_count != m_bit_count)
+    {
+        SaveAsBitmap(filename);
+        return;
+    }
+
+    std::vector<bool> rows(m_height, false);
+    for(const Rect& region : m_dirty)
+    {
+        for(int y{region.y}; y < region.y + region.height; ++ y)
+        {
+            rows[y] = true;
+        }
+    }
+
+    const int fd{::open(filename.c_str(), O_WRONLY)};
+    if(fd < 0)
+    {
+        std::cerr << "Unable to open output file " << filename << std::endl;
+        return;
+    }
+
+    // rows in the file are laid out as in m_data, so each run of dirty rows
+    // is one write
+    LONG y{0};
+    while(y < m_height)
+    {
+        if(!rows[y])
+        {
+            ++ y;
+            continue;
+        }
+        const LONG run_start{y};
+        while(y < m_height && rows[y])
+        {
+            ++ y;
+        }
+        const size_t count{(size_t)((y - run_start) * m_width_memory)};
+        const off_t offset{(off_t)(info.data_offset + run_start * m_width_memory)};
+        if(::pwrite(fd, &m_data[run_start * m_width_memory], count, offset) != (ssize_t)count)
+        {
+            std::cerr << "Save error: unable to write rows to " << filename << std::endl;
+            break;
+        }
+    }
+
+    ::close(fd);
+}
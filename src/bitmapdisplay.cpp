@@ -0,0 +1,62 @@
+#include "bitmapdisplay.hpp"
+
+
+BMP::BITMAPDisplay::BITMAPDisplay()
+{
+}
+
+
+bool BMP::BITMAPDisplay::Update(const BITMAP& bitmap)
+{
+    const unsigned int width{(unsigned int)bitmap.Width()};
+    const unsigned int height{(unsigned int)bitmap.Height()};
+
+    if(m_texture.getSize().x != width || m_texture.getSize().y != height)
+    {
+        if(!m_texture.create(width, height))
+        {
+            std::cerr << "Texture create failure: " << width << "x" << height << std::endl;
+            return false;
+        }
+        // the sprite keeps a pointer to the texture, but its rectangle
+        // must be reset for the new size
+        m_sprite.setTexture(m_texture, true);
+    }
+
+    m_staging.resize((size_t)width * height * 4);
+    bitmap.CopyToRGBA(m_staging.data());
+    m_texture.update(m_staging.data());
+    return true;
+}
+
+
+bool BMP::BITMAPDisplay::UpdateDirty(const BITMAP& bitmap)
+{
+    const unsigned int width{(unsigned int)bitmap.Width()};
+    const unsigned int height{(unsigned int)bitmap.Height()};
+    if(!bitmap.DirtyTracking() || m_texture.getSize().x != width || m_texture.getSize().y != height)
+    {
+        return Update(bitmap);
+    }
+
+    for(const Rect& region : bitmap.DirtyRegions())
+    {
+        m_staging.resize((size_t)region.width * region.height * 4);
+        bitmap.CopyToRGBA(m_staging.data(), region);
+        // the texture is top down
+        m_texture.update(m_staging.data(), region.width, region.height, region.x, height - region.y - region.height);
+    }
+    return true;
+}
+
+
+sf::Vector2u BMP::BITMAPDisplay::Size() const
+{
+    return m_texture.getSize();
+}
+
+
+void BMP::BITMAPDisplay::Draw(sf::RenderTarget& target) const
+{
+    target.draw(m_sprite);
+}
@@ -0,0 +1,213 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// C++ headers
+#include <algorithm>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG edges_min_band{64};
+
+
+// luma of width pixels of row as Grayscale
+static void luma_row(const uint8_t * const row, uint8_t * const gray, const int64_t width, const int64_t bytes_per_pixel)
+{
+    if(bytes_per_pixel == 1)
+    {
+        memcpy(gray, row, width);
+        return;
+    }
+    for(int64_t x{0}; x < width; ++ x)
+    {
+        const uint8_t * const p{row + x * bytes_per_pixel};
+        gray[x] = (uint8_t)((7471 * p[0] + 38470 * p[1] + 19595 * p[2] + (1 << 15)) >> 16);
+    }
+}
+
+
+// quantized direction of the gradient gx, gy
+// tan(22.5 degrees) ~ 106 / 256 and tan(67.5 degrees) ~ 618 / 256
+static uint8_t direction_bin(const int32_t gx, const int32_t gy)
+{
+    const int32_t ax{std::abs(gx)};
+    const int32_t ay{std::abs(gy)};
+    if(256 * ay - 106 * ax <= 0) return 0;
+    if(256 * ay - 618 * ax > 0) return 2;
+    return ((gx ^ gy) < 0) ? 3 : 1;
+}
+
+
+// magnitude and direction of one row from the luma rows below, at and
+// above it, which have one pixel of padding either side
+// gx = smooth(x + 1) - smooth(x - 1) with smooth = SIDE * (below + above)
+// + CENTRE * row, and gy likewise from the differences above - below
+template<int SIDE, int CENTRE>
+static void gradient_row(const uint8_t * const below, const uint8_t * const row, const uint8_t * const above,
+    uint8_t * const magnitude, uint8_t * const direction, const int64_t width)
+{
+    const float scale{1.0f / (2 * SIDE + CENTRE)};
+    int64_t x{0};
+
+#if defined(__SSE2__)
+    // 8 pixels per iteration in 16 bit lanes, |gx|, |gy| <= 16 * 255
+    const __m128i zero{_mm_setzero_si128()};
+    const __m128i side{_mm_set1_epi16(SIDE)};
+    const __m128i centre{_mm_set1_epi16(CENTRE)};
+    const __m128 scale_4{_mm_set1_ps(scale)};
+    const __m128i tan_22{_mm_set_epi16(-106, 256, -106, 256, -106, 256, -106, 256)};
+    const __m128i tan_67{_mm_set_epi16(-618, 256, -618, 256, -618, 256, -618, 256)};
+    const __m128i one_32{_mm_set1_epi32(1)};
+    const __m128i one{_mm_set1_epi16(1)};
+    const __m128i two{_mm_set1_epi16(2)};
+    auto load = [&](const uint8_t * const p)
+        {
+            return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), zero);
+        };
+    for(; x + 8 <= width; x += 8)
+    {
+        // pixel x is at x + 1 in the padded rows
+        __m128i smooth[3];
+        __m128i diff[3];
+        for(int i{0}; i < 3; ++ i)
+        {
+            const __m128i b{load(below + x + i)};
+            const __m128i a{load(above + x + i)};
+            smooth[i] = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(b, a), side), _mm_mullo_epi16(load(row + x + i), centre));
+            diff[i] = _mm_sub_epi16(a, b);
+        }
+        const __m128i gx{_mm_sub_epi16(smooth[2], smooth[0])};
+        const __m128i gy{_mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(diff[0], diff[2]), side), _mm_mullo_epi16(diff[1], centre))};
+
+        // gx^2 + gy^2 of interleaved pairs by multiply-add
+        const __m128i pairs_lo{_mm_unpacklo_epi16(gx, gy)};
+        const __m128i pairs_hi{_mm_unpackhi_epi16(gx, gy)};
+        const __m128 m_lo{_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(pairs_lo, pairs_lo))), scale_4)};
+        const __m128 m_hi{_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(pairs_hi, pairs_hi))), scale_4)};
+        const __m128i m{_mm_packs_epi32(_mm_cvtps_epi32(m_lo), _mm_cvtps_epi32(m_hi))};
+        _mm_storel_epi64((__m128i*)(magnitude + x), _mm_packus_epi16(m, m));
+
+        if(direction != nullptr)
+        {
+            // 256 |gy| - k |gx| of interleaved pairs by multiply-add
+            const __m128i ax{_mm_max_epi16(gx, _mm_sub_epi16(zero, gx))};
+            const __m128i ay{_mm_max_epi16(gy, _mm_sub_epi16(zero, gy))};
+            const __m128i abs_lo{_mm_unpacklo_epi16(ay, ax)};
+            const __m128i abs_hi{_mm_unpackhi_epi16(ay, ax)};
+            const __m128i horizontal{_mm_packs_epi32(_mm_cmplt_epi32(_mm_madd_epi16(abs_lo, tan_22), one_32),
+                                                     _mm_cmplt_epi32(_mm_madd_epi16(abs_hi, tan_22), one_32))};
+            const __m128i vertical{_mm_packs_epi32(_mm_cmpgt_epi32(_mm_madd_epi16(abs_lo, tan_67), zero),
+                                                   _mm_cmpgt_epi32(_mm_madd_epi16(abs_hi, tan_67), zero))};
+            const __m128i opposite{_mm_cmplt_epi16(_mm_xor_si128(gx, gy), zero)};
+            const __m128i diagonal{_mm_or_si128(_mm_and_si128(opposite, two), one)};
+            const __m128i bin{_mm_andnot_si128(horizontal, _mm_or_si128(_mm_and_si128(vertical, two), _mm_andnot_si128(vertical, diagonal)))};
+            _mm_storel_epi64((__m128i*)(direction + x), _mm_packus_epi16(bin, bin));
+        }
+    }
+#endif
+
+    for(; x < width; ++ x)
+    {
+        const int32_t gx{SIDE * (below[x + 2] + above[x + 2] - below[x] - above[x]) + CENTRE * (row[x + 2] - row[x])};
+        const int32_t gy{SIDE * (above[x] - below[x] + above[x + 2] - below[x + 2]) + CENTRE * (above[x + 1] - below[x + 1])};
+        const long m{std::lrint(std::sqrt((float)(gx * gx + gy * gy)) * scale)};
+        magnitude[x] = (uint8_t)std::min(m, 255L);
+        if(direction != nullptr)
+        {
+            direction[x] = direction_bin(gx, gy);
+        }
+    }
+}
+
+
+BMP::BITMAP BMP::BITMAP::edge_detect(BITMAP * const direction, const EdgeOperator op, const EdgeMode edge) const
+{
+    BITMAP magnitude(m_width, m_height, 8);
+    if(m_bit_count != 8 && m_bit_count != 24 && m_bit_count != 32)
+    {
+        std::cerr << "EdgeDetect error: requires 8, 24 or 32 bit image" << std::endl;
+        return magnitude;
+    }
+    if(direction == this)
+    {
+        std::cerr << "EdgeDetect error: direction must not be the input image" << std::endl;
+        return magnitude;
+    }
+    if(direction != nullptr)
+    {
+        direction->reinitialize(m_width, m_height, 8);
+    }
+    if(m_width == 0 || m_height == 0)
+    {
+        return magnitude;
+    }
+
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+    const int64_t bytes_per_pixel{(int64_t)(m_bit_count / 8)};
+    const int64_t x_left{edge_index(-1, width, edge)};
+    const int64_t x_right{edge_index(width, width, edge)};
+
+    ParallelBands(m_height, edges_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            // luma rows y - 1, y and y + 1 with one pixel of padding either
+            // side, row y is in slot (y - first) % 3
+            const int64_t first{(int64_t)begin - 1};
+            std::vector<uint8_t> rows[3];
+            for(std::vector<uint8_t>& row : rows)
+            {
+                row.resize(width + 2);
+            }
+            auto load = [&](const int64_t y)
+                {
+                    uint8_t * const gray{rows[(y - first) % 3].data()};
+                    const int64_t y_in{edge_index(y, height, edge)};
+                    if(y_in < 0)
+                    {
+                        std::fill(gray, gray + width + 2, 0x00);
+                        return;
+                    }
+                    luma_row(&m_data[index(0, y_in)], gray + 1, width, bytes_per_pixel);
+                    gray[0] = (x_left < 0) ? 0x00 : gray[x_left + 1];
+                    gray[width + 1] = (x_right < 0) ? 0x00 : gray[x_right + 1];
+                };
+
+            load(first);
+            load(first + 1);
+            for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+            {
+                load(y + 1);
+                const uint8_t * const below{rows[(y - 1 - first) % 3].data()};
+                const uint8_t * const row{rows[(y - first) % 3].data()};
+                const uint8_t * const above{rows[(y + 1 - first) % 3].data()};
+                uint8_t * const m{&magnitude.m_data[magnitude.index(0, y)]};
+                uint8_t * const d{(direction != nullptr) ? &direction->m_data[direction->index(0, y)] : nullptr};
+                if(op == EdgeOperator::SCHARR) gradient_row<3, 10>(below, row, above, m, d, width);
+                else gradient_row<1, 2>(below, row, above, m, d, width);
+            }
+        });
+
+    return magnitude;
+}
+
+
+BMP::BITMAP BMP::BITMAP::EdgeDetect(const EdgeOperator op, const EdgeMode edge) const
+{
+    return edge_detect(nullptr, op, edge);
+}
+
+
+BMP::BITMAP BMP::BITMAP::EdgeDetect(BITMAP& direction, const EdgeOperator op, const EdgeMode edge) const
+{
+    return edge_detect(&direction, op, edge);
+}
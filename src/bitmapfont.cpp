@@ -0,0 +1,114 @@
+#include "bitmapfont.hpp"
+
+
+BMP::BITMAPFont::BITMAPFont(const std::string& filename, const int glyph_width, const int glyph_height, const int first_char)
+    : BITMAP(filename)
+    , m_glyph_width{glyph_width}
+    , m_glyph_height{glyph_height}
+    , m_first_char{first_char}
+    , m_glyph_count{0}
+{
+    pack();
+}
+
+
+BMP::BITMAPFont::~BITMAPFont()
+{
+}
+
+
+void BMP::BITMAPFont::pack()
+{
+    m_spans.clear();
+    m_glyph_offset.clear();
+    m_glyph_count = 0;
+
+    if(m_glyph_width <= 0 || m_glyph_height <= 0)
+    {
+        std::cerr << "Font error: invalid glyph size" << std::endl;
+        m_glyph_offset.push_back(0);
+        return;
+    }
+
+    const LONG columns{m_width / m_glyph_width};
+    const LONG rows{m_height / m_glyph_height};
+    m_glyph_count = columns * rows;
+    if(m_glyph_count == 0)
+    {
+        std::cerr << "Font error: glyph sheet smaller than one glyph" << std::endl;
+    }
+
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+
+    // glyphs are numbered from the top left of the sheet, but rows are
+    // stored bottom up
+    for(int glyph{0}; glyph < m_glyph_count; ++ glyph)
+    {
+        m_glyph_offset.push_back(m_spans.size());
+
+        const LONG cell_x{(glyph % columns) * m_glyph_width};
+        const LONG cell_y{m_height - (glyph / columns + 1) * m_glyph_height};
+
+        for(int y{0}; y < m_glyph_height; ++ y)
+        {
+            const uint8_t* const row{&m_data[index(cell_x, cell_y + y)]};
+
+            int x{0};
+            while(x < m_glyph_width)
+            {
+                // skip background
+                while(x < m_glyph_width)
+                {
+                    const uint8_t* const p{row + x * bytes_per_pixel};
+                    if(p[0] | p[1] | p[2]) break;
+                    ++ x;
+                }
+                const int start{x};
+                while(x < m_glyph_width)
+                {
+                    const uint8_t* const p{row + x * bytes_per_pixel};
+                    if(!(p[0] | p[1] | p[2])) break;
+                    ++ x;
+                }
+                if(x > start)
+                {
+                    m_spans.push_back(Span{start, y, x - start});
+                }
+            }
+        }
+    }
+    m_glyph_offset.push_back(m_spans.size());
+}
+
+
+int BMP::BITMAPFont::GlyphWidth() const
+{
+    return m_glyph_width;
+}
+
+
+int BMP::BITMAPFont::GlyphHeight() const
+{
+    return m_glyph_height;
+}
+
+
+bool BMP::BITMAPFont::HasGlyph(const unsigned char c) const
+{
+    const int glyph{(int)c - m_first_char};
+    return (glyph >= 0 && glyph < m_glyph_count);
+}
+
+
+const BMP::BITMAPFont::Span* BMP::BITMAPFont::GlyphSpans(const unsigned char c, size_t& count) const
+{
+    if(!HasGlyph(c))
+    {
+        count = 0;
+        return nullptr;
+    }
+
+    const int glyph{(int)c - m_first_char};
+    count = m_glyph_offset[glyph + 1] - m_glyph_offset[glyph];
+    return m_spans.data() + m_glyph_offset[glyph];
+}
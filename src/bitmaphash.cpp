@@ -0,0 +1,195 @@
+#include "bitmap.hpp"
+
+
+// C headers
+#include <cstring>
+
+
+// XXH64
+// the input is consumed in 32 byte stripes by four independent 64 bit
+// lanes, so the multiply chains of the lanes overlap in the pipeline
+// (SSE2 has no 64 bit multiply, four scalar lanes are faster than a
+// vector version)
+
+static const uint64_t hash_prime_1{11400714785074694791ULL};
+static const uint64_t hash_prime_2{14029467366897019727ULL};
+static const uint64_t hash_prime_3{1609587929392839161ULL};
+static const uint64_t hash_prime_4{9650029242287828579ULL};
+static const uint64_t hash_prime_5{2870177450012600261ULL};
+
+
+static inline uint64_t hash_rotl(const uint64_t x, const int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+static inline uint64_t hash_read64(const uint8_t * const p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+static inline uint32_t hash_read32(const uint8_t * const p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+static inline uint64_t hash_round(uint64_t acc, const uint64_t input)
+{
+    acc += input * hash_prime_2;
+    acc = hash_rotl(acc, 31);
+    return acc * hash_prime_1;
+}
+
+
+static inline uint64_t hash_merge_round(uint64_t acc, const uint64_t value)
+{
+    acc ^= hash_round(0, value);
+    return acc * hash_prime_1 + hash_prime_4;
+}
+
+
+// streaming hash state, the bytes may be supplied in pieces of any size
+// (eg, one row at a time without the padding)
+class HashStream
+{
+
+    uint64_t m_lane[4];
+    uint8_t m_buffer[32];
+    BMP::LONG m_buffered;
+    BMP::LONG m_total;
+    uint64_t m_seed;
+
+    void stripe(const uint8_t * const p)
+    {
+        m_lane[0] = hash_round(m_lane[0], hash_read64(p + 0));
+        m_lane[1] = hash_round(m_lane[1], hash_read64(p + 8));
+        m_lane[2] = hash_round(m_lane[2], hash_read64(p + 16));
+        m_lane[3] = hash_round(m_lane[3], hash_read64(p + 24));
+    }
+
+public:
+
+    explicit
+    HashStream(const uint64_t seed)
+        : m_lane{seed + hash_prime_1 + hash_prime_2, seed + hash_prime_2, seed, seed - hash_prime_1}
+        , m_buffered{0}
+        , m_total{0}
+        , m_seed{seed}
+    {
+    }
+
+    void Update(const uint8_t* p, BMP::LONG count)
+    {
+        m_total += count;
+
+        // complete a partial stripe left from the previous call
+        if(m_buffered > 0)
+        {
+            const BMP::LONG fill{(count < 32 - m_buffered) ? count : 32 - m_buffered};
+            memcpy(m_buffer + m_buffered, p, fill);
+            m_buffered += fill;
+            p += fill;
+            count -= fill;
+            if(m_buffered < 32)
+            {
+                return;
+            }
+            stripe(m_buffer);
+            m_buffered = 0;
+        }
+
+        for(; count >= 32; p += 32, count -= 32)
+        {
+            stripe(p);
+        }
+
+        memcpy(m_buffer, p, count);
+        m_buffered = count;
+    }
+
+    uint64_t Digest() const
+    {
+        uint64_t hash;
+        if(m_total >= 32)
+        {
+            hash = hash_rotl(m_lane[0], 1) + hash_rotl(m_lane[1], 7) + hash_rotl(m_lane[2], 12) + hash_rotl(m_lane[3], 18);
+            hash = hash_merge_round(hash, m_lane[0]);
+            hash = hash_merge_round(hash, m_lane[1]);
+            hash = hash_merge_round(hash, m_lane[2]);
+            hash = hash_merge_round(hash, m_lane[3]);
+        }
+        else
+        {
+            hash = m_seed + hash_prime_5;
+        }
+        hash += (uint64_t)m_total;
+
+        // remaining bytes
+        const uint8_t* p{m_buffer};
+        BMP::LONG count{m_buffered};
+        for(; count >= 8; p += 8, count -= 8)
+        {
+            hash ^= hash_round(0, hash_read64(p));
+            hash = hash_rotl(hash, 27) * hash_prime_1 + hash_prime_4;
+        }
+        if(count >= 4)
+        {
+            hash ^= (uint64_t)hash_read32(p) * hash_prime_1;
+            hash = hash_rotl(hash, 23) * hash_prime_2 + hash_prime_3;
+            p += 4;
+            count -= 4;
+        }
+        for(; count > 0; ++ p, -- count)
+        {
+            hash ^= (*p) * hash_prime_5;
+            hash = hash_rotl(hash, 11) * hash_prime_1;
+        }
+
+        // avalanche
+        hash ^= hash >> 33;
+        hash *= hash_prime_2;
+        hash ^= hash >> 29;
+        hash *= hash_prime_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+};
+
+
+uint64_t BMP::HashBytes(const uint8_t * const data, const LONG count, const uint64_t seed)
+{
+    HashStream stream(seed);
+    stream.Update(data, count);
+    return stream.Digest();
+}
+
+
+uint64_t BMP::BITMAP::Hash() const
+{
+    // the dimensions are part of the seed, so that images with the same
+    // bytes but a different shape hash differently
+    const uint64_t seed{HashBytes((const uint8_t*)&m_width, sizeof(m_width), HashBytes((const uint8_t*)&m_height, sizeof(m_height), m_bit_count))};
+
+    HashStream stream(seed);
+    if(m_width_pad == 0)
+    {
+        stream.Update(m_data.data(), m_data.size());
+    }
+    else
+    {
+        const LONG row_bytes{m_width_memory - m_width_pad};
+        for(LONG y{0}; y < m_height; ++ y)
+        {
+            stream.Update(&m_data[index(0, y)], row_bytes);
+        }
+    }
+    return stream.Digest();
+}
@@ -0,0 +1,527 @@
+#include "bitmapmask.hpp"
+#include "integralimage.hpp"
+#include "parallel.hpp"
+
+
+// C++ headers
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+
+// C headers
+#include <cstring>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG mask_min_band{256};
+
+
+// 1 bit BMP rows store the first pixel in the highest bit of each byte,
+// masks store it in the lowest
+static uint8_t reverse_bits(const uint8_t value)
+{
+    return (uint8_t)(((value * 0x0202020202ULL) & 0x010884422010ULL) % 1023);
+}
+
+
+// bytes of a 1 bit BMP row including padding to 4 bytes
+static BMP::LONG file_row_bytes(const BMP::LONG width)
+{
+    return (width + 31) / 32 * 4;
+}
+
+
+BMP::BITMAPMask::BITMAPMask()
+    : m_width{0}
+    , m_height{0}
+    , m_words{0}
+    , m_tail{0}
+{
+}
+
+
+BMP::BITMAPMask::BITMAPMask(const LONG width, const LONG height)
+    : m_width{width}
+    , m_height{height}
+    , m_words{(width + 63) / 64}
+    , m_tail{(width % 64 == 0) ? ~(uint64_t)0 : ((uint64_t)1 << (width % 64)) - 1}
+    , m_data(m_words * height, 0)
+{
+}
+
+
+BMP::BITMAPMask::BITMAPMask(const std::string& filename)
+    : BITMAPMask()
+{
+    Load(filename);
+}
+
+
+BMP::LONG BMP::BITMAPMask::Width() const
+{
+    return m_width;
+}
+
+
+BMP::LONG BMP::BITMAPMask::Height() const
+{
+    return m_height;
+}
+
+
+BMP::LONG BMP::BITMAPMask::Words() const
+{
+    return m_words;
+}
+
+
+const uint64_t* BMP::BITMAPMask::Row(const LONG y) const
+{
+    return &m_data[y * m_words];
+}
+
+
+bool BMP::BITMAPMask::Get(const LONG x, const LONG y) const
+{
+    return (m_data[y * m_words + x / 64] >> (x % 64)) & 1;
+}
+
+
+void BMP::BITMAPMask::Set(const LONG x, const LONG y, const bool value)
+{
+    uint64_t& word{m_data[y * m_words + x / 64]};
+    const uint64_t bit{(uint64_t)1 << (x % 64)};
+    word = value ? (word | bit) : (word & ~bit);
+}
+
+
+void BMP::BITMAPMask::Fill(const bool value)
+{
+    std::fill(m_data.begin(), m_data.end(), value ? ~(uint64_t)0 : 0);
+    if(value && m_words > 0)
+    {
+        for(LONG y{0}; y < m_height; ++ y)
+        {
+            m_data[y * m_words + m_words - 1] &= m_tail;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// load / save
+////////////////////////////////////////////////////////////////////////////////
+
+void BMP::BITMAPMask::Load(const std::string& filename)
+{
+    std::ifstream inputfile(filename.c_str(), std::ios::binary);
+    if(!inputfile.is_open())
+    {
+        std::cerr << "Unable to open input file " << filename << std::endl;
+        return;
+    }
+
+    BITMAP::BITMAPFILEHEADER f_head;
+    BITMAP::BITMAPINFOHEADER i_head;
+    inputfile.read((char*)&f_head, sizeof(f_head));
+    inputfile.read((char*)&i_head, sizeof(i_head));
+    if(!inputfile)
+    {
+        std::cerr << ProbeStatusMessage(ProbeStatus::TRUNCATED) << std::endl;
+        return;
+    }
+
+    inputfile.seekg(0, std::ios::end);
+    const uint64_t file_size{(uint64_t)inputfile.tellg()};
+
+    // the checks of LoadBITMAP for 1 bit images, which also ensure that
+    // the pixel data lies inside the file before it is allocated
+    const ProbeStatus status{BITMAP::validate_header(f_head, i_head, file_size, true)};
+    if(status != ProbeStatus::OK)
+    {
+        std::cerr << ProbeStatusMessage(status) << std::endl;
+        return;
+    }
+
+    // the two palette entries follow the info header
+    uint8_t color_palette[8];
+    inputfile.seekg(sizeof(f_head) + i_head.biSize);
+    inputfile.read((char*)color_palette, sizeof(color_palette));
+    const bool invert{color_palette[0] + color_palette[1] + color_palette[2] > color_palette[4] + color_palette[5] + color_palette[6]};
+
+    const LONG width{i_head.biWidth};
+    const LONG height{i_head.biHeight};
+    const LONG row_bytes{file_row_bytes(width)};
+    std::vector<uint8_t> file_data(row_bytes * height);
+    inputfile.seekg(f_head.bfOffBits);
+    inputfile.read((char*)file_data.data(), file_data.size());
+    if(!inputfile)
+    {
+        std::cerr << ProbeStatusMessage(ProbeStatus::TRUNCATED) << std::endl;
+        return;
+    }
+
+    *this = BITMAPMask(width, height);
+    const LONG bytes{(width + 7) / 8};
+    for(LONG y{0}; m_words > 0 && y < height; ++ y)
+    {
+        const uint8_t * const input{&file_data[y * row_bytes]};
+        uint64_t * const output{&m_data[y * m_words]};
+        for(LONG i{0}; i < bytes; ++ i)
+        {
+            const uint8_t value{invert ? (uint8_t)~input[i] : input[i]};
+            output[i / 8] |= (uint64_t)reverse_bits(value) << (8 * (i % 8));
+        }
+        // the file padding bits are not part of the image
+        output[m_words - 1] &= m_tail;
+    }
+}
+
+
+void BMP::BITMAPMask::SaveAs(const std::string& filename) const
+{
+    std::ofstream outputfile(filename.c_str(), std::ios::binary);
+    if(!outputfile.is_open())
+    {
+        std::cerr << "Unable to open output file " << filename << std::endl;
+        return;
+    }
+
+    // clear is black, set is white
+    const uint8_t color_palette[8]{0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00};
+    const LONG row_bytes{file_row_bytes(m_width)};
+
+    BITMAP::BITMAPFILEHEADER f_head;
+    f_head.bfType = ((WORD)'M' << 0x08) | ((WORD)'B' << 0x00);
+    f_head.bfOffBits = sizeof(BITMAP::BITMAPFILEHEADER) + sizeof(BITMAP::BITMAPINFOHEADER) + sizeof(color_palette);
+    f_head.bfSize = f_head.bfOffBits + row_bytes * m_height;
+    f_head.bfReserved1 = 0;
+    f_head.bfReserved2 = 0;
+
+    BITMAP::BITMAPINFOHEADER i_head;
+    i_head.biSize = sizeof(BITMAP::BITMAPINFOHEADER);
+    i_head.biWidth = m_width;
+    i_head.biHeight = m_height;
+    i_head.biPlanes = 1;
+    i_head.biBitCount = 1;
+    i_head.biCompression = 0;
+    i_head.biSizeImage = row_bytes * m_height;
+    i_head.biXPelsPerMeter = 0;
+    i_head.biYPelsPerMeter = 0;
+    i_head.biClrUsed = 2;
+    i_head.biClrImportant = 0;
+
+    std::vector<uint8_t> memory(f_head.bfSize, 0);
+    memcpy(memory.data(), &f_head, sizeof(f_head));
+    memcpy(memory.data() + sizeof(f_head), &i_head, sizeof(i_head));
+    memcpy(memory.data() + sizeof(f_head) + sizeof(i_head), color_palette, sizeof(color_palette));
+
+    const LONG bytes{(m_width + 7) / 8};
+    for(LONG y{0}; y < m_height; ++ y)
+    {
+        const uint64_t * const input{&m_data[y * m_words]};
+        uint8_t * const output{memory.data() + f_head.bfOffBits + y * row_bytes};
+        for(LONG i{0}; i < bytes; ++ i)
+        {
+            output[i] = reverse_bits((uint8_t)(input[i / 8] >> (8 * (i % 8))));
+        }
+    }
+
+    outputfile.write((const char*)memory.data(), memory.size());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// logical operations
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+    struct OpAND
+    {
+        uint64_t operator()(const uint64_t l, const uint64_t r) const { return l & r; }
+#if defined(__SSE2__)
+        __m128i operator()(const __m128i l, const __m128i r) const { return _mm_and_si128(l, r); }
+#endif
+    };
+
+    struct OpOR
+    {
+        uint64_t operator()(const uint64_t l, const uint64_t r) const { return l | r; }
+#if defined(__SSE2__)
+        __m128i operator()(const __m128i l, const __m128i r) const { return _mm_or_si128(l, r); }
+#endif
+    };
+
+    struct OpXOR
+    {
+        uint64_t operator()(const uint64_t l, const uint64_t r) const { return l ^ r; }
+#if defined(__SSE2__)
+        __m128i operator()(const __m128i l, const __m128i r) const { return _mm_xor_si128(l, r); }
+#endif
+    };
+
+}
+
+
+template<typename OP>
+void BMP::BITMAPMask::combine(const BITMAPMask& mask, OP op)
+{
+    const LONG width{std::min(m_width, mask.m_width)};
+    const LONG height{std::min(m_height, mask.m_height)};
+    const LONG full{width / 64};
+    const LONG rest{width % 64};
+    const uint64_t rest_mask{((uint64_t)1 << rest) - 1};
+
+    for(LONG y{0}; y < height; ++ y)
+    {
+        uint64_t * const output{&m_data[y * m_words]};
+        const uint64_t * const input{&mask.m_data[y * mask.m_words]};
+        LONG w{0};
+#if defined(__SSE2__)
+        for(; w + 2 <= full; w += 2)
+        {
+            const __m128i l{_mm_loadu_si128((const __m128i*)(output + w))};
+            const __m128i r{_mm_loadu_si128((const __m128i*)(input + w))};
+            _mm_storeu_si128((__m128i*)(output + w), op(l, r));
+        }
+#endif
+        for(; w < full; ++ w)
+        {
+            output[w] = op(output[w], input[w]);
+        }
+        if(rest > 0)
+        {
+            output[full] = (output[full] & ~rest_mask) | (op(output[full], input[full]) & rest_mask);
+        }
+    }
+}
+
+
+void BMP::BITMAPMask::AND(const BITMAPMask& mask)
+{
+    combine(mask, OpAND());
+}
+
+
+void BMP::BITMAPMask::OR(const BITMAPMask& mask)
+{
+    combine(mask, OpOR());
+}
+
+
+void BMP::BITMAPMask::XOR(const BITMAPMask& mask)
+{
+    combine(mask, OpXOR());
+}
+
+
+void BMP::BITMAPMask::NOT()
+{
+    const LONG count{(LONG)m_data.size()};
+    LONG w{0};
+#if defined(__SSE2__)
+    const __m128i ones{_mm_set1_epi32(-1)};
+    for(; w + 2 <= count; w += 2)
+    {
+        const __m128i v{_mm_loadu_si128((const __m128i*)(&m_data[w]))};
+        _mm_storeu_si128((__m128i*)(&m_data[w]), _mm_xor_si128(v, ones));
+    }
+#endif
+    for(; w < count; ++ w)
+    {
+        m_data[w] = ~m_data[w];
+    }
+
+    // keep the bits beyond the width clear
+    for(LONG y{0}; m_words > 0 && y < m_height; ++ y)
+    {
+        m_data[y * m_words + m_words - 1] &= m_tail;
+    }
+}
+
+
+uint64_t BMP::BITMAPMask::Count() const
+{
+    uint64_t count{0};
+    for(const uint64_t word : m_data)
+    {
+        count += std::bitset<64>(word).count();
+    }
+    return count;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// conversion
+////////////////////////////////////////////////////////////////////////////////
+
+BMP::BITMAPMask BMP::BITMAPMask::Threshold(const BITMAP& bitmap, const uint8_t threshold)
+{
+    BITMAPMask mask(bitmap.m_width, bitmap.m_height);
+    const LONG bytes_per_pixel{(LONG)(bitmap.m_bit_count / 8)};
+    if(bytes_per_pixel != 1 && bytes_per_pixel < 3)
+    {
+        std::cerr << "Mask error: requires 8, 24 or 32 bit image" << std::endl;
+        return mask;
+    }
+
+    const LONG width{bitmap.m_width};
+    ParallelBands(bitmap.m_height, mask_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                const uint8_t * const input{&bitmap.m_data[bitmap.index(0, y)]};
+                uint64_t * const output{&mask.m_data[y * mask.m_words]};
+                LONG x{0};
+                if(bytes_per_pixel == 1)
+                {
+#if defined(__SSE2__)
+                    // v >= threshold as max(v, threshold) == v, one movemask
+                    // gives the bits of 16 pixels
+                    const __m128i t{_mm_set1_epi8((char)threshold)};
+                    for(; x + 16 <= width; x += 16)
+                    {
+                        const __m128i v{_mm_loadu_si128((const __m128i*)(input + x))};
+                        const uint64_t bits{(uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, t), v))};
+                        output[x / 64] |= bits << (x % 64);
+                    }
+#endif
+                    for(; x < width; ++ x)
+                    {
+                        output[x / 64] |= (uint64_t)(input[x] >= threshold) << (x % 64);
+                    }
+                }
+                else
+                {
+                    // luma as Grayscale
+                    for(; x < width; ++ x)
+                    {
+                        const uint8_t * const p{input + x * bytes_per_pixel};
+                        const uint8_t luma{(uint8_t)((7471 * p[0] + 38470 * p[1] + 19595 * p[2] + (1 << 15)) >> 16)};
+                        output[x / 64] |= (uint64_t)(luma >= threshold) << (x % 64);
+                    }
+                }
+            }
+        });
+
+    return mask;
+}
+
+
+BMP::BITMAPMask BMP::BITMAPMask::AdaptiveThreshold(const BITMAP& bitmap, const int radius, const double k)
+{
+    BITMAPMask mask(bitmap.m_width, bitmap.m_height);
+    if(bitmap.m_bit_count != 8 && bitmap.m_bit_count != 24 && bitmap.m_bit_count != 32)
+    {
+        std::cerr << "Mask error: requires 8, 24 or 32 bit image" << std::endl;
+        return mask;
+    }
+
+    const IntegralImage integral(bitmap);
+    const int64_t width{(int64_t)bitmap.m_width};
+    const int64_t height{(int64_t)bitmap.m_height};
+    const int64_t r{(radius < 0) ? 0 : radius};
+    ParallelBands(bitmap.m_height, mask_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+            {
+                const int64_t y0{std::max<int64_t>(y - r, 0)};
+                const int64_t y1{std::min<int64_t>(y + r + 1, height)};
+                uint64_t * const output{&mask.m_data[y * mask.m_words]};
+                for(int64_t x{0}; x < width; ++ x)
+                {
+                    const int64_t x0{std::max<int64_t>(x - r, 0)};
+                    const int64_t x1{std::min<int64_t>(x + r + 1, width)};
+                    const Rect window{(int)x0, (int)y0, (int)(x1 - x0), (int)(y1 - y0)};
+                    const double n{(double)((x1 - x0) * (y1 - y0))};
+                    const double mean{(double)integral.Sum(window) / n};
+                    const double variance{std::max((double)integral.SumSq(window) / n - mean * mean, 0.0)};
+                    const double value{(double)integral.Sum(Rect{(int)x, (int)y, 1, 1})};
+                    output[x / 64] |= (uint64_t)(value >= mean + k * std::sqrt(variance)) << (x % 64);
+                }
+            }
+        });
+
+    return mask;
+}
+
+
+BMP::BITMAP BMP::BITMAPMask::ToBITMAP() const
+{
+    BITMAP bitmap(m_width, m_height, 8);
+
+    ParallelBands(m_height, mask_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                const uint64_t * const input{&m_data[y * m_words]};
+                uint8_t * const output{&bitmap.m_data[bitmap.index(0, y)]};
+                for(LONG x{0}; x < m_width; ++ x)
+                {
+                    output[x] = (uint8_t)(0 - ((input[x / 64] >> (x % 64)) & 1));
+                }
+            }
+        });
+
+    return bitmap;
+}
+
+
+void BMP::BITMAP::Select(const BITMAPMask& mask, const BITMAP& bitmap)
+{
+    if(bitmap.m_bit_count != m_bit_count)
+    {
+        std::cerr << "Select error: bit count mismatch" << std::endl;
+        return;
+    }
+
+    const LONG width{std::min(std::min(m_width, bitmap.m_width), mask.Width())};
+    const LONG height{std::min(std::min(m_height, bitmap.m_height), mask.Height())};
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+
+    ParallelBands(height, mask_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                const uint64_t * const words{mask.Row(y)};
+                const uint8_t * const input{&bitmap.m_data[bitmap.index(0, y)]};
+                uint8_t * const output{&m_data[index(0, y)]};
+                for(LONG x_0{0}; x_0 < width; x_0 += 64)
+                {
+                    const LONG count{std::min((LONG)64, width - x_0)};
+                    uint64_t word{words[x_0 / 64]};
+                    if(count < 64)
+                    {
+                        word &= ((uint64_t)1 << count) - 1;
+                    }
+
+                    // whole words of clear or set pixels are common in masks
+                    if(word == 0)
+                    {
+                        continue;
+                    }
+                    if(word == ~(uint64_t)0)
+                    {
+                        memcpy(output + x_0 * bytes_per_pixel, input + x_0 * bytes_per_pixel, 64 * bytes_per_pixel);
+                        continue;
+                    }
+                    for(LONG i{0}; i < count; ++ i)
+                    {
+                        if((word >> i) & 1)
+                        {
+                            memcpy(output + (x_0 + i) * bytes_per_pixel, input + (x_0 + i) * bytes_per_pixel, bytes_per_pixel);
+                        }
+                    }
+                }
+            }
+        });
+
+    mark_dirty(Rect{0, 0, (int)width, (int)height});
+}
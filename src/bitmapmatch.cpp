@@ -0,0 +1,417 @@
+#include "bitmap.hpp"
+#include "integralimage.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cmath>
+
+// C++ headers
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows of positions scored by each thread
+static const BMP::LONG match_min_band{4};
+
+// the coarsest pyramid level searched keeps the needle at least this wide
+// and high
+static const BMP::LONG match_min_needle{16};
+
+// candidates from the coarsest level which are refined at finer levels
+static const size_t match_candidates{8};
+
+// positions searched either side of each candidate at the next finer level
+static const int64_t match_refine{2};
+
+
+namespace
+{
+
+    // pixels of one level of the haystack or the needle
+    struct Plane
+    {
+        const uint8_t* data;
+        BMP::LONG stride;
+        BMP::LONG width;
+        BMP::LONG height;
+        BMP::LONG bytes_per_pixel;
+
+        const uint8_t* pixel(const BMP::LONG x, const BMP::LONG y) const
+        {
+            return data + y * stride + x * bytes_per_pixel;
+        }
+    };
+
+
+    // one pyramid level, the integral image and needle sums are for NCC
+    // levels which are only refined score few positions and sum their
+    // windows directly rather than building an integral image
+    struct Level
+    {
+        Plane haystack;
+        Plane needle;
+        bool integral_sums;
+        BMP::IntegralImage integral;
+        double needle_sum;
+        double needle_sum_sq;
+    };
+
+
+    // position of a match and its cost, lower is better
+    struct Candidate
+    {
+        int64_t x;
+        int64_t y;
+        double cost;
+    };
+
+}
+
+
+// sum of |l[i] - r[i]|, 32 bytes per iteration
+static uint64_t sad_bytes(const uint8_t * const l, const uint8_t * const r, const BMP::LONG count)
+{
+    BMP::LONG i{0};
+    uint64_t sum{0};
+
+#if defined(__SSE2__)
+    __m128i acc{_mm_setzero_si128()};
+    for(; i + 32 <= count; i += 32)
+    {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(l + i)), _mm_loadu_si128((const __m128i*)(r + i))));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(l + i + 16)), _mm_loadu_si128((const __m128i*)(r + i + 16))));
+    }
+    for(; i + 16 <= count; i += 16)
+    {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(l + i)), _mm_loadu_si128((const __m128i*)(r + i))));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for(; i < count; ++ i)
+    {
+        sum += (l[i] > r[i]) ? l[i] - r[i] : r[i] - l[i];
+    }
+    return sum;
+}
+
+
+// sum of p[i], 32 bytes per iteration
+static uint64_t sum_bytes(const uint8_t * const p, const BMP::LONG count)
+{
+    BMP::LONG i{0};
+    uint64_t sum{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    __m128i acc{zero};
+    for(; i + 32 <= count; i += 32)
+    {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)), zero));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i + 16)), zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for(; i < count; ++ i)
+    {
+        sum += p[i];
+    }
+    return sum;
+}
+
+
+// sum of l[i] * r[i], 16 bytes per iteration
+static uint64_t dot_bytes(const uint8_t * const l, const uint8_t * const r, const BMP::LONG count)
+{
+    BMP::LONG i{0};
+    uint64_t sum{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    while(i + 16 <= count)
+    {
+        // each lane grows by at most 4 * 255^2 per iteration, so the lanes
+        // are added to sum before they can overflow
+        const BMP::LONG chunk_end{std::min(count, i + 16 * 4096)};
+        __m128i acc{zero};
+        for(; i + 16 <= chunk_end; i += 16)
+        {
+            const __m128i a{_mm_loadu_si128((const __m128i*)(l + i))};
+            const __m128i b{_mm_loadu_si128((const __m128i*)(r + i))};
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for(; i < count; ++ i)
+    {
+        sum += (uint32_t)l[i] * r[i];
+    }
+    return sum;
+}
+
+
+// cost of the needle at x, y of the haystack
+// SAD costs are the sum of absolute differences, scoring stops once the
+// sum exceeds bound, NCC costs are -NCC
+static double cost_at(const Level& level, const BMP::MatchMetric metric, const int64_t x, const int64_t y, const double bound)
+{
+    const Plane& haystack{level.haystack};
+    const Plane& needle{level.needle};
+    const BMP::LONG row_bytes{needle.width * needle.bytes_per_pixel};
+
+    if(metric == BMP::MatchMetric::SAD)
+    {
+        uint64_t sum{0};
+        for(BMP::LONG r{0}; r < needle.height; ++ r)
+        {
+            sum += sad_bytes(haystack.pixel(x, y + r), needle.pixel(0, r), row_bytes);
+            if((double)sum > bound) break;
+        }
+        return (double)sum;
+    }
+
+    uint64_t sum_product{0};
+    uint64_t window_sum{0};
+    uint64_t window_sum_sq{0};
+    for(BMP::LONG r{0}; r < needle.height; ++ r)
+    {
+        const uint8_t * const row{haystack.pixel(x, y + r)};
+        sum_product += dot_bytes(row, needle.pixel(0, r), row_bytes);
+        if(!level.integral_sums)
+        {
+            window_sum += sum_bytes(row, row_bytes);
+            window_sum_sq += dot_bytes(row, row, row_bytes);
+        }
+    }
+    if(level.integral_sums)
+    {
+        const BMP::Rect rect{(int)x, (int)y, (int)needle.width, (int)needle.height};
+        window_sum = level.integral.Sum(rect);
+        window_sum_sq = level.integral.SumSq(rect);
+    }
+    const double n{(double)(needle.width * needle.height)};
+    const double sum{(double)window_sum};
+    const double variance{n * (double)window_sum_sq - sum * sum};
+    const double needle_variance{n * level.needle_sum_sq - level.needle_sum * level.needle_sum};
+    if(variance <= 0.0 || needle_variance <= 0.0)
+    {
+        // flat windows or needles do not correlate with anything
+        return 0.0;
+    }
+    return -(n * (double)sum_product - sum * level.needle_sum) / std::sqrt(variance * needle_variance);
+}
+
+
+// lower cost, equal costs are ordered by position so that results do not
+// depend on the order in which threads finish
+static bool better(const Candidate& l, const Candidate& r)
+{
+    if(l.cost != r.cost) return l.cost < r.cost;
+    if(l.y != r.y) return l.y < r.y;
+    return l.x < r.x;
+}
+
+
+static size_t worst_index(const std::vector<Candidate>& candidates)
+{
+    size_t worst{0};
+    for(size_t i{1}; i < candidates.size(); ++ i)
+    {
+        if(better(candidates[worst], candidates[i])) worst = i;
+    }
+    return worst;
+}
+
+
+// keep the count best candidates, a candidate closer than separation in x
+// and y to one already kept replaces it only if better
+static void insert_candidate(std::vector<Candidate>& candidates, const Candidate& candidate, const size_t count, const int64_t separation)
+{
+    for(Candidate& kept : candidates)
+    {
+        if(std::abs(kept.x - candidate.x) < separation && std::abs(kept.y - candidate.y) < separation)
+        {
+            if(better(candidate, kept)) kept = candidate;
+            return;
+        }
+    }
+    if(candidates.size() < count)
+    {
+        candidates.push_back(candidate);
+        return;
+    }
+    const size_t worst{worst_index(candidates)};
+    if(better(candidate, candidates[worst])) candidates[worst] = candidate;
+}
+
+
+// score every position of the level in parallel bands of rows, positions
+// costing more than limit are dropped
+static std::vector<Candidate> search_all(const Level& level, const BMP::MatchMetric metric, const size_t count, const int64_t separation, const double limit)
+{
+    const BMP::LONG positions_x{level.haystack.width - level.needle.width + 1};
+    const BMP::LONG positions_y{level.haystack.height - level.needle.height + 1};
+
+    std::vector<Candidate> candidates;
+    std::mutex candidates_mutex;
+    BMP::ParallelBands(positions_y, match_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            std::vector<Candidate> local;
+            double bound{limit};
+            for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+            {
+                for(int64_t x{0}; x < (int64_t)positions_x; ++ x)
+                {
+                    const double cost{cost_at(level, metric, x, y, bound)};
+                    if(cost > bound) continue;
+                    insert_candidate(local, Candidate{x, y, cost}, count, separation);
+                    if(local.size() == count) bound = local[worst_index(local)].cost;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(candidates_mutex);
+            for(const Candidate& candidate : local)
+            {
+                insert_candidate(candidates, candidate, count, separation);
+            }
+        });
+    return candidates;
+}
+
+
+// best position of the level near twice the position of candidate, which
+// comes from the next coarser level
+static Candidate refine(const Level& level, const BMP::MatchMetric metric, const Candidate& candidate)
+{
+    const int64_t positions_x{(int64_t)(level.haystack.width - level.needle.width + 1)};
+    const int64_t positions_y{(int64_t)(level.haystack.height - level.needle.height + 1)};
+
+    Candidate best{-1, -1, std::numeric_limits<double>::infinity()};
+    for(int64_t y{2 * candidate.y - match_refine}; y <= 2 * candidate.y + match_refine; ++ y)
+    {
+        for(int64_t x{2 * candidate.x - match_refine}; x <= 2 * candidate.x + match_refine; ++ x)
+        {
+            if(x < 0 || y < 0 || x >= positions_x || y >= positions_y) continue;
+            const Candidate c{x, y, cost_at(level, metric, x, y, best.cost)};
+            if(better(c, best)) best = c;
+        }
+    }
+    return best;
+}
+
+
+BMP::TemplateMatch BMP::BITMAP::FindTemplate(const BITMAP& needle, const MatchMetric metric, const double threshold, const bool coarse_to_fine) const
+{
+    TemplateMatch match{Rect{0, 0, 0, 0}, 0.0};
+    if(m_bit_count != needle.m_bit_count || (m_bit_count != 8 && m_bit_count != 24 && m_bit_count != 32))
+    {
+        std::cerr << "FindTemplate error: requires 8, 24 or 32 bit images of the same bit count" << std::endl;
+        return match;
+    }
+    if(needle.m_width == 0 || needle.m_height == 0)
+    {
+        std::cerr << "FindTemplate error: empty needle" << std::endl;
+        return match;
+    }
+    if(needle.m_width > m_width || needle.m_height > m_height)
+    {
+        return match;
+    }
+
+    // NCC works on the luma
+    const bool ncc{metric == MatchMetric::NCC};
+    BITMAP gray_haystack;
+    BITMAP gray_needle;
+    if(ncc)
+    {
+        gray_haystack = Grayscale();
+        gray_needle = needle.Grayscale();
+    }
+    const BITMAP& source_haystack{ncc ? gray_haystack : *this};
+    const BITMAP& source_needle{ncc ? gray_needle : needle};
+
+    int levels{0};
+    if(coarse_to_fine)
+    {
+        while((needle.m_width >> (levels + 1)) >= match_min_needle && (needle.m_height >> (levels + 1)) >= match_min_needle)
+        {
+            ++ levels;
+        }
+    }
+    const std::vector<BITMAP> pyramid_haystack{source_haystack.BuildPyramid(levels)};
+    const std::vector<BITMAP> pyramid_needle{source_needle.BuildPyramid(levels)};
+
+    auto plane = [](const BITMAP& bitmap)
+        {
+            return Plane{bitmap.m_data.data(), bitmap.m_width_memory, bitmap.m_width, bitmap.m_height, (LONG)(bitmap.m_bit_count / 8)};
+        };
+    auto make_level = [&](const int l, const bool exhaustive)
+        {
+            const BITMAP& h{(l == 0) ? source_haystack : pyramid_haystack[l - 1]};
+            const BITMAP& n{(l == 0) ? source_needle : pyramid_needle[l - 1]};
+            Level level{plane(h), plane(n), ncc && exhaustive, IntegralImage(), 0.0, 0.0};
+            if(ncc)
+            {
+                if(exhaustive) level.integral = IntegralImage(h);
+                const IntegralImage integral_needle(n);
+                const Rect all{0, 0, (int)n.m_width, (int)n.m_height};
+                level.needle_sum = (double)integral_needle.Sum(all);
+                level.needle_sum_sq = (double)integral_needle.SumSq(all);
+            }
+            return level;
+        };
+
+    // an exhaustive search only keeps positions within the threshold,
+    // coarse levels keep the best few regardless
+    const double values{(double)(needle.m_width * needle.m_height * (m_bit_count / 8))};
+    const double limit{ncc ? -threshold : threshold * values};
+
+    std::vector<Candidate> candidates;
+    {
+        const Level coarsest{make_level(levels, true)};
+        const int64_t separation{std::max<int64_t>((int64_t)std::max(coarsest.needle.width, coarsest.needle.height) / 2, 1)};
+        if(levels == 0) candidates = search_all(coarsest, metric, 1, separation, limit);
+        else candidates = search_all(coarsest, metric, match_candidates, separation, std::numeric_limits<double>::infinity());
+    }
+    for(int level{levels - 1}; level >= 0; -- level)
+    {
+        const Level finer{make_level(level, false)};
+        for(Candidate& candidate : candidates)
+        {
+            candidate = refine(finer, metric, candidate);
+        }
+    }
+    if(candidates.empty())
+    {
+        return match;
+    }
+
+    Candidate best{candidates[0]};
+    for(const Candidate& candidate : candidates)
+    {
+        if(better(candidate, best)) best = candidate;
+    }
+    match.score = ncc ? -best.cost : best.cost / values;
+    if(ncc ? (match.score >= threshold) : (match.score <= threshold))
+    {
+        match.bounds = Rect{(int)best.x, (int)best.y, (int)needle.m_width, (int)needle.m_height};
+    }
+    return match;
+}
@@ -0,0 +1,436 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+
+// C++ headers
+#include <algorithm>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG median_min_band{64};
+
+// columns filtered together by the histogram median, so that the column
+// histograms of a strip stay in cache
+static const int64_t median_strip{256};
+
+// largest radius for which window counts fit the 16 bit histogram bins
+static const int median_max_radius{127};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// sorting networks
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+    // compare-exchange of p[i] and p[j], leaving the minimum in p[i] and the
+    // maximum in p[j], LOW and HIGH only write the one which is used later
+    enum Exchange : uint8_t
+    {
+        BOTH,
+        LOW,
+        HIGH
+    };
+
+    struct Comparator
+    {
+        uint8_t i;
+        uint8_t j;
+        Exchange exchange;
+    };
+
+
+    struct ByteOps
+    {
+        static uint8_t min(const uint8_t l, const uint8_t r) { return (l < r) ? l : r; }
+        static uint8_t max(const uint8_t l, const uint8_t r) { return (l < r) ? r : l; }
+    };
+
+#if defined(__SSE2__)
+    struct VectorOps
+    {
+        static __m128i min(const __m128i l, const __m128i r) { return _mm_min_epu8(l, r); }
+        static __m128i max(const __m128i l, const __m128i r) { return _mm_max_epu8(l, r); }
+    };
+#endif
+
+}
+
+
+// Paeth's median of 9, reduced to the comparisons which reach the median
+static constexpr Comparator median_9[]
+{
+    {1, 2, BOTH}, {4, 5, BOTH}, {7, 8, BOTH}, {0, 1, BOTH}, {3, 4, BOTH}, {6, 7, BOTH},
+    {1, 2, BOTH}, {4, 5, BOTH}, {7, 8, BOTH}, {0, 3, HIGH}, {5, 8, LOW}, {4, 7, BOTH}, {3, 6, HIGH},
+    {1, 4, HIGH}, {2, 5, LOW}, {4, 7, LOW}, {4, 2, BOTH}, {6, 4, HIGH}, {4, 2, LOW}
+};
+
+// Batcher's odd-even merge sort of 32 inputs, without the comparisons with
+// the 7 inputs which would always be largest, reduced to the comparisons
+// which reach the median of the 25 remaining
+static constexpr Comparator median_25[]
+{
+    {0, 1, BOTH}, {2, 3, BOTH}, {4, 5, BOTH}, {6, 7, BOTH}, {8, 9, BOTH}, {10, 11, BOTH},
+    {12, 13, BOTH}, {14, 15, BOTH}, {16, 17, BOTH}, {18, 19, BOTH}, {20, 21, BOTH}, {22, 23, BOTH},
+    {0, 2, BOTH}, {1, 3, BOTH}, {4, 6, BOTH}, {5, 7, BOTH}, {8, 10, BOTH}, {9, 11, BOTH},
+    {12, 14, BOTH}, {13, 15, BOTH}, {16, 18, BOTH}, {17, 19, BOTH}, {20, 22, BOTH}, {21, 23, BOTH},
+    {1, 2, BOTH}, {5, 6, BOTH}, {9, 10, BOTH}, {13, 14, BOTH}, {17, 18, BOTH}, {21, 22, BOTH},
+    {0, 4, BOTH}, {1, 5, BOTH}, {2, 6, BOTH}, {3, 7, BOTH}, {8, 12, BOTH}, {9, 13, BOTH},
+    {10, 14, BOTH}, {11, 15, BOTH}, {16, 20, BOTH}, {17, 21, BOTH}, {18, 22, BOTH}, {19, 23, BOTH},
+    {2, 4, BOTH}, {3, 5, BOTH}, {10, 12, BOTH}, {11, 13, BOTH}, {18, 20, BOTH}, {19, 21, BOTH},
+    {1, 2, BOTH}, {3, 4, BOTH}, {5, 6, BOTH}, {9, 10, BOTH}, {11, 12, BOTH}, {13, 14, BOTH},
+    {17, 18, BOTH}, {19, 20, BOTH}, {21, 22, BOTH}, {0, 8, BOTH}, {1, 9, BOTH}, {2, 10, BOTH},
+    {3, 11, BOTH}, {4, 12, BOTH}, {5, 13, BOTH}, {6, 14, BOTH}, {7, 15, LOW}, {16, 24, BOTH},
+    {4, 8, BOTH}, {5, 9, BOTH}, {6, 10, BOTH}, {7, 11, BOTH}, {20, 24, BOTH}, {2, 4, BOTH},
+    {3, 5, BOTH}, {6, 8, BOTH}, {7, 9, BOTH}, {10, 12, BOTH}, {11, 13, BOTH}, {18, 20, BOTH},
+    {19, 21, BOTH}, {22, 24, BOTH}, {1, 2, BOTH}, {3, 4, BOTH}, {5, 6, BOTH}, {7, 8, BOTH},
+    {9, 10, BOTH}, {11, 12, BOTH}, {13, 14, LOW}, {17, 18, BOTH}, {19, 20, BOTH}, {21, 22, BOTH},
+    {23, 24, BOTH}, {0, 16, HIGH}, {1, 17, HIGH}, {2, 18, HIGH}, {3, 19, HIGH}, {4, 20, HIGH},
+    {5, 21, HIGH}, {6, 22, LOW}, {7, 23, LOW}, {8, 24, LOW}, {8, 16, HIGH}, {9, 17, HIGH},
+    {10, 18, LOW}, {11, 19, LOW}, {12, 20, LOW}, {13, 21, LOW}, {6, 10, HIGH}, {7, 11, HIGH},
+    {12, 16, LOW}, {13, 17, LOW}, {10, 12, HIGH}, {11, 13, LOW}, {11, 12, HIGH}
+};
+
+
+// apply comparators FIRST to FIRST + COUNT - 1 of NETWORK to p, expanded
+// at compile time so that p can be kept in registers
+template<typename OPS, typename T, const Comparator* NETWORK, size_t FIRST, size_t COUNT>
+struct Network
+{
+    static void apply(T * const p)
+    {
+        Network<OPS, T, NETWORK, FIRST, COUNT / 2>::apply(p);
+        Network<OPS, T, NETWORK, FIRST + COUNT / 2, COUNT - COUNT / 2>::apply(p);
+    }
+};
+
+
+template<typename OPS, typename T, const Comparator* NETWORK, size_t FIRST>
+struct Network<OPS, T, NETWORK, FIRST, 1>
+{
+    static void apply(T * const p)
+    {
+        constexpr Comparator c{NETWORK[FIRST]};
+        if(c.exchange == BOTH)
+        {
+            const T low{OPS::min(p[c.i], p[c.j])};
+            p[c.j] = OPS::max(p[c.i], p[c.j]);
+            p[c.i] = low;
+        }
+        else if(c.exchange == LOW)
+        {
+            p[c.i] = OPS::min(p[c.i], p[c.j]);
+        }
+        else
+        {
+            p[c.j] = OPS::max(p[c.i], p[c.j]);
+        }
+    }
+};
+
+
+// median of the (2 * R + 1)^2 inputs p
+template<int R, typename OPS, typename T>
+static T select_median(T * const p)
+{
+    if(R == 1)
+    {
+        Network<OPS, T, median_9, 0, sizeof(median_9) / sizeof(Comparator)>::apply(p);
+        return p[4];
+    }
+    Network<OPS, T, median_25, 0, sizeof(median_25) / sizeof(Comparator)>::apply(p);
+    return p[12];
+}
+
+
+// one output row from the padded rows window[0..2 * R]
+// byte i of the output row is byte i + R * bytes_per_pixel of the padded
+// rows, all channels are filtered alike
+template<int R>
+static void median_row(const uint8_t * const * const window, uint8_t * const out, const int64_t row_bytes, const int64_t bytes_per_pixel)
+{
+    const int size{2 * R + 1};
+    int64_t i{0};
+#if defined(__SSE2__)
+    __m128i p[size * size];
+    for(; i + 16 <= row_bytes; i += 16)
+    {
+        for(int dy{0}; dy < size; ++ dy)
+        {
+            for(int dx{0}; dx < size; ++ dx)
+            {
+                p[dy * size + dx] = _mm_loadu_si128((const __m128i*)(window[dy] + i + dx * bytes_per_pixel));
+            }
+        }
+        _mm_storeu_si128((__m128i*)(out + i), select_median<R, VectorOps>(p));
+    }
+#endif
+    uint8_t q[size * size];
+    for(; i < row_bytes; ++ i)
+    {
+        for(int dy{0}; dy < size; ++ dy)
+        {
+            for(int dx{0}; dx < size; ++ dx)
+            {
+                q[dy * size + dx] = window[dy][i + dx * bytes_per_pixel];
+            }
+        }
+        out[i] = select_median<R, ByteOps>(q);
+    }
+}
+
+
+void BMP::BITMAP::median_network(std::vector<uint8_t>& output, const int radius, const EdgeMode edge, const LONG begin, const LONG end) const
+{
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+    const int64_t bytes_per_pixel{(int64_t)(m_bit_count / 8)};
+    const int64_t r{radius};
+    const int64_t size{2 * r + 1};
+    const int64_t row_bytes{width * bytes_per_pixel};
+
+    // padded rows y - r to y + r, row y is kept in slot (y - first) % size
+    const int64_t first{(int64_t)begin - r};
+    std::vector<std::vector<uint8_t>> rows(size, std::vector<uint8_t>((width + 2 * r) * bytes_per_pixel));
+    auto load = [&](const int64_t y)
+        {
+            std::vector<uint8_t>& row{rows[(y - first) % size]};
+            const int64_t y_in{edge_index(y, height, edge)};
+            if(y_in < 0) std::fill(row.begin(), row.end(), 0x00);
+            else pad_row(row.data(), &m_data[index(0, y_in)], width, bytes_per_pixel, r, edge);
+        };
+    for(int64_t y{first}; y < (int64_t)begin + r; ++ y)
+    {
+        load(y);
+    }
+
+    for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+    {
+        load(y + r);
+        const uint8_t* window[5];
+        for(int64_t dy{0}; dy < size; ++ dy)
+        {
+            window[dy] = rows[(y - r + dy - first) % size].data();
+        }
+
+        uint8_t * const out{&output[index(0, y)]};
+        if(radius == 1) median_row<1>(window, out, row_bytes, bytes_per_pixel);
+        else median_row<2>(window, out, row_bytes, bytes_per_pixel);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// histograms
+////////////////////////////////////////////////////////////////////////////////
+
+// 16 bins of a histogram
+static inline void add_bins(uint16_t * const bins, const uint16_t * const other)
+{
+#if defined(__SSE2__)
+    _mm_storeu_si128((__m128i*)bins, _mm_add_epi16(_mm_loadu_si128((const __m128i*)bins), _mm_loadu_si128((const __m128i*)other)));
+    _mm_storeu_si128((__m128i*)(bins + 8), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(bins + 8)), _mm_loadu_si128((const __m128i*)(other + 8))));
+#else
+    for(int b{0}; b < 16; ++ b) bins[b] += other[b];
+#endif
+}
+
+
+static inline void subtract_bins(uint16_t * const bins, const uint16_t * const other)
+{
+#if defined(__SSE2__)
+    _mm_storeu_si128((__m128i*)bins, _mm_sub_epi16(_mm_loadu_si128((const __m128i*)bins), _mm_loadu_si128((const __m128i*)other)));
+    _mm_storeu_si128((__m128i*)(bins + 8), _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(bins + 8)), _mm_loadu_si128((const __m128i*)(other + 8))));
+#else
+    for(int b{0}; b < 16; ++ b) bins[b] -= other[b];
+#endif
+}
+
+
+// first of 16 bins at which the count of the bins so far, starting from
+// below, exceeds rank, below is advanced past the bins before it
+static inline int find_bin(const uint16_t * const bins, uint32_t& below, const uint32_t rank)
+{
+#if defined(__SSE2__)
+    // prefix sums of the bins, at most 65025 so they are compared unsigned
+    // by flipping the sign bit, then the first greater than rank - below
+    __m128i lo{_mm_loadu_si128((const __m128i*)bins)};
+    __m128i hi{_mm_loadu_si128((const __m128i*)(bins + 8))};
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+    hi = _mm_add_epi16(hi, _mm_shuffle_epi32(_mm_shufflehi_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+
+    const __m128i sign{_mm_set1_epi16((short)0x8000)};
+    const __m128i target{_mm_set1_epi16((short)((rank - below) ^ 0x8000))};
+    const int mask{_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_xor_si128(lo, sign), target)) |
+                   (_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_xor_si128(hi, sign), target)) << 16)};
+    const int bin{__builtin_ctz((unsigned)mask) / 2};
+
+    uint16_t prefix[16];
+    _mm_storeu_si128((__m128i*)prefix, lo);
+    _mm_storeu_si128((__m128i*)(prefix + 8), hi);
+    if(bin > 0) below += prefix[bin - 1];
+    return bin;
+#else
+    int bin{0};
+    while(below + bins[bin] <= rank)
+    {
+        below += bins[bin];
+        ++ bin;
+    }
+    return bin;
+#endif
+}
+
+
+// each column of a strip has a histogram of the 2 * radius + 1 values above
+// and below the current row, updated by one value in and one out per row
+// the window histogram slides along the row by adding and subtracting
+// column histograms, with 16 coarse bins (high 4 bits) updated at every
+// pixel and 16 fine histograms of 16 bins (low 4 bits) updated only when
+// the median falls in them, from the column at which they were last used
+void BMP::BITMAP::median_histogram(std::vector<uint8_t>& output, const int radius, const EdgeMode edge, const LONG begin, const LONG end) const
+{
+    const int64_t width{(int64_t)m_width};
+    const int64_t height{(int64_t)m_height};
+    const int64_t bytes_per_pixel{(int64_t)(m_bit_count / 8)};
+    const int64_t r{radius};
+    const int64_t size{2 * r + 1};
+    // the median is the value at which the count of the bins so far first
+    // exceeds rank
+    const uint32_t rank{(uint32_t)(size * size / 2)};
+
+    std::vector<uint16_t> fine((median_strip + 2 * r) * 256);
+    std::vector<uint16_t> coarse((median_strip + 2 * r) * 16);
+    std::vector<int64_t> columns(median_strip + 2 * r);
+    uint16_t window_coarse[16];
+    uint16_t window_fine[16 * 16];
+    int64_t window_fine_column[16];
+
+    for(int64_t x0{0}; x0 < width; x0 += median_strip)
+    {
+        // byte offset in a row of each column of the strip, -1 for zero
+        const int64_t x1{std::min(x0 + median_strip, width)};
+        const int64_t count{x1 - x0 + 2 * r};
+        for(int64_t p{0}; p < count; ++ p)
+        {
+            const int64_t x_in{edge_index(x0 - r + p, width, edge)};
+            columns[p] = (x_in < 0) ? -1 : x_in * bytes_per_pixel;
+        }
+
+        for(int64_t c{0}; c < bytes_per_pixel; ++ c)
+        {
+            auto update = [&](const int64_t y, const uint16_t delta)
+                {
+                    const int64_t y_in{edge_index(y, height, edge)};
+                    const uint8_t * const row{(y_in < 0) ? nullptr : &m_data[index(0, y_in) + c]};
+                    for(int64_t p{0}; p < count; ++ p)
+                    {
+                        const uint8_t value{(row == nullptr || columns[p] < 0) ? (uint8_t)0 : row[columns[p]]};
+                        fine[p * 256 + value] += delta;
+                        coarse[p * 16 + (value >> 4)] += delta;
+                    }
+                };
+
+            std::fill(fine.begin(), fine.begin() + count * 256, 0);
+            std::fill(coarse.begin(), coarse.begin() + count * 16, 0);
+            for(int64_t y{(int64_t)begin - r}; y <= (int64_t)begin + r; ++ y)
+            {
+                update(y, 1);
+            }
+
+            for(int64_t y{(int64_t)begin}; y < (int64_t)end; ++ y)
+            {
+                if(y > (int64_t)begin)
+                {
+                    update(y - r - 1, (uint16_t)-1);
+                    update(y + r, 1);
+                }
+
+                std::fill(window_coarse, window_coarse + 16, 0);
+                for(int64_t p{0}; p < size; ++ p)
+                {
+                    add_bins(window_coarse, &coarse[p * 16]);
+                }
+                std::fill(window_fine_column, window_fine_column + 16, -size);
+
+                uint8_t * const out{&output[index(x0, y) + c]};
+                for(int64_t x{0}; x < x1 - x0; ++ x)
+                {
+                    if(x > 0)
+                    {
+                        add_bins(window_coarse, &coarse[(x + 2 * r) * 16]);
+                        subtract_bins(window_coarse, &coarse[(x - 1) * 16]);
+                    }
+
+                    uint32_t below{0};
+                    const int k{find_bin(window_coarse, below, rank)};
+
+                    // bring fine histogram k to the window at x, rebuilding
+                    // it if that is cheaper
+                    uint16_t * const bins{&window_fine[k * 16]};
+                    if(x - window_fine_column[k] >= size)
+                    {
+                        std::fill(bins, bins + 16, 0);
+                        for(int64_t p{x}; p < x + size; ++ p)
+                        {
+                            add_bins(bins, &fine[p * 256 + k * 16]);
+                        }
+                    }
+                    else
+                    {
+                        for(int64_t p{window_fine_column[k]}; p < x; ++ p)
+                        {
+                            add_bins(bins, &fine[(p + size) * 256 + k * 16]);
+                            subtract_bins(bins, &fine[p * 256 + k * 16]);
+                        }
+                    }
+                    window_fine_column[k] = x;
+
+                    out[x * bytes_per_pixel] = (uint8_t)(k * 16 + find_bin(bins, below, rank));
+                }
+            }
+        }
+    }
+}
+
+
+void BMP::BITMAP::MedianFilter(const int radius, const EdgeMode edge)
+{
+    if(radius <= 0)
+    {
+        return;
+    }
+    if(radius > median_max_radius)
+    {
+        std::cerr << "MedianFilter error: radius larger than " << median_max_radius << std::endl;
+        return;
+    }
+    if(m_bit_count != 8 && m_bit_count != 24 && m_bit_count != 32)
+    {
+        std::cerr << "MedianFilter error: unsupported bit count " << m_bit_count << std::endl;
+        return;
+    }
+
+    std::vector<uint8_t> output(m_data.size(), 0x00);
+    ParallelBands(m_height, median_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            if(radius <= 2) median_network(output, radius, edge, begin, end);
+            else median_histogram(output, radius, edge, begin, end);
+        });
+    m_data.swap(output);
+    mark_dirty_all();
+}
@@ -0,0 +1,380 @@
+#include "bitmap.hpp"
+#include "bitmapmask.hpp"
+#include "parallel.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+// C headers
+#include <cstring>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows (or column chunks) processed by each thread
+static const BMP::LONG morphology_min_band{64};
+
+// bytes of each row filtered together by the vertical pass
+static const BMP::LONG morphology_chunk{64};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// van Herk / Gil-Werman
+////////////////////////////////////////////////////////////////////////////////
+
+// out[c] = min or max of a[c] and b[c] for count bytes
+template<bool MAX>
+static inline void morphology_bytes(uint8_t * const output, const uint8_t * const a, const uint8_t * const b, const BMP::LONG count)
+{
+    BMP::LONG c{0};
+#if defined(__SSE2__)
+    for(; c + 16 <= count; c += 16)
+    {
+        const __m128i va{_mm_loadu_si128((const __m128i*)(a + c))};
+        const __m128i vb{_mm_loadu_si128((const __m128i*)(b + c))};
+        _mm_storeu_si128((__m128i*)(output + c), MAX ? _mm_max_epu8(va, vb) : _mm_min_epu8(va, vb));
+    }
+#endif
+    for(; c < count; ++ c)
+    {
+        output[c] = MAX ? std::max(a[c], b[c]) : std::min(a[c], b[c]);
+    }
+}
+
+
+// filter a line of count elements in place, element i is bytes long and
+// starts at data + i * stride
+// the line is padded by radius elements of the identity on each side and
+// split into blocks of k = 2 * radius + 1, g holds the running min / max
+// from the start of each block and h from the end, so every window is the
+// min / max of one h and one g value
+// g and h hold (count + 2 * radius) * bytes bytes
+template<bool MAX>
+static void vhgw_line(uint8_t * const data, const BMP::LONG count, const BMP::LONG stride, const BMP::LONG bytes, const BMP::LONG radius, uint8_t * const g, uint8_t * const h)
+{
+    const BMP::LONG k{2 * radius + 1};
+    const BMP::LONG length{count + 2 * radius};
+
+    uint8_t identity[morphology_chunk];
+    memset(identity, MAX ? 0x00 : 0xFF, bytes);
+    auto input = [&](const BMP::LONG i) -> const uint8_t*
+        {
+            return (i < radius || i >= radius + count) ? identity : data + (i - radius) * stride;
+        };
+
+    BMP::LONG block{0};
+    for(BMP::LONG i{0}; i < length; ++ i)
+    {
+        if(block == 0)
+        {
+            memcpy(g + i * bytes, input(i), bytes);
+        }
+        else
+        {
+            morphology_bytes<MAX>(g + i * bytes, g + (i - 1) * bytes, input(i), bytes);
+        }
+        if(++ block == k) block = 0;
+    }
+
+    // position in block of the last element
+    block = (length - 1) % k;
+    for(BMP::LONG i{length}; i -- > 0; )
+    {
+        if(block == k - 1 || i == length - 1)
+        {
+            memcpy(h + i * bytes, input(i), bytes);
+        }
+        else
+        {
+            morphology_bytes<MAX>(h + i * bytes, h + (i + 1) * bytes, input(i), bytes);
+        }
+        block = (block == 0) ? k - 1 : block - 1;
+    }
+
+    // the window of output x is [x, x + k) of the padded line
+    for(BMP::LONG x{0}; x < count; ++ x)
+    {
+        morphology_bytes<MAX>(data + x * stride, h + x * bytes, g + (x + k - 1) * bytes, bytes);
+    }
+}
+
+
+template<bool MAX>
+static void morphology_pass(uint8_t * const data, const BMP::LONG width, const BMP::LONG height, const BMP::LONG row_stride,
+    const BMP::LONG bytes_per_pixel, const BMP::LONG radius_x, const BMP::LONG radius_y)
+{
+    // rows, one element per pixel
+    if(radius_x > 0)
+    {
+        BMP::ParallelBands(height, morphology_min_band, [&](const uint64_t begin, const uint64_t end)
+            {
+                std::vector<uint8_t> g((width + 2 * radius_x) * bytes_per_pixel);
+                std::vector<uint8_t> h(g.size());
+                for(BMP::LONG y{begin}; y < end; ++ y)
+                {
+                    vhgw_line<MAX>(data + y * row_stride, width, bytes_per_pixel, bytes_per_pixel, radius_x, g.data(), h.data());
+                }
+            });
+    }
+
+    // columns, one element per chunk of a row, so each step is SIMD
+    if(radius_y > 0)
+    {
+        const BMP::LONG row_bytes{width * bytes_per_pixel};
+        const BMP::LONG chunks{(row_bytes + morphology_chunk - 1) / morphology_chunk};
+        BMP::ParallelBands(chunks, 1, [&](const uint64_t begin, const uint64_t end)
+            {
+                std::vector<uint8_t> g((height + 2 * radius_y) * morphology_chunk);
+                std::vector<uint8_t> h(g.size());
+                for(BMP::LONG chunk{begin}; chunk < end; ++ chunk)
+                {
+                    const BMP::LONG offset{chunk * morphology_chunk};
+                    const BMP::LONG bytes{std::min(morphology_chunk, row_bytes - offset)};
+                    vhgw_line<MAX>(data + offset, height, row_stride, bytes, radius_y, g.data(), h.data());
+                }
+            });
+    }
+}
+
+
+void BMP::BITMAP::morphology(const bool dilate, const int radius_x, const int radius_y)
+{
+    if(radius_x < 0 || radius_y < 0)
+    {
+        std::cerr << "Morphology error: negative radius" << std::endl;
+        return;
+    }
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel == 0 || m_width == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    if(dilate)
+    {
+        morphology_pass<true>(m_data.data(), m_width, m_height, m_width_memory, bytes_per_pixel, radius_x, radius_y);
+    }
+    else
+    {
+        morphology_pass<false>(m_data.data(), m_width, m_height, m_width_memory, bytes_per_pixel, radius_x, radius_y);
+    }
+    mark_dirty_all();
+}
+
+
+void BMP::BITMAP::Erode(const int radius_x, const int radius_y)
+{
+    morphology(false, radius_x, radius_y);
+}
+
+
+void BMP::BITMAP::Dilate(const int radius_x, const int radius_y)
+{
+    morphology(true, radius_x, radius_y);
+}
+
+
+void BMP::BITMAP::Open(const int radius_x, const int radius_y)
+{
+    morphology(false, radius_x, radius_y);
+    morphology(true, radius_x, radius_y);
+}
+
+
+void BMP::BITMAP::Close(const int radius_x, const int radius_y)
+{
+    morphology(true, radius_x, radius_y);
+    morphology(false, radius_x, radius_y);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// bit-parallel masks
+////////////////////////////////////////////////////////////////////////////////
+
+// dst bit x = src bit x + shift, bits from beyond the row are fill
+static void shift_row_down(const uint64_t * const src, uint64_t * const dst, const BMP::LONG words, const BMP::LONG shift, const uint64_t fill)
+{
+    const BMP::LONG word_shift{shift / 64};
+    const BMP::LONG bit_shift{shift % 64};
+    for(BMP::LONG i{0}; i < words; ++ i)
+    {
+        const uint64_t lo{(i + word_shift < words) ? src[i + word_shift] : fill};
+        const uint64_t hi{(i + word_shift + 1 < words) ? src[i + word_shift + 1] : fill};
+        dst[i] = (bit_shift == 0) ? lo : ((lo >> bit_shift) | (hi << (64 - bit_shift)));
+    }
+}
+
+
+// dst bit x = src bit x - shift, bits from before the row are fill
+static void shift_row_up(const uint64_t * const src, uint64_t * const dst, const BMP::LONG words, const BMP::LONG shift, const uint64_t fill)
+{
+    const BMP::LONG word_shift{shift / 64};
+    const BMP::LONG bit_shift{shift % 64};
+    for(BMP::LONG i{0}; i < words; ++ i)
+    {
+        const uint64_t hi{(i >= word_shift) ? src[i - word_shift] : fill};
+        const uint64_t lo{(i >= word_shift + 1) ? src[i - word_shift - 1] : fill};
+        dst[i] = (bit_shift == 0) ? hi : ((hi << bit_shift) | (lo >> (64 - bit_shift)));
+    }
+}
+
+
+// result bit x = AND (or OR) of row bits x, x + 1 .. x + count - 1 (down) or
+// x, x - 1 .. x - count + 1 (up), by doubling the run length of partial
+// results, so log(count) shifts of the row
+// run and shifted are scratch rows
+template<bool OR>
+static void row_window(const uint64_t * const row, uint64_t * const result, uint64_t * const run, uint64_t * const shifted,
+    const BMP::LONG words, BMP::LONG count, const bool down)
+{
+    const uint64_t fill{OR ? (uint64_t)0 : ~(uint64_t)0};
+    auto shift = [&](const uint64_t * const src, const BMP::LONG s)
+        {
+            if(down) shift_row_down(src, shifted, words, s, fill);
+            else shift_row_up(src, shifted, words, s, fill);
+        };
+
+    // result covers offset bits, run covers length bits
+    std::fill(result, result + words, fill);
+    std::copy(row, row + words, run);
+    BMP::LONG offset{0};
+    BMP::LONG length{1};
+    while(count > 0)
+    {
+        if(count & 1)
+        {
+            shift(run, offset);
+            for(BMP::LONG i{0}; i < words; ++ i)
+            {
+                result[i] = OR ? (result[i] | shifted[i]) : (result[i] & shifted[i]);
+            }
+            offset += length;
+        }
+        count >>= 1;
+        if(count > 0)
+        {
+            shift(run, length);
+            for(BMP::LONG i{0}; i < words; ++ i)
+            {
+                run[i] = OR ? (run[i] | shifted[i]) : (run[i] & shifted[i]);
+            }
+            length *= 2;
+        }
+    }
+}
+
+
+void BMP::BITMAPMask::morphology(const bool dilate, const int radius_x, const int radius_y)
+{
+    if(radius_x < 0 || radius_y < 0)
+    {
+        std::cerr << "Morphology error: negative radius" << std::endl;
+        return;
+    }
+    if(m_words == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    const uint64_t fill{dilate ? (uint64_t)0 : ~(uint64_t)0};
+
+    // rows, the window is the combination of the runs right and left of x
+    if(radius_x > 0)
+    {
+        ParallelBands(m_height, morphology_min_band, [&](const uint64_t begin, const uint64_t end)
+            {
+                std::vector<uint64_t> row(m_words);
+                std::vector<uint64_t> right(m_words);
+                std::vector<uint64_t> left(m_words);
+                std::vector<uint64_t> run(m_words);
+                std::vector<uint64_t> shifted(m_words);
+                for(LONG y{begin}; y < end; ++ y)
+                {
+                    uint64_t * const output{&m_data[y * m_words]};
+                    std::copy(output, output + m_words, row.begin());
+                    // bits beyond the width are outside, so are the identity
+                    row[m_words - 1] |= fill & ~m_tail;
+                    if(dilate)
+                    {
+                        row_window<true>(row.data(), right.data(), run.data(), shifted.data(), m_words, radius_x + 1, true);
+                        row_window<true>(row.data(), left.data(), run.data(), shifted.data(), m_words, radius_x + 1, false);
+                        for(LONG i{0}; i < m_words; ++ i) output[i] = right[i] | left[i];
+                    }
+                    else
+                    {
+                        row_window<false>(row.data(), right.data(), run.data(), shifted.data(), m_words, radius_x + 1, true);
+                        row_window<false>(row.data(), left.data(), run.data(), shifted.data(), m_words, radius_x + 1, false);
+                        for(LONG i{0}; i < m_words; ++ i) output[i] = right[i] & left[i];
+                    }
+                    output[m_words - 1] &= m_tail;
+                }
+            });
+    }
+
+    // columns, whole rows of words are the elements of van Herk / Gil-Werman
+    if(radius_y > 0)
+    {
+        const LONG k{2 * (LONG)radius_y + 1};
+        const LONG length{m_height + 2 * radius_y};
+        const std::vector<uint64_t> identity(m_words, fill);
+        std::vector<uint64_t> g(length * m_words);
+        std::vector<uint64_t> h(length * m_words);
+        auto input = [&](const LONG i) -> const uint64_t*
+            {
+                return (i < (LONG)radius_y || i >= radius_y + m_height) ? identity.data() : &m_data[(i - radius_y) * m_words];
+            };
+        auto combine_row = [&](uint64_t * const output, const uint64_t * const a, const uint64_t * const b)
+            {
+                for(LONG w{0}; w < m_words; ++ w)
+                {
+                    output[w] = dilate ? (a[w] | b[w]) : (a[w] & b[w]);
+                }
+            };
+
+        for(LONG i{0}; i < length; ++ i)
+        {
+            if(i % k == 0) std::copy(input(i), input(i) + m_words, &g[i * m_words]);
+            else combine_row(&g[i * m_words], &g[(i - 1) * m_words], input(i));
+        }
+        for(LONG i{length}; i -- > 0; )
+        {
+            if(i % k == k - 1 || i == length - 1) std::copy(input(i), input(i) + m_words, &h[i * m_words]);
+            else combine_row(&h[i * m_words], &h[(i + 1) * m_words], input(i));
+        }
+        for(LONG y{0}; y < m_height; ++ y)
+        {
+            combine_row(&m_data[y * m_words], &h[y * m_words], &g[(y + k - 1) * m_words]);
+        }
+    }
+}
+
+
+void BMP::BITMAPMask::Erode(const int radius_x, const int radius_y)
+{
+    morphology(false, radius_x, radius_y);
+}
+
+
+void BMP::BITMAPMask::Dilate(const int radius_x, const int radius_y)
+{
+    morphology(true, radius_x, radius_y);
+}
+
+
+void BMP::BITMAPMask::Open(const int radius_x, const int radius_y)
+{
+    morphology(false, radius_x, radius_y);
+    morphology(true, radius_x, radius_y);
+}
+
+
+void BMP::BITMAPMask::Close(const int radius_x, const int radius_y)
+{
+    morphology(true, radius_x, radius_y);
+    morphology(false, radius_x, radius_y);
+}
@@ -0,0 +1,167 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+
+// POSIX headers
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+// minimum number of files probed by each thread
+static const BMP::LONG probe_min_band{64};
+
+
+const char* BMP::ProbeStatusMessage(const ProbeStatus status)
+{
+    switch(status)
+    {
+        case ProbeStatus::OK: return "";
+        case ProbeStatus::OPEN_FAILED: return "Unable to open input file";
+        case ProbeStatus::TRUNCATED: return "File head error: File is shorter than the headers.";
+        case ProbeStatus::BAD_SIGNATURE: return "File format error: Missing 'B'|'M' from head.";
+        case ProbeStatus::FILE_SIZE_MISMATCH: return "File head error: Head file size label does not match file size.";
+        case ProbeStatus::BAD_INFO_HEADER_SIZE: return "File info head error: Unexpected info head size value";
+        case ProbeStatus::BAD_PLANES: return "File info head error: Unexpected info head planes value";
+        case ProbeStatus::BAD_BIT_COUNT: return "File info head error: Unexpected info head bit count value";
+        case ProbeStatus::DATA_SIZE_MISMATCH: return "File info head error: Calculated file size does not match value calculated from header size, info header size, image width, height, depth.";
+        case ProbeStatus::COMPRESSED: return "Image is compressed, load abort";
+        case ProbeStatus::IMAGE_SIZE_MISMATCH: return "File info head error: Calculated file size does not match value calculated from image width, height, depth.";
+        case ProbeStatus::TOP_DOWN: return "File info head error: Negative image width or height, top down images are not supported.";
+    }
+    return "";
+}
+
+
+BMP::ProbeStatus BMP::BITMAP::validate_header(const BITMAPFILEHEADER& f_head, const BITMAPINFOHEADER& i_head, const uint64_t file_size, const bool one_bit)
+{
+    // 'B' is the first byte in the file
+    if(f_head.bfType != (((WORD)'M' << 0x08) | ((WORD)'B' << 0x00)))
+    {
+        return ProbeStatus::BAD_SIGNATURE;
+    }
+
+    if(f_head.bfSize != file_size)
+    {
+        return ProbeStatus::FILE_SIZE_MISMATCH;
+    }
+
+    if(i_head.biSize != sizeof(BITMAPINFOHEADER))
+    {
+        return ProbeStatus::BAD_INFO_HEADER_SIZE;
+    }
+
+    if(i_head.biPlanes != 1)
+    {
+        return ProbeStatus::BAD_PLANES;
+    }
+
+    if(one_bit ? (i_head.biBitCount != 1 || (i_head.biClrUsed != 0 && i_head.biClrUsed != 2)) :
+                 (i_head.biBitCount != 8 && i_head.biBitCount != 24 && i_head.biBitCount != 32))
+    {
+        return ProbeStatus::BAD_BIT_COUNT;
+    }
+
+    // width and height are signed in the file, negative values would also
+    // overflow the sizes below
+    if(i_head.biWidth > INT32_MAX || i_head.biHeight > INT32_MAX)
+    {
+        return ProbeStatus::TOP_DOWN;
+    }
+
+    const uint64_t row_bits{(uint64_t)i_head.biBitCount * i_head.biWidth};
+    const uint64_t expected_width_memory{(row_bits + 31) / 32 * 4};
+    const uint64_t expected_size{expected_width_memory * i_head.biHeight};
+    // 1 and 8 bit images have a color palette between the header and the data
+    uint64_t palette_size{0};
+    if(i_head.biBitCount == 1)
+    {
+        palette_size = 4 * 2;
+    }
+    else if(i_head.biBitCount == 8)
+    {
+        palette_size = 4 * ((i_head.biClrUsed != 0) ? (uint64_t)i_head.biClrUsed : 256);
+    }
+    // the pixel data must lie between the palette and the end of the file
+    const uint64_t data_begin{sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + palette_size};
+    if(file_size != data_begin + expected_size ||
+       f_head.bfOffBits < data_begin || (uint64_t)f_head.bfOffBits + expected_size > file_size)
+    {
+        return ProbeStatus::DATA_SIZE_MISMATCH;
+    }
+
+    if(i_head.biCompression != 0)
+    {
+        return ProbeStatus::COMPRESSED;
+    }
+
+    if(i_head.biSizeImage != expected_size)
+    {
+        return ProbeStatus::IMAGE_SIZE_MISMATCH;
+    }
+
+    return ProbeStatus::OK;
+}
+
+
+BMP::BITMAPInfo BMP::BITMAP::Probe(const std::string& filename)
+{
+    BITMAPInfo info;
+    memset(&info, 0, sizeof(info));
+    info.status = ProbeStatus::OPEN_FAILED;
+
+    // open, fstat and a single pread of both headers
+    const int fd{::open(filename.c_str(), O_RDONLY)};
+    if(fd < 0)
+    {
+        return info;
+    }
+
+    struct stat file_stat;
+    uint8_t head[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+    const bool stat_ok{fstat(fd, &file_stat) == 0};
+    const ssize_t count{stat_ok ? ::pread(fd, head, sizeof(head), 0) : -1};
+    ::close(fd);
+    if(!stat_ok || count < 0)
+    {
+        return info;
+    }
+    if((size_t)count < sizeof(head))
+    {
+        info.status = ProbeStatus::TRUNCATED;
+        return info;
+    }
+
+    BITMAPFILEHEADER f_head;
+    BITMAPINFOHEADER i_head;
+    memcpy(&f_head, head, sizeof(f_head));
+    memcpy(&i_head, head + sizeof(f_head), sizeof(i_head));
+
+    info.file_size = (uint64_t)file_stat.st_size;
+    info.status = validate_header(f_head, i_head, info.file_size);
+    if(info.status == ProbeStatus::OK)
+    {
+        info.width = i_head.biWidth;
+        info.height = i_head.biHeight;
+        info.bit_count = i_head.biBitCount;
+        info.data_offset = f_head.bfOffBits;
+    }
+    return info;
+}
+
+
+std::vector<BMP::BITMAPInfo> BMP::BITMAP::ProbeMany(const std::vector<std::string>& filenames)
+{
+    std::vector<BITMAPInfo> infos(filenames.size());
+    ParallelBands(filenames.size(), probe_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(uint64_t i{begin}; i < end; ++ i)
+            {
+                infos[i] = Probe(filenames[i]);
+            }
+        });
+    return infos;
+}
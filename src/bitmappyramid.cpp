@@ -0,0 +1,291 @@
+#include "bitmap.hpp"
+#include "arearesampler.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of source rows processed by each thread
+static const BMP::LONG pyramid_min_band{256};
+
+
+// average each 2x2 block of pixels
+// sums holds the vertical pair sums of each channel value
+template<int BPP>
+static void downsample_columns(const uint16_t * const sums, uint8_t * const dst, const BMP::LONG width)
+{
+    for(BMP::LONG x{0}; x < width; ++ x)
+    {
+        for(int c{0}; c < BPP; ++ c)
+        {
+            dst[x * BPP + c] = (uint8_t)((sums[2 * x * BPP + c] + sums[(2 * x + 1) * BPP + c] + 2) >> 2);
+        }
+    }
+}
+
+
+#if defined(__SSE2__)
+// 8 bit, 8 pixels per iteration, pairs are summed by multiply-add with 1
+template<>
+void downsample_columns<1>(const uint16_t * const sums, uint8_t * const dst, const BMP::LONG width)
+{
+    const __m128i ones{_mm_set1_epi16(1)};
+    const __m128i two{_mm_set1_epi16(2)};
+    BMP::LONG x{0};
+    for(; x + 8 <= width; x += 8)
+    {
+        const __m128i lo{_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sums + 2 * x)), ones)};
+        const __m128i hi{_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sums + 2 * x + 8)), ones)};
+        const __m128i sum{_mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(lo, hi), two), 2)};
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(sum, sum));
+    }
+    for(; x < width; ++ x)
+    {
+        dst[x] = (uint8_t)((sums[2 * x] + sums[2 * x + 1] + 2) >> 2);
+    }
+}
+
+
+// 24 bit, 4 pixels per iteration, each pixel is the sum of a load and the
+// same load shifted by one pixel, the 12 channel sums are then gathered
+// into 8 + 4 lanes
+template<>
+void downsample_columns<3>(const uint16_t * const sums, uint8_t * const dst, const BMP::LONG width)
+{
+    const __m128i two{_mm_set1_epi16(2)};
+    const __m128i low3{_mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1)};
+    auto pixel = [&](const BMP::LONG x)
+        {
+            const __m128i s{_mm_loadu_si128((const __m128i*)(sums + 6 * x))};
+            return _mm_and_si128(_mm_add_epi16(s, _mm_srli_si128(s, 6)), low3);
+        };
+    BMP::LONG x{0};
+    // the last load reads 8 sums from pixel x + 3
+    for(; x + 5 <= width; x += 4)
+    {
+        const __m128i a{_mm_or_si128(pixel(x), _mm_slli_si128(pixel(x + 1), 6))};
+        const __m128i b{_mm_or_si128(pixel(x + 2), _mm_slli_si128(pixel(x + 3), 6))};
+        const __m128i lo{_mm_srli_epi16(_mm_add_epi16(_mm_or_si128(a, _mm_slli_si128(b, 12)), two), 2)};
+        const __m128i hi{_mm_srli_epi16(_mm_add_epi16(_mm_srli_si128(b, 4), two), 2)};
+        const __m128i bytes{_mm_packus_epi16(lo, hi)};
+        _mm_storel_epi64((__m128i*)(dst + 3 * x), bytes);
+        const int32_t tail{_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8))};
+        memcpy(dst + 3 * x + 8, &tail, 4);
+    }
+    for(; x < width; ++ x)
+    {
+        for(int c{0}; c < 3; ++ c)
+        {
+            dst[x * 3 + c] = (uint8_t)((sums[6 * x + c] + sums[6 * x + 3 + c] + 2) >> 2);
+        }
+    }
+}
+
+
+// 32 bit, 2 pixels per iteration, the second pixel of each pair is
+// shifted onto the first
+template<>
+void downsample_columns<4>(const uint16_t * const sums, uint8_t * const dst, const BMP::LONG width)
+{
+    const __m128i two{_mm_set1_epi16(2)};
+    BMP::LONG x{0};
+    for(; x + 2 <= width; x += 2)
+    {
+        const __m128i s0{_mm_loadu_si128((const __m128i*)(sums + 8 * x))};
+        const __m128i s1{_mm_loadu_si128((const __m128i*)(sums + 8 * x + 8))};
+        const __m128i p0{_mm_add_epi16(s0, _mm_srli_si128(s0, 8))};
+        const __m128i p1{_mm_add_epi16(s1, _mm_srli_si128(s1, 8))};
+        const __m128i sum{_mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(p0, p1), two), 2)};
+        _mm_storel_epi64((__m128i*)(dst + 4 * x), _mm_packus_epi16(sum, sum));
+    }
+    for(; x < width; ++ x)
+    {
+        for(int c{0}; c < 4; ++ c)
+        {
+            dst[x * 4 + c] = (uint8_t)((sums[8 * x + c] + sums[8 * x + 4 + c] + 2) >> 2);
+        }
+    }
+}
+#endif
+
+
+// 2x2 box reduction of the rows top and bottom into dst, width is the
+// number of destination pixels
+static void downsample_rows(const uint8_t * const top, const uint8_t * const bottom, uint8_t * const dst, const BMP::LONG width, const BMP::LONG bytes_per_pixel, uint16_t * const sums)
+{
+    // vertical pair sums
+    const BMP::LONG count{2 * width * bytes_per_pixel};
+    BMP::LONG i{0};
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    for(; i + 16 <= count; i += 16)
+    {
+        const __m128i t{_mm_loadu_si128((const __m128i*)(top + i))};
+        const __m128i b{_mm_loadu_si128((const __m128i*)(bottom + i))};
+        _mm_storeu_si128((__m128i*)(sums + i), _mm_add_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(b, zero)));
+        _mm_storeu_si128((__m128i*)(sums + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(b, zero)));
+    }
+#endif
+    for(; i < count; ++ i)
+    {
+        sums[i] = (uint16_t)(top[i] + bottom[i]);
+    }
+
+    // horizontal pair sums
+    switch(bytes_per_pixel)
+    {
+        case 1: downsample_columns<1>(sums, dst, width); break;
+        case 2: downsample_columns<2>(sums, dst, width); break;
+        case 3: downsample_columns<3>(sums, dst, width); break;
+        case 4: downsample_columns<4>(sums, dst, width); break;
+        default:
+            for(BMP::LONG x{0}; x < width; ++ x)
+            {
+                for(BMP::LONG c{0}; c < bytes_per_pixel; ++ c)
+                {
+                    dst[x * bytes_per_pixel + c] = (uint8_t)((sums[2 * x * bytes_per_pixel + c] + sums[(2 * x + 1) * bytes_per_pixel + c] + 2) >> 2);
+                }
+            }
+            break;
+    }
+}
+
+
+void BMP::BITMAP::resize_area(const BITMAP& src, BITMAP& dst)
+{
+    const LONG bytes_per_pixel{(LONG)(src.m_bit_count / 8)};
+    AreaResampler resampler(src.m_width, src.m_height, dst.m_width, dst.m_height, bytes_per_pixel);
+    const LONG row_bytes{dst.m_width * bytes_per_pixel};
+    for(LONG y{0}; y < src.m_height; ++ y)
+    {
+        const LONG dst_y{resampler.DstRow()};
+        const uint8_t * const row{resampler.PushRow(&src.m_data[src.index(0, y)])};
+        if(row != nullptr)
+        {
+            memcpy(&dst.m_data[dst.index(0, dst_y)], row, row_bytes);
+        }
+    }
+}
+
+
+void BMP::BITMAP::ResizeArea(const int width, const int height)
+{
+    if(width <= 0 || height <= 0)
+    {
+        std::cerr << "Resize error: invalid size " << width << "x" << height << std::endl;
+        return;
+    }
+    if((LONG)width > m_width || (LONG)height > m_height)
+    {
+        Resize(width, height);
+        return;
+    }
+
+    BITMAP temp(width, height, m_bit_count);
+    resize_area(*this, temp);
+    *this = std::move(temp);
+}
+
+
+std::vector<BMP::BITMAP> BMP::BITMAP::BuildPyramid(const int levels) const
+{
+    std::vector<BITMAP> pyramid;
+    const LONG bytes_per_pixel{(LONG)(m_bit_count / 8)};
+    if(bytes_per_pixel == 0)
+    {
+        return pyramid;
+    }
+
+    int count{0};
+    while(count < levels && (m_width >> (count + 1)) > 0 && (m_height >> (count + 1)) > 0)
+    {
+        ++ count;
+    }
+    pyramid.reserve(count);
+    for(int level{0}; level < count; ++ level)
+    {
+        pyramid.emplace_back(m_width >> (level + 1), m_height >> (level + 1), m_bit_count);
+    }
+    if(count == 0)
+    {
+        return pyramid;
+    }
+
+    // each pair of rows of a level makes one row of the next, which is
+    // immediately paired with the row before it to make a row of the level
+    // after that, so all levels are built from rows which are still in cache
+    // blocks of 2^count source rows are independent of each other, so
+    // bands of blocks are processed in parallel
+    const LONG block{(LONG)1 << count};
+    const LONG blocks{(m_height + block - 1) / block};
+    const LONG min_band{(pyramid_min_band > block) ? pyramid_min_band / block : 1};
+    ParallelBands(blocks, min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            std::vector<const uint8_t*> pending(count, nullptr);
+            std::vector<LONG> next_row(count);
+            for(int level{0}; level < count; ++ level)
+            {
+                next_row[level] = (begin * block) >> (level + 1);
+            }
+            std::vector<uint16_t> sums(m_width_memory);
+
+            const LONG y_end{(end * block < m_height) ? end * block : m_height};
+            for(LONG y{begin * block}; y < y_end; ++ y)
+            {
+                const uint8_t* row{&m_data[index(0, y)]};
+                for(int level{0}; level < count; ++ level)
+                {
+                    if(pending[level] == nullptr)
+                    {
+                        pending[level] = row;
+                        break;
+                    }
+                    BITMAP& output{pyramid[level]};
+                    uint8_t * const dst{&output.m_data[output.index(0, next_row[level] ++)]};
+                    downsample_rows(pending[level], row, dst, output.m_width, bytes_per_pixel, sums.data());
+                    pending[level] = nullptr;
+                    row = dst;
+                }
+            }
+        });
+
+    return pyramid;
+}
+
+
+BMP::BITMAP BMP::BITMAP::ResizeFromPyramid(const std::vector<BITMAP>& pyramid, const int width, const int height) const
+{
+    if(width <= 0 || height <= 0)
+    {
+        std::cerr << "Resize error: invalid size " << width << "x" << height << std::endl;
+        return *this;
+    }
+
+    // levels get smaller, so the last large enough level is the best
+    const BITMAP* source{this};
+    for(const BITMAP& level : pyramid)
+    {
+        if(level.m_bit_count == m_bit_count && level.m_width >= (LONG)width && level.m_height >= (LONG)height)
+        {
+            source = &level;
+        }
+    }
+
+    if(source->m_width < (LONG)width || source->m_height < (LONG)height)
+    {
+        BITMAP result(*source);
+        result.Resize(width, height);
+        return result;
+    }
+
+    BITMAP result(width, height, m_bit_count);
+    resize_area(*source, result);
+    return result;
+}
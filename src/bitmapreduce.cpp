@@ -0,0 +1,67 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+// C headers
+#include <cstring>
+
+
+// bytes of a row combined at a time, the accumulator stays in L1 while every
+// input is folded into it
+static const BMP::LONG reduce_chunk{4096};
+
+// minimum number of rows reduced by each thread
+static const BMP::LONG reduce_min_band{64};
+
+
+void BMP::BITMAP::Reduce(const KernelMode mode, const std::vector<const BITMAP*>& bitmaps)
+{
+    if(mode == KernelMode::UNDEFINED || bitmaps.empty())
+    {
+        return;
+    }
+
+    LONG width{m_width};
+    LONG height{m_height};
+    for(const BITMAP* const bitmap : bitmaps)
+    {
+        if(bitmap->m_bit_count != m_bit_count)
+        {
+            std::cerr << "Reduce error: bit count mismatch" << std::endl;
+            return;
+        }
+        width = std::min(width, bitmap->m_width);
+        height = std::min(height, bitmap->m_height);
+    }
+    if(width == 0 || height == 0)
+    {
+        return;
+    }
+
+    const FunctorKernel kernel(mode);
+    const LONG row_bytes{width * (m_bit_count / 8)};
+    ParallelBands(height, reduce_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            // the output is only written after all inputs of a chunk have
+            // been read, so *this may alias any input
+            alignas(16) uint8_t accumulator[reduce_chunk];
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                for(LONG c{0}; c < row_bytes; c += reduce_chunk)
+                {
+                    const LONG count{std::min(reduce_chunk, row_bytes - c)};
+                    memcpy(accumulator, &bitmaps[0]->m_data[bitmaps[0]->index(0, y) + c], count);
+                    for(size_t i{1}; i < bitmaps.size(); ++ i)
+                    {
+                        kernel.row(accumulator, accumulator, &bitmaps[i]->m_data[bitmaps[i]->index(0, y) + c], count);
+                    }
+                    memcpy(&m_data[index(0, y) + c], accumulator, count);
+                }
+            }
+        });
+
+    mark_dirty(Rect{0, 0, (int)width, (int)height});
+}
@@ -0,0 +1,375 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C++ headers
+#include <algorithm>
+
+
+// rows labelled independently before the seams are merged
+static const BMP::LONG label_band{64};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// flood fill
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+
+    // pixels x1..x2 of row y were filled, the row y + dy is still to be
+    // scanned between them
+    struct Span
+    {
+        int64_t x1;
+        int64_t x2;
+        int64_t y;
+        int64_t dy;
+    };
+
+}
+
+
+template<typename F>
+static BMP::Rect flood_fill(const BMP::BasicBitmap<F> view, const int64_t seed_x, const int64_t seed_y, const uint8_t* const color)
+{
+    typedef typename F::channel_type C;
+    const int64_t width{(int64_t)view.Width()};
+    const int64_t height{(int64_t)view.Height()};
+    if(seed_x < 0 || seed_y < 0 || seed_x >= width || seed_y >= height)
+    {
+        return BMP::Rect{0, 0, 0, 0};
+    }
+
+    C target[F::channels];
+    bool same{true};
+    for(int c{0}; c < F::channels; ++ c)
+    {
+        target[c] = view.Pixel(seed_x, seed_y)[c];
+        same = same && (target[c] == color[c]);
+    }
+    if(same)
+    {
+        return BMP::Rect{0, 0, 0, 0};
+    }
+
+    auto inside = [&](const int64_t x, const int64_t y)
+        {
+            if(x < 0 || y < 0 || x >= width || y >= height)
+            {
+                return false;
+            }
+            const C * const p{view.Pixel(x, y)};
+            for(int c{0}; c < F::channels; ++ c)
+            {
+                if(p[c] != target[c]) return false;
+            }
+            return true;
+        };
+
+    int64_t x_min{seed_x};
+    int64_t x_max{seed_x};
+    int64_t y_min{seed_y};
+    int64_t y_max{seed_y};
+    auto set = [&](const int64_t x, const int64_t y)
+        {
+            C * const p{view.Pixel(x, y)};
+            for(int c{0}; c < F::channels; ++ c)
+            {
+                p[c] = color[c];
+            }
+            x_min = std::min(x_min, x);
+            x_max = std::max(x_max, x);
+            y_min = std::min(y_min, y);
+            y_max = std::max(y_max, y);
+        };
+
+    // the stack keeps its memory between fills on the same thread
+    static thread_local std::vector<Span> stack;
+    stack.clear();
+    stack.push_back(Span{seed_x, seed_x, seed_y, 1});
+    stack.push_back(Span{seed_x, seed_x, seed_y - 1, -1});
+    while(!stack.empty())
+    {
+        const Span span{stack.back()};
+        stack.pop_back();
+
+        int64_t x1{span.x1};
+        const int64_t x2{span.x2};
+        const int64_t y{span.y};
+        const int64_t dy{span.dy};
+
+        // extend left of the span, the extension may leak back into the row
+        // the span came from
+        int64_t x{x1};
+        if(inside(x, y))
+        {
+            while(inside(x - 1, y))
+            {
+                set(x - 1, y);
+                -- x;
+            }
+            if(x < x1)
+            {
+                stack.push_back(Span{x, x1 - 1, y - dy, -dy});
+            }
+        }
+
+        while(x1 <= x2)
+        {
+            while(inside(x1, y))
+            {
+                set(x1, y);
+                ++ x1;
+            }
+            if(x1 > x)
+            {
+                stack.push_back(Span{x, x1 - 1, y + dy, dy});
+            }
+            // extended right of the span
+            if(x1 - 1 > x2)
+            {
+                stack.push_back(Span{x2 + 1, x1 - 1, y - dy, -dy});
+            }
+            ++ x1;
+            while(x1 < x2 && !inside(x1, y))
+            {
+                ++ x1;
+            }
+            x = x1;
+        }
+    }
+
+    return BMP::Rect{(int)x_min, (int)y_min, (int)(x_max - x_min + 1), (int)(y_max - y_min + 1)};
+}
+
+
+BMP::Rect BMP::BITMAP::FloodFill(const int x, const int y, const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a)
+{
+    // memory order is b, g, r, a
+    const uint8_t color[4]{b, g, r, a};
+    Rect filled{0, 0, 0, 0};
+    switch(m_bit_count)
+    {
+        case 8: filled = flood_fill(view_unmarked<Gray8>(), x, y, color); break;
+        case 24: filled = flood_fill(view_unmarked<Bgr24>(), x, y, color); break;
+        case 32: filled = flood_fill(view_unmarked<Bgra32>(), x, y, color); break;
+        default:
+            std::cerr << "FloodFill error: unsupported bit count " << m_bit_count << std::endl;
+            return filled;
+    }
+    mark_dirty(filled);
+    return filled;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// connected components
+////////////////////////////////////////////////////////////////////////////////
+
+// root of label, with path halving
+static uint32_t find_root(std::vector<uint32_t>& parent, uint32_t label)
+{
+    while(parent[label] != label)
+    {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
+}
+
+
+// the smaller root becomes the root of both, so every label points to a
+// smaller or equal label
+static void unite(std::vector<uint32_t>& parent, const uint32_t l, const uint32_t r)
+{
+    const uint32_t root_l{find_root(parent, l)};
+    const uint32_t root_r{find_root(parent, r)};
+    if(root_l < root_r) parent[root_r] = root_l;
+    else if(root_r < root_l) parent[root_l] = root_r;
+}
+
+
+template<typename F>
+static bool foreground(const typename F::channel_type * const p)
+{
+    for(int c{0}; c < F::channels; ++ c)
+    {
+        if(c != F::a && p[c] != 0) return true;
+    }
+    return false;
+}
+
+
+// label rows y_begin..y_end without looking outside them, new labels of the
+// band start at y_begin * width + 1 so that bands never share a label
+template<typename F, typename BYTE_TYPE>
+static void label_rows(const BMP::BasicBitmap<F, BYTE_TYPE> view, const BMP::LONG y_begin, const BMP::LONG y_end, const bool eight,
+    std::vector<uint32_t>& labels, std::vector<uint32_t>& parent)
+{
+    const BMP::LONG width{view.Width()};
+    uint32_t next{(uint32_t)(y_begin * width + 1)};
+    for(BMP::LONG y{y_begin}; y < y_end; ++ y)
+    {
+        const typename BMP::BasicBitmap<F, BYTE_TYPE>::channel_type * const row{view.Row(y)};
+        uint32_t * const label_row{&labels[y * width]};
+        const uint32_t * const above{(y > y_begin) ? &labels[(y - 1) * width] : nullptr};
+        for(BMP::LONG x{0}; x < width; ++ x)
+        {
+            if(!foreground<F>(row + x * F::channels))
+            {
+                continue;
+            }
+
+            uint32_t label{0};
+            auto join = [&](const uint32_t neighbour)
+                {
+                    if(neighbour == 0) return;
+                    if(label == 0) label = neighbour;
+                    else if(neighbour != label) unite(parent, label, neighbour);
+                };
+            if(x > 0) join(label_row[x - 1]);
+            if(above != nullptr)
+            {
+                if(eight && x > 0) join(above[x - 1]);
+                join(above[x]);
+                if(eight && x + 1 < width) join(above[x + 1]);
+            }
+            if(label == 0)
+            {
+                label = next ++;
+                parent[label] = label;
+            }
+            label_row[x] = label;
+        }
+    }
+}
+
+
+BMP::ComponentLabels BMP::BITMAP::ConnectedComponents(const Connectivity connectivity) const
+{
+    ComponentLabels result;
+    result.width = m_width;
+    result.height = m_height;
+
+    const LONG pixels{m_width * m_height};
+    if(pixels >= UINT32_MAX)
+    {
+        std::cerr << "ConnectedComponents error: too many pixels" << std::endl;
+        result.width = 0;
+        result.height = 0;
+        return result;
+    }
+    result.labels.assign(pixels, 0);
+
+    // parent[0] is unused, a label with parent 0 was never created
+    std::vector<uint32_t> parent(pixels + 1, 0);
+    const bool eight{connectivity == Connectivity::EIGHT};
+    const LONG bands{(m_height + label_band - 1) / label_band};
+
+    const bool supported{Dispatch([&](const auto view)
+        {
+            ParallelBands(bands, 1, [&](const uint64_t begin, const uint64_t end)
+                {
+                    for(LONG band{begin}; band < end; ++ band)
+                    {
+                        const LONG y_begin{band * label_band};
+                        label_rows(view, y_begin, std::min(y_begin + label_band, m_height), eight, result.labels, parent);
+                    }
+                });
+        })};
+    if(!supported)
+    {
+        std::cerr << "ConnectedComponents error: unsupported bit count " << m_bit_count << std::endl;
+        std::fill(result.labels.begin(), result.labels.end(), 0);
+        return result;
+    }
+
+    // merge labels across the seam above each band
+    for(LONG band{1}; band < bands; ++ band)
+    {
+        const LONG y{band * label_band};
+        const uint32_t * const row{&result.labels[y * m_width]};
+        const uint32_t * const below{&result.labels[(y - 1) * m_width]};
+        for(LONG x{0}; x < m_width; ++ x)
+        {
+            if(row[x] == 0) continue;
+            if(eight && x > 0 && below[x - 1] != 0) unite(parent, row[x], below[x - 1]);
+            if(below[x] != 0) unite(parent, row[x], below[x]);
+            if(eight && x + 1 < m_width && below[x + 1] != 0) unite(parent, row[x], below[x + 1]);
+        }
+    }
+
+    // parents are never larger than their children, so in increasing order
+    // the parent of a label is already resolved to its root
+    std::vector<uint32_t> component(pixels + 1, 0);
+    uint32_t count{0};
+    for(LONG label{1}; label <= pixels; ++ label)
+    {
+        if(parent[label] == 0)
+        {
+            continue;
+        }
+        if(parent[label] == label)
+        {
+            component[label] = ++ count;
+        }
+        else
+        {
+            parent[label] = parent[parent[label]];
+            component[label] = component[parent[label]];
+        }
+    }
+
+    // final labels
+    ParallelBands(m_height, label_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG i{begin * m_width}; i < end * m_width; ++ i)
+            {
+                result.labels[i] = component[result.labels[i]];
+            }
+        });
+
+    // component statistics in one pass over the labels, O(pixels +
+    // components) however many components there are
+    struct Sums
+    {
+        LONG x_min;
+        LONG y_min;
+        LONG x_max;
+        LONG y_max;
+        uint64_t area;
+        uint64_t sum_x;
+        uint64_t sum_y;
+    };
+    std::vector<Sums> sums(count, Sums{m_width, m_height, 0, 0, 0, 0, 0});
+    for(LONG y{0}; y < m_height; ++ y)
+    {
+        const uint32_t * const row{&result.labels[y * m_width]};
+        for(LONG x{0}; x < m_width; ++ x)
+        {
+            if(row[x] == 0) continue;
+            Sums& s{sums[row[x] - 1]};
+            s.x_min = std::min(s.x_min, x);
+            s.y_min = std::min(s.y_min, y);
+            s.x_max = std::max(s.x_max, x);
+            s.y_max = std::max(s.y_max, y);
+            ++ s.area;
+            s.sum_x += x;
+            s.sum_y += y;
+        }
+    }
+
+    result.components.resize(count);
+    for(uint32_t i{0}; i < count; ++ i)
+    {
+        const Sums& s{sums[i]};
+        Component& c{result.components[i]};
+        c.bounds = Rect{(int)s.x_min, (int)s.y_min, (int)(s.x_max - s.x_min + 1), (int)(s.y_max - s.y_min + 1)};
+        c.area = s.area;
+        c.centroid_x = (double)s.sum_x / s.area;
+        c.centroid_y = (double)s.sum_y / s.area;
+    }
+
+    return result;
+}
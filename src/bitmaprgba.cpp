@@ -0,0 +1,150 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+// minimum number of rows converted by each thread
+static const BMP::LONG rgba_min_band{256};
+
+
+// 8 bit gray to r, g, b, a
+static void row_gray_to_rgba(const uint8_t * const src, uint8_t * const dst, const BMP::LONG count)
+{
+    for(BMP::LONG x{0}; x < count; ++ x)
+    {
+        const uint32_t pixel{(uint32_t)src[x] * 0x00010101u | 0xFF000000u};
+        memcpy(dst + 4 * x, &pixel, 4);
+    }
+}
+
+
+// b, g, r to r, g, b, a
+static void row_bgr_to_rgba(const uint8_t * const src, uint8_t * const dst, const BMP::LONG count)
+{
+    BMP::LONG x{0};
+
+#if defined(__SSSE3__)
+    // 4 pixels per 16 byte load, the load reads 4 bytes beyond the pixels
+    // used, so the last two pixels are left to the scalar loop
+    const __m128i shuffle{_mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)};
+    const __m128i alpha{_mm_set1_epi32((int)0xFF000000)};
+    for(; x + 6 <= count; x += 4)
+    {
+        const __m128i v{_mm_loadu_si128((const __m128i*)(src + 3 * x))};
+        _mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+    }
+#elif defined(__SSE2__)
+    // spread the pixels into 32 bit lanes with byte shifts, then swap the
+    // low and high bytes of each lane as for 32 bit pixels
+    const __m128i green{_mm_set1_epi32(0x0000FF00)};
+    const __m128i low{_mm_set1_epi32(0x000000FF)};
+    const __m128i alpha{_mm_set1_epi32((int)0xFF000000)};
+    for(; x + 6 <= count; x += 4)
+    {
+        const __m128i v{_mm_loadu_si128((const __m128i*)(src + 3 * x))};
+        const __m128i p01{_mm_unpacklo_epi32(v, _mm_srli_si128(v, 3))};
+        const __m128i p23{_mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9))};
+        const __m128i p{_mm_unpacklo_epi64(p01, p23)};
+        const __m128i r{_mm_and_si128(_mm_srli_epi32(p, 16), low)};
+        const __m128i b{_mm_slli_epi32(_mm_and_si128(p, low), 16)};
+        _mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_or_si128(_mm_or_si128(_mm_and_si128(p, green), alpha), _mm_or_si128(r, b)));
+    }
+#endif
+
+    for(; x < count; ++ x)
+    {
+        dst[4 * x + 0] = src[3 * x + 2];
+        dst[4 * x + 1] = src[3 * x + 1];
+        dst[4 * x + 2] = src[3 * x + 0];
+        dst[4 * x + 3] = 0xFF;
+    }
+}
+
+
+// b, g, r, a to r, g, b, a
+static void row_bgra_to_rgba(const uint8_t * const src, uint8_t * const dst, const BMP::LONG count)
+{
+    BMP::LONG x{0};
+
+#if defined(__SSSE3__)
+    const __m128i shuffle{_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)};
+    for(; x + 4 <= count; x += 4)
+    {
+        const __m128i v{_mm_loadu_si128((const __m128i*)(src + 4 * x))};
+        _mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_shuffle_epi8(v, shuffle));
+    }
+#elif defined(__SSE2__)
+    // swap the low and high bytes of each 32 bit lane with shifts
+    const __m128i keep{_mm_set1_epi32((int)0xFF00FF00)};
+    const __m128i low{_mm_set1_epi32(0x000000FF)};
+    for(; x + 4 <= count; x += 4)
+    {
+        const __m128i v{_mm_loadu_si128((const __m128i*)(src + 4 * x))};
+        const __m128i r{_mm_and_si128(_mm_srli_epi32(v, 16), low)};
+        const __m128i b{_mm_slli_epi32(_mm_and_si128(v, low), 16)};
+        _mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(r, b)));
+    }
+#endif
+
+    for(; x < count; ++ x)
+    {
+        dst[4 * x + 0] = src[4 * x + 2];
+        dst[4 * x + 1] = src[4 * x + 1];
+        dst[4 * x + 2] = src[4 * x + 0];
+        dst[4 * x + 3] = src[4 * x + 3];
+    }
+}
+
+
+void BMP::BITMAP::CopyToRGBA(uint8_t * const dst) const
+{
+    CopyToRGBA(dst, Rect{0, 0, (int)m_width, (int)m_height});
+}
+
+
+void BMP::BITMAP::CopyToRGBA(uint8_t * const dst, const Rect& rect) const
+{
+    if(rect.x < 0 || rect.y < 0 || rect.width < 0 || rect.height < 0 ||
+       (LONG)rect.x + rect.width > m_width || (LONG)rect.y + rect.height > m_height)
+    {
+        std::cerr << "Copy error: rectangle outside bitmap" << std::endl;
+        return;
+    }
+    if(rect.width == 0 || rect.height == 0)
+    {
+        return;
+    }
+
+    void (*convert)(const uint8_t*, uint8_t*, LONG){nullptr};
+    switch(m_bit_count)
+    {
+        case 8: convert = row_gray_to_rgba; break;
+        case 24: convert = row_bgr_to_rgba; break;
+        case 32: convert = row_bgra_to_rgba; break;
+        default:
+            std::cerr << "Copy error: unsupported bit count " << m_bit_count << std::endl;
+            return;
+    }
+
+    // rows are stored bottom up, the first output row is the top row
+    const LONG dst_stride{(LONG)rect.width * 4};
+    ParallelBands(rect.height, rgba_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(LONG r{begin}; r < end; ++ r)
+            {
+                const LONG y{(LONG)rect.y + rect.height - 1 - r};
+                convert(&m_data[index(rect.x, y)], dst + r * dst_stride, rect.width);
+            }
+        });
+}
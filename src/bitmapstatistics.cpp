@@ -0,0 +1,106 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cstring>
+#include <cmath>
+
+// C++ headers
+#include <mutex>
+
+
+// minimum number of rows processed by each thread
+static const BMP::LONG statistics_min_band{256};
+
+// number of sub-histograms per channel
+// consecutive pixels usually have the same value, incrementing the same
+// counter back to back stalls each increment on the store of the previous
+// one, so consecutive pixels are counted in different sub-histograms
+static const int statistics_sub_histograms{4};
+
+
+BMP::BITMAPStatistics BMP::BITMAP::Statistics() const
+{
+    BITMAPStatistics statistics;
+    memset(&statistics, 0, sizeof(statistics));
+
+    const int bytes_per_pixel{m_bit_count / 8};
+    const int channels{(bytes_per_pixel > 4) ? 4 : bytes_per_pixel};
+    statistics.channels = channels;
+    statistics.pixels = m_width * m_height;
+    if(channels == 0 || statistics.pixels == 0)
+    {
+        return statistics;
+    }
+
+    std::mutex merge_mutex;
+    ParallelBands(m_height, statistics_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            // histogram[sub][channel][value]
+            std::vector<uint32_t> histogram(statistics_sub_histograms * 4 * 256, 0);
+            uint64_t non_zero{0};
+
+            for(LONG y{begin}; y < end; ++ y)
+            {
+                // only the pixels of each row are read, padding is skipped
+                const uint8_t * const row{&m_data[index(0, y)]};
+                for(LONG x{0}; x < m_width; ++ x)
+                {
+                    const uint8_t * const p{row + x * bytes_per_pixel};
+                    uint32_t * const sub{&histogram[(x % statistics_sub_histograms) * 4 * 256]};
+                    uint8_t any{0};
+                    for(int c{0}; c < channels; ++ c)
+                    {
+                        ++ sub[c * 256 + p[c]];
+                        any |= p[c];
+                    }
+                    non_zero += (any != 0);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            for(int s{0}; s < statistics_sub_histograms; ++ s)
+            {
+                for(int c{0}; c < channels; ++ c)
+                {
+                    const uint32_t * const sub{&histogram[(s * 4 + c) * 256]};
+                    for(int v{0}; v < 256; ++ v)
+                    {
+                        statistics.channel[c].histogram[v] += sub[v];
+                    }
+                }
+            }
+            statistics.non_zero_pixels += non_zero;
+        });
+
+    // moments follow from the histograms, so no further pass over the
+    // pixels is needed
+    const double n{(double)statistics.pixels};
+    for(int c{0}; c < channels; ++ c)
+    {
+        ChannelStatistics& channel{statistics.channel[c]};
+        uint64_t sum{0};
+        uint64_t sum_sq{0};
+        int min{-1};
+        int max{0};
+        for(int v{0}; v < 256; ++ v)
+        {
+            const uint64_t count{channel.histogram[v]};
+            if(count != 0)
+            {
+                if(min < 0) min = v;
+                max = v;
+            }
+            sum += count * v;
+            sum_sq += count * v * v;
+        }
+        channel.min = (uint8_t)min;
+        channel.max = (uint8_t)max;
+        channel.mean = (double)sum / n;
+        const double variance{(double)sum_sq / n - channel.mean * channel.mean};
+        channel.stddev = (variance > 0.0) ? std::sqrt(variance) : 0.0;
+    }
+
+    return statistics;
+}
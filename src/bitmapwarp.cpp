@@ -0,0 +1,364 @@
+#include "bitmap.hpp"
+#include "parallel.hpp"
+
+
+// C headers
+#include <cmath>
+#include <cstring>
+
+// C++ headers
+#include <algorithm>
+
+
+// destination is processed in square tiles, the source pixels read by a
+// tile lie close together whatever the rotation
+static const int64_t warp_tile{64};
+
+// minimum number of rows of tiles processed by each thread
+static const BMP::LONG warp_min_band{4};
+
+// source coordinates are stepped in 16.16 fixed point
+static const int64_t warp_one{1 << 16};
+static const int64_t warp_half{1 << 15};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// AffineMatrix
+////////////////////////////////////////////////////////////////////////////////
+
+BMP::AffineMatrix BMP::AffineMatrix::Identity()
+{
+    return AffineMatrix{1.0, 0.0, 0.0, 0.0, 1.0, 0.0};
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::Translation(const double dx, const double dy)
+{
+    return AffineMatrix{1.0, 0.0, dx, 0.0, 1.0, dy};
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::Scale(const double sx, const double sy)
+{
+    return AffineMatrix{sx, 0.0, 0.0, 0.0, sy, 0.0};
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::Shear(const double shx, const double shy)
+{
+    return AffineMatrix{1.0, shx, 0.0, shy, 1.0, 0.0};
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::Rotation(const double angle)
+{
+    const double c{std::cos(angle)};
+    const double s{std::sin(angle)};
+    return AffineMatrix{c, -s, 0.0, s, c, 0.0};
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::Rotation(const double angle, const double cx, const double cy)
+{
+    return Translation(cx, cy) * Rotation(angle) * Translation(-cx, -cy);
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::operator*(const AffineMatrix& r) const
+{
+    return AffineMatrix{a * r.a + b * r.d, a * r.b + b * r.e, a * r.c + b * r.f + c,
+                        d * r.a + e * r.d, d * r.b + e * r.e, d * r.c + e * r.f + f};
+}
+
+
+double BMP::AffineMatrix::Determinant() const
+{
+    return a * e - b * d;
+}
+
+
+BMP::AffineMatrix BMP::AffineMatrix::Inverse() const
+{
+    const double det{Determinant()};
+    const double ia{e / det};
+    const double ib{-b / det};
+    const double id{-d / det};
+    const double ie{a / det};
+    return AffineMatrix{ia, ib, -(ia * c + ib * f), id, ie, -(id * c + ie * f)};
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// spans
+////////////////////////////////////////////////////////////////////////////////
+
+// floor(n / d) for d > 0
+static inline int64_t floor_div(const int64_t n, const int64_t d)
+{
+    return (n >= 0) ? n / d : -((-n + d - 1) / d);
+}
+
+
+// restrict [begin, end) to the x for which lo <= f0 + x * df < hi
+// the coordinates are stepped exactly in fixed point, so every x in the
+// resulting span is in range and the sampling loops need no checks
+static void clip_span(const int64_t f0, const int64_t df, const int64_t lo, const int64_t hi, int64_t& begin, int64_t& end)
+{
+    int64_t first;
+    int64_t last;
+    if(df == 0)
+    {
+        if(f0 < lo || f0 >= hi)
+        {
+            end = begin;
+        }
+        return;
+    }
+    else if(df > 0)
+    {
+        first = -floor_div(f0 - lo, df);
+        last = -floor_div(f0 - hi, df);
+    }
+    else
+    {
+        first = floor_div(f0 - hi, -df) + 1;
+        last = floor_div(f0 - lo, -df) + 1;
+    }
+    begin = std::max(begin, first);
+    end = std::min(end, last);
+    if(end < begin)
+    {
+        end = begin;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// samplers
+////////////////////////////////////////////////////////////////////////////////
+
+// BPP is the number of bytes per pixel, or 0 to use bpp
+template<int BPP>
+static void warp_nearest(const uint8_t * const src, const int64_t stride, uint8_t* dst, int64_t u, int64_t v, const int64_t du, const int64_t dv, const int64_t count, const int64_t bpp)
+{
+    const int64_t n{(BPP > 0) ? BPP : bpp};
+    for(int64_t i{0}; i < count; ++ i)
+    {
+        const uint8_t * const p{src + (v >> 16) * stride + (u >> 16) * n};
+        for(int64_t c{0}; c < n; ++ c)
+        {
+            dst[c] = p[c];
+        }
+        dst += n;
+        u += du;
+        v += dv;
+    }
+}
+
+
+template<int BPP>
+static void warp_bilinear(const uint8_t * const src, const int64_t stride, uint8_t* dst, int64_t u, int64_t v, const int64_t du, const int64_t dv, const int64_t count, const int64_t bpp)
+{
+    const int64_t n{(BPP > 0) ? BPP : bpp};
+    for(int64_t i{0}; i < count; ++ i)
+    {
+        const uint32_t fx{(uint32_t)((u >> 8) & 0xFF)};
+        const uint32_t fy{(uint32_t)((v >> 8) & 0xFF)};
+        const uint8_t * const p00{src + (v >> 16) * stride + (u >> 16) * n};
+        const uint8_t * const p01{p00 + stride};
+        for(int64_t c{0}; c < n; ++ c)
+        {
+            const uint32_t bottom{p00[c] * (256 - fx) + p00[c + n] * fx};
+            const uint32_t top{p01[c] * (256 - fx) + p01[c + n] * fx};
+            dst[c] = (uint8_t)((bottom * (256 - fy) + top * fy + 32768) >> 16);
+        }
+        dst += n;
+        u += du;
+        v += dv;
+    }
+}
+
+
+// bilinear sample near the edge of the source, taps outside are clamped
+static void warp_bilinear_clamped(const uint8_t * const src, const int64_t stride, const int64_t width, const int64_t height, uint8_t* dst, int64_t u, int64_t v, const int64_t du, const int64_t dv, const int64_t count, const int64_t bpp)
+{
+    for(int64_t i{0}; i < count; ++ i)
+    {
+        const uint32_t fx{(uint32_t)((u >> 8) & 0xFF)};
+        const uint32_t fy{(uint32_t)((v >> 8) & 0xFF)};
+        const int64_t x0{std::min(std::max(u >> 16, (int64_t)0), width - 1)};
+        const int64_t y0{std::min(std::max(v >> 16, (int64_t)0), height - 1)};
+        const int64_t x1{std::min(std::max((u >> 16) + 1, (int64_t)0), width - 1)};
+        const int64_t y1{std::min(std::max((v >> 16) + 1, (int64_t)0), height - 1)};
+        const uint8_t * const p00{src + y0 * stride + x0 * bpp};
+        const uint8_t * const p10{src + y0 * stride + x1 * bpp};
+        const uint8_t * const p01{src + y1 * stride + x0 * bpp};
+        const uint8_t * const p11{src + y1 * stride + x1 * bpp};
+        for(int64_t c{0}; c < bpp; ++ c)
+        {
+            const uint32_t bottom{p00[c] * (256 - fx) + p10[c] * fx};
+            const uint32_t top{p01[c] * (256 - fx) + p11[c] * fx};
+            dst[c] = (uint8_t)((bottom * (256 - fy) + top * fy + 32768) >> 16);
+        }
+        dst += bpp;
+        u += du;
+        v += dv;
+    }
+}
+
+
+typedef void (*warp_span_function)(const uint8_t*, int64_t, uint8_t*, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+
+
+// span sampler specialized for the common pixel sizes
+static warp_span_function warp_span(const BMP::Interpolation interpolation, const int64_t bpp)
+{
+    if(interpolation == BMP::Interpolation::NEAREST)
+    {
+        switch(bpp)
+        {
+            case 1: return warp_nearest<1>;
+            case 3: return warp_nearest<3>;
+            case 4: return warp_nearest<4>;
+            default: return warp_nearest<0>;
+        }
+    }
+    switch(bpp)
+    {
+        case 1: return warp_bilinear<1>;
+        case 3: return warp_bilinear<3>;
+        case 4: return warp_bilinear<4>;
+        default: return warp_bilinear<0>;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Warp
+////////////////////////////////////////////////////////////////////////////////
+
+void BMP::BITMAP::Warp(BITMAP& dst, const AffineMatrix& matrix, const Interpolation interpolation) const
+{
+    if(&dst == this)
+    {
+        // source and destination overlap, warp from a copy
+        const BITMAP copy(*this);
+        copy.Warp(dst, matrix, interpolation);
+        return;
+    }
+
+    if(dst.m_bit_count != m_bit_count)
+    {
+        std::cerr << "Warp error: source and destination bit count differ" << std::endl;
+        return;
+    }
+
+    if(matrix.Determinant() == 0.0)
+    {
+        std::cerr << "Warp error: matrix is not invertible" << std::endl;
+        return;
+    }
+
+    const int64_t bpp{(int64_t)(m_bit_count / 8)};
+    const int64_t src_width{(int64_t)m_width};
+    const int64_t src_height{(int64_t)m_height};
+    const int64_t dst_width{(int64_t)dst.m_width};
+    const int64_t dst_height{(int64_t)dst.m_height};
+    if(bpp == 0 || src_width == 0 || src_height == 0 || dst_width == 0 || dst_height == 0)
+    {
+        return;
+    }
+
+    // destination pixel centers are mapped back into the source, the
+    // source coordinate is stepped along each row, so there is one matrix
+    // multiply per row of each tile
+    const AffineMatrix inverse{matrix.Inverse()};
+    const int64_t du{std::llround(inverse.a * warp_one)};
+    const int64_t dv{std::llround(inverse.d * warp_one)};
+    const bool bilinear{interpolation == Interpolation::BILINEAR};
+    const warp_span_function span{warp_span(interpolation, bpp)};
+    const uint8_t * const src{m_data.data()};
+    const int64_t stride{(int64_t)m_width_memory};
+
+    const LONG tiles_y{(LONG)((dst_height + warp_tile - 1) / warp_tile)};
+    ParallelBands(tiles_y, warp_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(int64_t tile_y{(int64_t)begin}; tile_y < (int64_t)end; ++ tile_y)
+            {
+                const int64_t y_end{std::min((tile_y + 1) * warp_tile, dst_height)};
+                for(int64_t x0{0}; x0 < dst_width; x0 += warp_tile)
+                {
+                    const int64_t x_end{std::min(x0 + warp_tile, dst_width)};
+                    for(int64_t y{tile_y * warp_tile}; y < y_end; ++ y)
+                    {
+                        uint8_t * const row{&dst.m_data[dst.index(0, y)]};
+
+                        // source position of the center of pixel (x0, y)
+                        int64_t u{std::llround((inverse.a * (x0 + 0.5) + inverse.b * (y + 0.5) + inverse.c) * warp_one)};
+                        int64_t v{std::llround((inverse.d * (x0 + 0.5) + inverse.e * (y + 0.5) + inverse.f) * warp_one)};
+
+                        if(!bilinear)
+                        {
+                            int64_t b{0};
+                            int64_t e{x_end - x0};
+                            clip_span(u, du, 0, src_width * warp_one, b, e);
+                            clip_span(v, dv, 0, src_height * warp_one, b, e);
+                            span(src, stride, row + (x0 + b) * bpp, u + b * du, v + b * dv, du, dv, e - b, bpp);
+                            continue;
+                        }
+
+                        // bilinear taps are the pixels either side of the
+                        // sample, relative to pixel centers
+                        u -= warp_half;
+                        v -= warp_half;
+
+                        // pixels whose center maps inside the source
+                        int64_t outer_b{0};
+                        int64_t outer_e{x_end - x0};
+                        clip_span(u, du, -warp_half, src_width * warp_one - warp_half, outer_b, outer_e);
+                        clip_span(v, dv, -warp_half, src_height * warp_one - warp_half, outer_b, outer_e);
+
+                        // pixels whose taps are all inside the source
+                        int64_t inner_b{outer_b};
+                        int64_t inner_e{outer_e};
+                        clip_span(u, du, 0, (src_width - 1) * warp_one, inner_b, inner_e);
+                        clip_span(v, dv, 0, (src_height - 1) * warp_one, inner_b, inner_e);
+                        if(inner_b == inner_e)
+                        {
+                            inner_b = outer_e;
+                            inner_e = outer_e;
+                        }
+
+                        warp_bilinear_clamped(src, stride, src_width, src_height, row + (x0 + outer_b) * bpp, u + outer_b * du, v + outer_b * dv, du, dv, inner_b - outer_b, bpp);
+                        span(src, stride, row + (x0 + inner_b) * bpp, u + inner_b * du, v + inner_b * dv, du, dv, inner_e - inner_b, bpp);
+                        warp_bilinear_clamped(src, stride, src_width, src_height, row + (x0 + inner_e) * bpp, u + inner_e * du, v + inner_e * dv, du, dv, outer_e - inner_e, bpp);
+                    }
+                }
+            }
+        });
+
+    // only the bounding box of the transformed source can have changed
+    double x_min{HUGE_VAL};
+    double y_min{HUGE_VAL};
+    double x_max{-HUGE_VAL};
+    double y_max{-HUGE_VAL};
+    for(int corner{0}; corner < 4; ++ corner)
+    {
+        const double sx{(corner & 1) ? (double)src_width : 0.0};
+        const double sy{(corner & 2) ? (double)src_height : 0.0};
+        const double dx{matrix.a * sx + matrix.b * sy + matrix.c};
+        const double dy{matrix.d * sx + matrix.e * sy + matrix.f};
+        x_min = std::min(x_min, dx);
+        y_min = std::min(y_min, dy);
+        x_max = std::max(x_max, dx);
+        y_max = std::max(y_max, dy);
+    }
+    x_min = std::max(std::floor(x_min) - 1.0, 0.0);
+    y_min = std::max(std::floor(y_min) - 1.0, 0.0);
+    x_max = std::min(std::ceil(x_max) + 1.0, (double)dst_width);
+    y_max = std::min(std::ceil(y_max) + 1.0, (double)dst_height);
+    if(x_min < x_max && y_min < y_max)
+    {
+        dst.mark_dirty(Rect{(int)x_min, (int)y_min, (int)(x_max - x_min), (int)(y_max - y_min)});
+    }
+}
@@ -0,0 +1,254 @@
+#include "integralimage.hpp"
+#include "parallel.hpp"
+
+
+// C++ headers
+#include <iostream>
+
+// SIMD headers
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// minimum number of rows, and of columns in the vertical pass, processed by
+// each thread
+static const BMP::LONG integral_min_band{256};
+
+
+// out[x] = sum of row[0..x], or of their squares
+// squares of bytes fit in 16 bits, so they are formed with 16 bit multiplies
+// and prefix sums are formed in registers with two (one for 64 bit lanes)
+// shifted adds plus the carry from the previous vector
+static void row_prefix(const uint8_t * const row, const BMP::LONG width, const bool square, uint32_t * const out)
+{
+    BMP::LONG x{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    __m128i carry{zero};
+    for(; x + 8 <= width; x += 8)
+    {
+        __m128i v{_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row + x)), zero)};
+        if(square) v = _mm_mullo_epi16(v, v);
+
+        __m128i lo{_mm_unpacklo_epi16(v, zero)};
+        lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+        lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+        lo = _mm_add_epi32(lo, carry);
+        carry = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 3, 3, 3));
+
+        __m128i hi{_mm_unpackhi_epi16(v, zero)};
+        hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+        hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
+        hi = _mm_add_epi32(hi, carry);
+        carry = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 3, 3, 3));
+
+        _mm_storeu_si128((__m128i*)(out + x), lo);
+        _mm_storeu_si128((__m128i*)(out + x + 4), hi);
+    }
+#endif
+
+    uint32_t sum{(x > 0) ? out[x - 1] : 0};
+    for(; x < width; ++ x)
+    {
+        sum += square ? (uint32_t)row[x] * row[x] : row[x];
+        out[x] = sum;
+    }
+}
+
+
+static void row_prefix(const uint8_t * const row, const BMP::LONG width, const bool square, uint64_t * const out)
+{
+    BMP::LONG x{0};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    __m128i carry{zero};
+    for(; x + 8 <= width; x += 8)
+    {
+        __m128i v{_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row + x)), zero)};
+        if(square) v = _mm_mullo_epi16(v, v);
+        const __m128i lo{_mm_unpacklo_epi16(v, zero)};
+        const __m128i hi{_mm_unpackhi_epi16(v, zero)};
+
+        __m128i parts[4]{_mm_unpacklo_epi32(lo, zero), _mm_unpackhi_epi32(lo, zero),
+                         _mm_unpacklo_epi32(hi, zero), _mm_unpackhi_epi32(hi, zero)};
+        for(int i{0}; i < 4; ++ i)
+        {
+            parts[i] = _mm_add_epi64(parts[i], _mm_slli_si128(parts[i], 8));
+            parts[i] = _mm_add_epi64(parts[i], carry);
+            carry = _mm_shuffle_epi32(parts[i], _MM_SHUFFLE(3, 2, 3, 2));
+            _mm_storeu_si128((__m128i*)(out + x + 2 * i), parts[i]);
+        }
+    }
+#endif
+
+    uint64_t sum{(x > 0) ? out[x - 1] : 0};
+    for(; x < width; ++ x)
+    {
+        sum += square ? (uint64_t)row[x] * row[x] : row[x];
+        out[x] = sum;
+    }
+}
+
+
+// row[x] += below[x] for x in begin..end
+static void add_row(uint32_t * const row, const uint32_t * const below, const BMP::LONG begin, const BMP::LONG end)
+{
+    BMP::LONG x{begin};
+#if defined(__SSE2__)
+    for(; x + 4 <= end; x += 4)
+    {
+        const __m128i sum{_mm_add_epi32(_mm_loadu_si128((const __m128i*)(row + x)), _mm_loadu_si128((const __m128i*)(below + x)))};
+        _mm_storeu_si128((__m128i*)(row + x), sum);
+    }
+#endif
+    for(; x < end; ++ x)
+    {
+        row[x] += below[x];
+    }
+}
+
+
+static void add_row(uint64_t * const row, const uint64_t * const below, const BMP::LONG begin, const BMP::LONG end)
+{
+    BMP::LONG x{begin};
+#if defined(__SSE2__)
+    for(; x + 2 <= end; x += 2)
+    {
+        const __m128i sum{_mm_add_epi64(_mm_loadu_si128((const __m128i*)(row + x)), _mm_loadu_si128((const __m128i*)(below + x)))};
+        _mm_storeu_si128((__m128i*)(row + x), sum);
+    }
+#endif
+    for(; x < end; ++ x)
+    {
+        row[x] += below[x];
+    }
+}
+
+
+// accumulate the row prefix sums of table down the columns, in strips of
+// columns so that each thread walks all rows of its own strip
+template<typename T>
+static void accumulate_columns(std::vector<T>& table, const BMP::LONG stride, const BMP::LONG height)
+{
+    BMP::ParallelBands(stride, integral_min_band, [&](const uint64_t begin, const uint64_t end)
+        {
+            for(BMP::LONG y{2}; y <= height; ++ y)
+            {
+                add_row(&table[y * stride], &table[(y - 1) * stride], begin, end);
+            }
+        });
+}
+
+
+BMP::IntegralImage::IntegralImage() :
+    m_width{0},
+    m_height{0},
+    m_stride{1},
+    m_wide_sum{false},
+    m_wide_sum_sq{false},
+    m_sum_32(1, 0),
+    m_sum_sq_32(1, 0)
+{
+}
+
+
+BMP::IntegralImage::IntegralImage(const BITMAP& bitmap, const int channel) :
+    IntegralImage(bitmap, channel, 0, bitmap.Height())
+{
+}
+
+
+BMP::IntegralImage::IntegralImage(const BITMAP& bitmap, const int channel, const LONG y_begin, const LONG y_end) :
+    IntegralImage()
+{
+    const int bit_count{bitmap.BitCount()};
+    if(bit_count != 8 && bit_count != 24 && bit_count != 32)
+    {
+        std::cerr << "IntegralImage error: requires 8, 24 or 32 bit image" << std::endl;
+        return;
+    }
+    if(channel < -1 || (bit_count > 8 && channel >= bit_count / 8))
+    {
+        std::cerr << "IntegralImage error: invalid channel " << channel << std::endl;
+        return;
+    }
+
+    if(y_begin > y_end || y_end > bitmap.Height())
+    {
+        std::cerr << "IntegralImage error: invalid rows " << y_begin << " to " << y_end << std::endl;
+        return;
+    }
+
+    m_width = bitmap.Width();
+    m_height = y_end - y_begin;
+    m_stride = m_width + 1;
+    const uint64_t pixels{m_width * m_height};
+    m_wide_sum = (pixels > UINT32_MAX / 255);
+    m_wide_sum_sq = (pixels > UINT32_MAX / (255 * 255));
+
+    const LONG table_size{(m_height + 1) * m_stride};
+    m_sum_32.clear();
+    m_sum_sq_32.clear();
+    if(m_wide_sum) m_sum_64.assign(table_size, 0);
+    else m_sum_32.assign(table_size, 0);
+    if(m_wide_sum_sq) m_sum_sq_64.assign(table_size, 0);
+    else m_sum_sq_32.assign(table_size, 0);
+
+    // prefix sums of each row into the table row above it, the first row
+    // and column stay 0
+    bitmap.Dispatch([&](const auto view)
+        {
+            typedef decltype(view) VIEW;
+            ParallelBands(m_height, integral_min_band, [&](const uint64_t begin, const uint64_t end)
+                {
+                    std::vector<uint8_t> values(m_width);
+                    for(LONG y{begin}; y < end; ++ y)
+                    {
+                        const auto * const row{view.Row(y_begin + y)};
+                        if(VIEW::channels == 1)
+                        {
+                            for(LONG x{0}; x < m_width; ++ x) values[x] = (uint8_t)row[x];
+                        }
+                        else if(channel >= 0)
+                        {
+                            for(LONG x{0}; x < m_width; ++ x) values[x] = (uint8_t)row[x * VIEW::channels + channel];
+                        }
+                        else
+                        {
+                            // luma as Grayscale
+                            for(LONG x{0}; x < m_width; ++ x)
+                            {
+                                const auto * const p{row + x * VIEW::channels};
+                                values[x] = (uint8_t)((7471 * p[0] + 38470 * p[1] + 19595 * p[2] + (1 << 15)) >> 16);
+                            }
+                        }
+
+                        const LONG offset{(y + 1) * m_stride + 1};
+                        if(m_wide_sum) row_prefix(values.data(), m_width, false, &m_sum_64[offset]);
+                        else row_prefix(values.data(), m_width, false, &m_sum_32[offset]);
+                        if(m_wide_sum_sq) row_prefix(values.data(), m_width, true, &m_sum_sq_64[offset]);
+                        else row_prefix(values.data(), m_width, true, &m_sum_sq_32[offset]);
+                    }
+                });
+        });
+
+    if(m_wide_sum) accumulate_columns(m_sum_64, m_stride, m_height);
+    else accumulate_columns(m_sum_32, m_stride, m_height);
+    if(m_wide_sum_sq) accumulate_columns(m_sum_sq_64, m_stride, m_height);
+    else accumulate_columns(m_sum_sq_32, m_stride, m_height);
+}
+
+
+BMP::LONG BMP::IntegralImage::Width() const
+{
+    return m_width;
+}
+
+
+BMP::LONG BMP::IntegralImage::Height() const
+{
+    return m_height;
+}
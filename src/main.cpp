@@ -1,4 +1,5 @@
 #include "bitmap.hpp"
+#include "bitmapdisplay.hpp"
 
 
 // SFML headers
@@ -15,31 +16,30 @@ int main()
 {
 
     BMP::BITMAP b("img.bmp");
-    BMP::BITMAP b_r(b);
-    BMP::BITMAP b_g(b);
-    BMP::BITMAP b_b(b);
 
-    // filter color channels
-    b_r.RGBFilterAND(0xFF, 0x00, 0x00);
-    b_g.RGBFilterAND(0x00, 0xFF, 0x00);
-    b_b.RGBFilterAND(0x00, 0x00, 0xFF);
+    // color channels as 8 bit images
+    BMP::BITMAP b_r;
+    BMP::BITMAP b_g;
+    BMP::BITMAP b_b;
+    b.SplitChannels(b_r, b_g, b_b);
 
-    b_r.Translate(-10, -5);
-    b_b.Translate(10, 0);
-
-    b_g.OR(b_r);
-    b_g.OR(b_b);
+    // offset the red and blue channels in a single pass
+    BMP::BITMAP b_shift(b);
+    b_shift.ShiftChannels(-10, -5, 0, 0, 10, 0);
 
     b.SaveAs("img_out.bmp");
     
     b_r.SaveAs("img_out_r.bmp");
     b_g.SaveAs("img_out_g.bmp");
     b_b.SaveAs("img_out_b.bmp");
+    b_shift.SaveAs("img_out_shift.bmp");
 
-    b_g.Resize(640, 480);
-    b_g.SaveAs("img_out_g_resize.bmp");
-    b_g.Resize(800, 600);
-    b_g.SaveAs("img_out_g_resize_2.bmp");
+    b_shift.Resize(640, 480);
+    b_shift.SaveAs("img_out_shift_resize.bmp");
+    const BMP::BITMAP b_shift_resize(b_shift);
+    b_shift.Resize(800, 600);
+    b_shift.SaveAs("img_out_shift_resize_2.bmp");
+    const BMP::BITMAP b_shift_resize_2(b_shift);
 
     ////////////////////////////////////////////////////////////////////////////
 
@@ -51,11 +51,9 @@ int main()
 
     sf::RenderWindow window(sf::VideoMode(800, 600), "cpp-bitmap-lib", sf::Style::Titlebar | sf::Style::Close);
 
-    sf::Texture texture;
-    if(!texture.loadFromFile("img_out_g_resize.bmp"))
-    {
-        std::cerr << "Texture load failure: " << std::endl;
-    }
+    // bitmaps are uploaded from memory, the texture is kept between frames
+    BMP::BITMAPDisplay display;
+    display.Update(b_shift_resize);
 
     // program main window
     while(window.isOpen())
@@ -81,27 +79,21 @@ int main()
                 {
                     if(event.key.code == sf::Keyboard::F1)
                     {
-                        if(!texture.loadFromFile("img_out_g_resize.bmp"))
-                        {
-                            std::cerr << "Texture load failure: " << std::endl;
-                        }
+                        display.Update(b_shift_resize);
                         std::cout << "F1" << std::endl;
                     }
                     else if(event.key.code == sf::Keyboard::F2)
                     {
-                        if(!texture.loadFromFile("img_out_g_resize_2.bmp"))
-                        {
-                            std::cerr << "Texture load failure: " << std::endl;
-                        }
+                        display.Update(b_shift_resize_2);
                         std::cout << "F2" << std::endl;
                     }
 
-                    if(window.getSize().x != texture.getSize().x)
+                    if(window.getSize().x != display.Size().x)
                     {
-                        if(window.getSize().y != texture.getSize().y)
+                        if(window.getSize().y != display.Size().y)
                         {
-                            window.setView(sf::View(sf::FloatRect(0.0, 0.0, texture.getSize().x, texture.getSize().y)));
-                            window.setSize(sf::Vector2u(texture.getSize().x, texture.getSize().y));
+                            window.setView(sf::View(sf::FloatRect(0.0, 0.0, display.Size().x, display.Size().y)));
+                            window.setSize(display.Size());
                         }
                     }
                 }
@@ -115,25 +107,7 @@ int main()
 
         window.clear(sf::Color::Black);
 
-        //texture.create(b.Width(), b.Height());
-        // requires RGBA
-
-        /*
-        if(!texture.loadFromMemory(b_g.SaveMem().data(), b_g.SaveMem().size()))
-        {
-            std::cerr << "Texture load failure: " << std::endl;
-        }
-
-        if(!texture.loadFromFile("img_out_g_resize.bmp"))
-        {
-            std::cerr << "Texture load failure: " << std::endl;
-        }
-        */
-
-        sf::Sprite sprite;
-        sprite.setTexture(texture);
-
-        window.draw(sprite);
+        display.Draw(window);
 
         window.display();
 